@@ -0,0 +1,62 @@
+import argparse
+import random
+
+from src.lz import LZCoder, HierachicalLZCoder, get_input_vocab, BYTE_INPUT, CODEPOINT_INPUT
+from .common import timed, print_table
+
+
+SAMPLES = {
+    "english": "the quick brown fox jumps over the lazy dog while the cat sleeps in the sun",
+    "chinese": "我们今天去公园散步天气很好孩子们在草地上玩耍老人们在树下下棋",
+    "japanese": "今日はとても良い天気ですね公園に行って散歩しましょう子供たちが遊んでいます",
+    "russian": "сегодня очень хорошая погода давайте пойдем гулять в парк дети играют",
+    "emoji": "🎉🎉 party time 😀😀 🚀 launch 🚀 🌍 hello world 🌍 👍👍",
+}
+
+
+def multilingual_text(num_chars: int, seed: int=0) -> str:
+    # short runs of words from every sample, so all scripts are interleaved.
+    rng = random.Random(seed)
+    pieces = {name: text.split(" ") if " " in text else [text[i:i+3] for i in range(0, len(text), 3)] for name, text in SAMPLES.items()}
+    out = []
+    length = 0
+    while length < num_chars:
+        words = pieces[rng.choice(list(pieces))]
+        run = " ".join(rng.choice(words) for _ in range(rng.randint(1, 6)))
+        out.append(run)
+        length += len(run) + 1
+    return " ".join(out)[:num_chars]
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--chars", type=int, default=20000)
+    parser.add_argument("--vocab", type=int, default=1024)
+    args = parser.parse_args()
+
+    train = multilingual_text(args.chars, seed=0)
+    test = multilingual_text(args.chars, seed=1)
+
+    rows = []
+    for name, cls in [("LZ", LZCoder), ("HLZ", HierachicalLZCoder)]:
+        for mode in [BYTE_INPUT, CODEPOINT_INPUT]:
+            coder = cls(output_vocab_size=args.vocab, input_vocab=get_input_vocab(train + test, mode), input_mode=mode)
+            _, train_time = timed(lambda: coder.encode(train, learn=True))
+            try:
+                encoded, encode_time = timed(lambda: coder.encode(test, learn=False), repeat=3)
+            except ValueError:
+                # the hierarchical coder can not encode contexts it never saw
+                # while frozen, so fall back to measuring on the training text.
+                encoded, encode_time = timed(lambda: coder.encode(train, learn=False), repeat=3)
+            rows.append([
+                name, mode,
+                len(encoded) / args.chars,
+                args.chars / train_time / 1e3,
+                args.chars / encode_time / 1e3,
+            ])
+
+    print_table(["coder", "input", "tokens/char", "train_kchar/s", "encode_kchar/s"], rows)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,39 @@
+import argparse
+import pickle
+
+from src.lz import LZCoder, HierachicalLZCoder
+from src.flat import FlatCoder, to_flat_bytes
+from src.compact import dumps, loads, loads_flat
+from .common import load_corpus, timed, print_table
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--chars", type=int, default=50000)
+    parser.add_argument("--vocab", type=int, default=1024)
+    args = parser.parse_args()
+
+    text = load_corpus(args.chars)
+    coders = {
+        "LZ": LZCoder(output_vocab_size=16 * args.vocab, input_vocab=set(range(256))),
+        "HLZ": HierachicalLZCoder(output_vocab_size=args.vocab, input_vocab=set(range(256))),
+    }
+    rows = []
+    for name, coder in coders.items():
+        coder.encode(text, learn=True)
+        formats = [
+            ("pickle", pickle.dumps(coder), pickle.loads),
+            ("flat", to_flat_bytes(coder), FlatCoder),
+        ]
+        for compression in [None, "zlib", "lzma"]:
+            data = dumps(coder, compression)
+            formats.append((f"compact {compression or 'raw'}", data, loads))
+            formats.append((f"compact {compression or 'raw'} -> flat", data, loads_flat))
+        for fmt, data, load in formats:
+            _, load_time = timed(lambda: load(data), repeat=3)
+            rows.append([name, fmt, len(data), load_time * 1e3])
+    print_table(["coder", "format", "bytes", "load_ms"], rows)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,49 @@
+import argparse
+import copy
+import sys
+
+from src.lz import LZCoder, HierachicalLZCoder, DecodeTable
+from .common import load_corpus, synthetic_text, timed, print_table
+
+
+def table_bytes(table: DecodeTable) -> int:
+    # the slots only: the expansions are the coder's own tuples.
+    return sys.getsizeof(table.rows) + sum(sys.getsizeof(row) for row in table.rows if row is not None)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--doc-chars", type=int, default=500000)
+    parser.add_argument("--vocab", type=int, default=1024)
+    parser.add_argument("--densities", type=float, nargs="+", default=[0.0, 1 / 64, 1 / 16, 1 / 4, 2.0])
+    args = parser.parse_args()
+
+    train = load_corpus(30000)
+    doc = synthetic_text(args.doc_chars, seed=1)
+    lz = LZCoder(16 * args.vocab, input_vocab=set(range(256)))
+    lz.encode(train, learn=True)
+    coder = HierachicalLZCoder(args.vocab, input_vocab=set(range(256)))
+    coder.encode(train, learn=True)
+    frozen = copy.deepcopy(coder)
+    frozen.freeze()
+
+    rows = []
+    for name, c in [("LZ", lz), ("HLZ dict loop", coder), ("HLZ frozen (table)", frozen)]:
+        tokens = c.encode(doc)
+        decoded, elapsed = timed(lambda: c.decode(tokens), repeat=3)
+        assert decoded == list(doc.encode())
+        rows.append([name, len(doc) / elapsed / 1e6])
+    print_table(["decoder", "MB_per_s"], rows)
+    print()
+
+    tokens = coder.encode(doc)
+    rows = []
+    for density in args.densities:
+        table, build_time = timed(lambda: DecodeTable(coder, density))
+        _, elapsed = timed(lambda: table.decode(tokens), repeat=3)
+        rows.append([density, table.dense_rows, len(coder.coders), table_bytes(table), build_time * 1e3, len(doc) / elapsed / 1e6])
+    print_table(["density", "dense_rows", "contexts", "slot_bytes", "build_ms", "MB_per_s"], rows)
+
+
+if __name__ == "__main__":
+    main()
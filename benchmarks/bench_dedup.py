@@ -0,0 +1,63 @@
+import argparse
+import random
+
+from src.lz import HierachicalLZCoder, ensure_list
+from src.dedup import DedupEncoder
+from .common import load_corpus, synthetic_text, timed, print_table
+
+
+def make_documents(num_docs: int, doc_chars: int, duplicate_fraction: float, seed: int=0):
+    # a pool of distinct documents; a fraction of the stream repeats earlier
+    # documents exactly or with a small edit near the start.
+    rng = random.Random(seed)
+    docs = []
+    for i in range(num_docs):
+        if docs and rng.random() < duplicate_fraction:
+            doc = rng.choice(docs)
+            if rng.random() < 0.5:
+                doc = synthetic_text(20, seed=i) + doc
+            docs.append(doc)
+        else:
+            docs.append(synthetic_text(doc_chars, seed=1000 + i))
+    return docs
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--docs", type=int, default=60)
+    parser.add_argument("--doc-chars", type=int, default=4000)
+    parser.add_argument("--vocab", type=int, default=512)
+    args = parser.parse_args()
+
+    train_text = load_corpus(20000)
+    coder = HierachicalLZCoder(output_vocab_size=args.vocab, input_vocab=set(range(256)))
+    coder.encode(train_text, learn=True)
+
+    rows = []
+    for duplicate_fraction in [0.0, 0.25, 0.5, 0.75]:
+        docs = make_documents(args.docs, args.doc_chars, duplicate_fraction)
+        total = sum(len(ensure_list(d)) for d in docs)
+
+        plain, plain_time = timed(lambda: [coder.encode(d, learn=False) for d in docs])
+
+        dedup = DedupEncoder(coder)
+        deduped, dedup_time = timed(lambda: [dedup.encode(d) for d in docs])
+
+        for d, tokens in zip(docs, deduped):
+            assert bytes(coder.decode(tokens)).decode('utf-8') == d
+
+        rows.append([
+            duplicate_fraction,
+            dedup.stats.hit_rate,
+            dedup.stats.symbol_hit_rate,
+            total / plain_time / 1e6,
+            total / dedup_time / 1e6,
+            plain_time / dedup_time,
+            sum(map(len, deduped)) / sum(map(len, plain)),
+        ])
+
+    print_table(["dup_frac", "chunk_hit", "byte_hit", "plain_MB/s", "dedup_MB/s", "speedup", "tokens_ratio"], rows)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,54 @@
+import argparse
+import copy
+import tracemalloc
+
+from src.lz import LZCoder, HierachicalLZCoder
+from .common import load_corpus, synthetic_text, timed, print_table
+
+
+def adapted_size(make, doc) -> int:
+    # bytes a coder made by make() holds on to after learning doc.
+    tracemalloc.start()
+    coder = make()
+    coder.encode(doc, learn=True)
+    size, _ = tracemalloc.get_traced_memory()
+    tracemalloc.stop()
+    del coder
+    return size
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--train-chars", type=int, default=30000)
+    parser.add_argument("--doc-chars", type=int, nargs="+", default=[1000, 10000])
+    parser.add_argument("--vocab", type=int, default=1024)
+    args = parser.parse_args()
+
+    train = load_corpus(args.train_chars)
+    rows = []
+    for name, base in [("LZ", LZCoder(16 * args.vocab, input_vocab=set(range(256)))),
+                       ("HLZ", HierachicalLZCoder(args.vocab, input_vocab=set(range(256))))]:
+        base.encode(train, learn=True)
+        base.freeze()
+        for doc_chars in args.doc_chars:
+            doc = synthetic_text(doc_chars, seed=7)
+
+            def thaw():
+                coder = copy.deepcopy(base)
+                coder.frozen = False
+                for c in (coder.coders.values() if coder.hierarchical else []):
+                    c.frozen = False
+                return coder
+
+            for method, make in [("deepcopy", thaw), ("fork", base.fork)]:
+                coder, make_time = timed(make)
+                _, learn_time = timed(lambda: coder.encode(doc, learn=True))
+                new_entries = len(coder.entry_log) - len(base.entry_log)
+                size = adapted_size(make, doc)
+                tokens, encode_time = timed(lambda: coder.encode(doc), repeat=3)
+                rows.append([name, doc_chars, method, make_time * 1e3, learn_time * 1e3, encode_time * 1e3, new_entries, size])
+    print_table(["coder", "doc_chars", "method", "make_ms", "learn_ms", "encode_ms", "new_entries", "bytes_per_doc"], rows)
+
+
+if __name__ == "__main__":
+    main()
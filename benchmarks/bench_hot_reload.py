@@ -0,0 +1,85 @@
+import argparse
+import os
+import pickle
+import statistics
+import tempfile
+import threading
+import time
+
+from src.lz import HierachicalLZCoder
+from src.flat import dump_flat
+from src.serving import HotSwapCoder
+from .common import load_corpus, timed, print_table
+
+
+def percentile(samples, p):
+    samples = sorted(samples)
+    return samples[min(len(samples) - 1, int(p * len(samples)))]
+
+
+def measure_latency(slot, requests, reload_path=None, reload_every=0.01):
+    stop = threading.Event()
+    reloads = [0]
+
+    def reloader():
+        while not stop.is_set():
+            slot.load(reload_path)
+            reloads[0] += 1
+            time.sleep(reload_every)
+
+    thread = threading.Thread(target=reloader) if reload_path is not None else None
+    if thread is not None:
+        thread.start()
+    latencies = []
+    for request in requests:
+        start = time.perf_counter()
+        slot.encode(request)
+        latencies.append(time.perf_counter() - start)
+    stop.set()
+    if thread is not None:
+        thread.join()
+    return latencies, reloads[0]
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--chars", type=int, default=20000)
+    parser.add_argument("--vocab", type=int, default=512)
+    parser.add_argument("--requests", type=int, default=500)
+    args = parser.parse_args()
+
+    text = load_corpus(args.chars)
+    coder = HierachicalLZCoder(output_vocab_size=args.vocab, input_vocab=set(range(256)))
+    coder.encode(text, learn=True)
+
+    with tempfile.TemporaryDirectory() as tmp:
+        flat_path = os.path.join(tmp, "coder.flat")
+        pickle_path = os.path.join(tmp, "coder.pkl")
+        dump_flat(coder, flat_path)
+        with open(pickle_path, "wb") as f:
+            pickle.dump(coder, f)
+
+        def load_pickle():
+            with open(pickle_path, "rb") as f:
+                return pickle.load(f)
+
+        slot = HotSwapCoder()
+        _, flat_load = timed(lambda: slot.load(flat_path), repeat=20)
+        _, pickle_load = timed(load_pickle, repeat=5)
+        print_table(["format", "bytes", "load_ms"], [
+            ["flat (mmap)", os.path.getsize(flat_path), flat_load * 1e3],
+            ["pickle", os.path.getsize(pickle_path), pickle_load * 1e3],
+        ])
+        print()
+
+        step = max(1, len(text) // args.requests)
+        requests = [text[i:i + 200] for i in range(0, len(text) - 200, step)][:args.requests]
+        rows = []
+        for name, reload_path in [("no reload", None), ("reload every 10ms", flat_path)]:
+            latencies, reloads = measure_latency(slot, requests, reload_path)
+            rows.append([name, reloads, statistics.median(latencies) * 1e6, percentile(latencies, 0.99) * 1e6])
+        print_table(["scenario", "reloads", "p50_us", "p99_us"], rows)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,67 @@
+import argparse
+import copy
+import math
+
+from src.lz import HierachicalLZCoder
+from src.entropy import FrequencyTable, rans_encode, rans_decode
+from src.mixing import cm_encode, cm_decode
+from src.huffman import HuffmanTables
+from .common import load_corpus, synthetic_text, timed, print_table
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--train-chars", type=int, default=50000)
+    parser.add_argument("--test-chars", type=int, default=50000)
+    parser.add_argument("--vocab", type=int, default=1024)
+    parser.add_argument("--repeat", type=int, default=3)
+    args = parser.parse_args()
+
+    train = load_corpus(args.train_chars)
+    coder = HierachicalLZCoder(args.vocab, input_vocab=set(range(256)))
+    coder.encode(train, learn=True)
+    frozen = copy.deepcopy(coder)
+    frozen.freeze()
+
+    # fit on the training text, measure on text the tables have not seen.
+    test = synthetic_text(args.test_chars, seed=7)
+    n_bytes = len(test.encode())
+    tokens = frozen.encode(test)
+    vocab_size = frozen.vocab_size
+    symbols = [t + 1 for t in tokens]
+
+    tables, fit_seconds = timed(lambda: HuffmanTables.from_coder(frozen, [train]))
+    table_bytes = len(tables.to_bytes())
+
+    counts = [0] * (vocab_size + 1)
+    for t in frozen.encode(train):
+        counts[t + 1] += 1
+    order0 = FrequencyTable.from_counts([c + 1 for c in counts])
+
+    rows = [["log2(vocab) fixed width", f"{len(tokens) * math.log2(vocab_size + 1) / n_bytes:.3f}", "-", "-"]]
+
+    def row(name, data, encode_seconds, decode_seconds):
+        rows.append([name, f"{8 * len(data) / n_bytes:.3f}",
+                     f"{n_bytes / encode_seconds / 1e6:.2f}", f"{n_bytes / decode_seconds / 1e6:.2f}"])
+
+    data, encode_seconds = timed(lambda: tables.encode(tokens), args.repeat)
+    (decoded, _), decode_seconds = timed(lambda: tables.decode(data, len(tokens)), args.repeat)
+    assert decoded == tokens
+    row(f"static per-context Huffman ({len(tables.context_tables)} tables)", data, encode_seconds, decode_seconds)
+
+    data, encode_seconds = timed(lambda: rans_encode(order0, symbols), args.repeat)
+    (decoded, _), decode_seconds = timed(lambda: rans_decode(order0, data, len(symbols)), args.repeat)
+    assert decoded == symbols
+    row("static order 0 rANS", data, encode_seconds, decode_seconds)
+
+    data, encode_seconds = timed(lambda: cm_encode(tokens, vocab_size))
+    decoded, decode_seconds = timed(lambda: cm_decode(data, len(tokens), vocab_size))
+    assert decoded == tokens
+    row("adaptive context mixing", data, encode_seconds, decode_seconds)
+
+    print(f"{len(tokens)} tokens for {n_bytes} bytes; Huffman tables: {table_bytes} bytes, fitted in {fit_seconds:.2f}s")
+    print_table(["coder", "bits/byte", "encode MB/s", "decode MB/s"], rows)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,36 @@
+import argparse
+import copy
+
+from src.lz import LZCoder, HierachicalLZCoder
+from src.machine import StateMachineCoder
+from .common import load_corpus, synthetic_text, timed, print_table
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--doc-chars", type=int, default=300000)
+    parser.add_argument("--train-chars", type=int, default=30000)
+    parser.add_argument("--vocabs", type=int, nargs="+", default=[256, 1024])
+    args = parser.parse_args()
+
+    train = load_corpus(args.train_chars)
+    doc = synthetic_text(args.doc_chars, seed=1).encode()
+    rows = []
+    for vocab in args.vocabs:
+        for name, coder in [("LZ", LZCoder(16 * vocab, input_vocab=set(range(256)))),
+                            ("HLZ", HierachicalLZCoder(vocab, input_vocab=set(range(256))))]:
+            coder.encode(train, learn=True)
+            coder = copy.deepcopy(coder)
+            coder.freeze()
+            machine, build_time = timed(lambda: StateMachineCoder(coder))
+            expected, object_time = timed(lambda: coder.encode(doc), repeat=3)
+            tokens, machine_time = timed(lambda: machine.encode(doc), repeat=3)
+            assert tokens == expected
+            rows.append([name, vocab, machine.n_states, machine.n_columns, len(machine.actions), machine.nbytes,
+                         build_time, len(doc) / object_time / 1e6, len(doc) / machine_time / 1e6])
+    print_table(["coder", "vocab", "states", "columns", "actions", "table_bytes", "build_s", "object_MB_per_s",
+                 "machine_MB_per_s"], rows)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,96 @@
+import argparse
+import copy
+import random
+import time
+import zlib
+
+from src.lz import HierachicalLZCoder
+from src.native import NativeCoder
+from src.message import MessageCodec
+from .common import load_corpus, synthetic_text, print_table
+
+
+def percentiles(samples, ps=(50, 99)):
+    samples = sorted(samples)
+    return [samples[min(len(samples) - 1, len(samples) * p // 100)] for p in ps]
+
+
+def latencies(fn, items):
+    out = []
+    for item in items:
+        start = time.perf_counter()
+        fn(item)
+        out.append((time.perf_counter() - start) * 1e6)
+    return out
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--messages", type=int, default=2000)
+    parser.add_argument("--vocab", type=int, default=1024)
+    parser.add_argument("--train-chars", type=int, default=30000)
+    args = parser.parse_args()
+
+    train = load_corpus(args.train_chars)
+    coder = HierachicalLZCoder(args.vocab, input_vocab=set(range(256)))
+    coder.encode(train, learn=True)
+    frozen = copy.deepcopy(coder)
+    frozen.freeze()
+    native = NativeCoder.from_coder(frozen)
+
+    # RPC sized payloads: 100 B to 2 KB slices of text the dictionary has not seen.
+    rng = random.Random(0)
+    stream = synthetic_text(4 * 1024 * 1024, seed=5).encode()
+    messages = []
+    for _ in range(args.messages):
+        size = int(100 * 20 ** rng.random())
+        start = rng.randrange(len(stream) - size)
+        messages.append(stream[start:start + size])
+
+    zdict = train.encode()[-32768:]
+
+    def zlib_encode(m):
+        c = zlib.compressobj(9, zdict=zdict)
+        return c.compress(m) + c.flush()
+
+    def zlib_decode(data):
+        d = zlib.decompressobj(zdict=zdict)
+        return d.decompress(data) + d.flush()
+
+    def fresh_encode(m):
+        return HierachicalLZCoder(args.vocab, input_vocab=set(range(256))).encode(m, learn=True)
+
+    python_codec = MessageCodec(frozen, sample=train)
+    native_codec = MessageCodec(native, table=python_codec.table)
+    codecs = [
+        # learning from scratch is slow, so only on a few of the messages.
+        ("fresh coder, no entropy", fresh_encode, None, messages[:args.messages // 20]),
+        ("zlib, shared zdict", zlib_encode, zlib_decode, messages),
+        ("message (python)", python_codec.encode, python_codec.decode, messages),
+        ("message (native)", native_codec.encode, native_codec.decode, messages),
+    ]
+
+    rows = []
+    for name, encode, decode, messages in codecs:
+        total = sum(len(m) for m in messages)
+        encoded = [encode(m) for m in messages]
+        if isinstance(encoded[0], list):
+            # tokens of a vocab of this size, at their log2(vocab) bits each.
+            size = sum(len(e) for e in encoded) * args.vocab.bit_length() / 8
+        else:
+            size = sum(len(e) for e in encoded)
+        encode_times = latencies(encode, messages)
+        row = [name, total / size] + percentiles(encode_times)
+        if decode is not None:
+            for m, e in zip(messages, encoded):
+                assert bytes(decode(e)) == m
+            row += percentiles(latencies(decode, encoded))
+        else:
+            row += ["-", "-"]
+        row.append(percentiles(latencies(encode, [b""] * 200))[0])
+        rows.append(row)
+    print_table(["codec", "ratio", "enc_p50_us", "enc_p99_us", "dec_p50_us", "dec_p99_us", "empty_enc_us"], rows)
+
+
+if __name__ == "__main__":
+    main()
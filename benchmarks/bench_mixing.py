@@ -0,0 +1,47 @@
+import argparse
+import math
+
+from src.lz import HierachicalLZCoder
+from src.entropy import FrequencyTable, rans_encode
+from src.mixing import cm_encode, cm_decode
+from .common import load_corpus, timed, print_table
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--chars", type=int, default=50000)
+    parser.add_argument("--vocab", type=int, default=1024)
+    args = parser.parse_args()
+
+    text = load_corpus(args.chars)
+    coder = HierachicalLZCoder(args.vocab, input_vocab=set(range(256)))
+    tokens = coder.encode(text, learn=True)
+    n_bytes = len(text.encode())
+    vocab_size = coder.vocab_size
+
+    rows = []
+    fixed_bits = len(tokens) * math.log2(vocab_size + 1)
+    rows.append(["log2(vocab) fixed width", f"{fixed_bits / n_bytes:.3f}", "-", "-"])
+
+    # the best any static order 0 code could do, knowing the counts up front
+    # (which the decoder would have to be sent).
+    counts = [0] * (vocab_size + 1)
+    for t in tokens:
+        counts[t + 1] += 1
+    table = FrequencyTable.from_counts(counts)
+    data, seconds = timed(lambda: rans_encode(table, [t + 1 for t in tokens]))
+    rows.append(["static order 0 (rANS)", f"{8 * len(data) / n_bytes:.3f}", f"{len(tokens) / seconds:,.0f}", "-"])
+
+    for orders in [(0,), (0, 1), (0, 1, 2)]:
+        data, encode_seconds = timed(lambda: cm_encode(tokens, vocab_size, orders))
+        decoded, decode_seconds = timed(lambda: cm_decode(data, len(tokens), vocab_size, orders))
+        assert decoded == tokens
+        rows.append([f"context mixing {orders}", f"{8 * len(data) / n_bytes:.3f}",
+                     f"{len(tokens) / encode_seconds:,.0f}", f"{len(tokens) / decode_seconds:,.0f}"])
+
+    print(f"{len(tokens)} tokens of {vocab_size} (+ EMPTY_TOKEN) for {n_bytes} bytes")
+    print_table(["model", "bits/byte", "encode tokens/s", "decode tokens/s"], rows)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,56 @@
+import argparse
+from array import array
+from concurrent.futures import ThreadPoolExecutor
+
+from src.lz import HierachicalLZCoder
+from src.flat import FlatCoder, to_flat_bytes
+from src.native import NativeCoder
+from .common import load_corpus, synthetic_text, timed, print_table
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--doc-chars", type=int, default=200000)
+    parser.add_argument("--vocab", type=int, default=1024)
+    parser.add_argument("--threads", type=int, nargs="+", default=[1, 2, 4, 8])
+    args = parser.parse_args()
+
+    coder = HierachicalLZCoder(output_vocab_size=args.vocab, input_vocab=set(range(256)))
+    coder.encode(load_corpus(20000), learn=True)
+    flat = FlatCoder(to_flat_bytes(coder))
+    native = NativeCoder.from_coder(coder)
+
+    doc = synthetic_text(args.doc_chars, seed=1).encode()
+    encoded = native.encode(doc)
+    assert native.decode(encoded) == list(doc)
+
+    small = doc[:20000]
+    rows = []
+    for name, c in [("object", coder), ("flat (python)", flat), ("native", native)]:
+        _, elapsed = timed(lambda: c.encode(small), repeat=3)
+        tokens = c.encode(small)
+        _, decode_elapsed = timed(lambda: c.decode(tokens), repeat=3)
+        rows.append([name, len(small) / elapsed / 1e6, len(small) / decode_elapsed / 1e6])
+    print_table(["coder", "encode_MB/s", "decode_MB/s"], rows)
+    print()
+
+    # every thread encodes and decodes its own document with the shared coder.
+    out = [array('i', bytes(4 * (2 * len(doc) + 1))) for _ in range(max(args.threads))]
+    decoded = [array('i', bytes(4 * len(doc))) for _ in range(max(args.threads))]
+    tokens = array('i', encoded)
+
+    rows = []
+    base = None
+    for threads in args.threads:
+        def run():
+            with ThreadPoolExecutor(threads) as pool:
+                list(pool.map(lambda i: (native.encode_into(doc, out[i]), native.decode_into(tokens, decoded[i])), range(threads)))
+        _, elapsed = timed(run, repeat=3)
+        throughput = threads * len(doc) / elapsed / 1e6
+        base = base or throughput
+        rows.append([threads, throughput, throughput / base])
+    print_table(["threads", "encode+decode_MB/s", "speedup"], rows)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,40 @@
+import argparse
+
+from src.lz import LZCoder
+from src.offline import build_dictionary, count_substrings
+from .common import load_corpus, synthetic_text, timed, print_table
+
+
+def learn_online(text: bytes, vocab: int, input_vocab) -> LZCoder:
+    coder = LZCoder(vocab, input_vocab=input_vocab)
+    coder.encode(text, learn=True)
+    return coder
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--chars", type=int, default=100000)
+    parser.add_argument("--vocabs", type=int, nargs="+", default=[512, 2048, 8192])
+    parser.add_argument("--max-length", type=int, default=24)
+    parser.add_argument("--min-count", type=int, default=3)
+    args = parser.parse_args()
+
+    text = load_corpus(args.chars).encode()
+    held_out = synthetic_text(20000, seed=5).encode()
+    input_vocab = set(text) | set(held_out)
+
+    counts, count_time = timed(lambda: count_substrings(text, args.max_length, args.min_count))
+    print(f"counted {len(counts)} frequent substrings in {count_time:.2f} s")
+
+    rows = []
+    for vocab in args.vocabs:
+        online, online_time = timed(lambda: learn_online(text, vocab, input_vocab))
+        rows.append(["online", vocab, online_time, len(online.encode(held_out)) / len(held_out)])
+
+        offline, build_time = timed(lambda: build_dictionary(text, vocab, input_vocab=input_vocab, counts=counts))
+        rows.append(["offline", vocab, build_time + count_time, len(offline.encode(held_out)) / len(held_out)])
+    print_table(["builder", "vocab", "build_s", "held_out_tokens_per_byte"], rows)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,43 @@
+import argparse
+
+from src.lz import HierachicalLZCoder
+from src.parse import optimal_parse, estimated_bits, token_count
+from .common import load_corpus, synthetic_text, timed, print_table
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--train-chars", type=int, default=30000)
+    parser.add_argument("--test-chars", type=int, default=5000)
+    parser.add_argument("--vocab", type=int, default=512)
+    parser.add_argument("--beams", type=int, nargs="+", default=[1, 4, 16, 64])
+    args = parser.parse_args()
+
+    coder = HierachicalLZCoder(output_vocab_size=args.vocab, input_vocab=set(range(256)))
+    coder.encode(load_corpus(args.train_chars), learn=True)
+    coder.freeze()
+    # a held-out text that only uses contexts the coder has learned, so greedy
+    # encoding works too.
+    text = synthetic_text(args.test_chars, seed=3)
+    bits = estimated_bits(coder, load_corpus(args.train_chars))
+
+    def total_bits(tokens):
+        total, context = 0.0, -1
+        for t in tokens:
+            total += bits(context, t)
+            context = t
+        return total
+
+    greedy, greedy_time = timed(lambda: coder.encode(text), repeat=3)
+    rows = [["greedy", "-", len(greedy), total_bits(greedy) / len(text), 0.0, len(text) / greedy_time / 1e3]]
+    for name, cost in [("tokens", token_count), ("bits", bits)]:
+        for beam in args.beams + [None]:
+            tokens, parse_time = timed(lambda: optimal_parse(coder, text, beam_width=beam, cost=cost))
+            assert coder.decode(tokens) == list(text.encode())
+            rows.append([f"optimal {name}", beam or "exact", len(tokens), total_bits(tokens) / len(text),
+                         100 * (1 - len(tokens) / len(greedy)), len(text) / parse_time / 1e3])
+    print_table(["parser", "beam", "tokens", "est_bits_per_byte", "fewer_tokens_%", "KB_per_s"], rows)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,36 @@
+import argparse
+
+from src.lz import HierachicalLZCoder
+from src.parallel import BatchEncoder, free_threaded
+from .common import load_corpus, synthetic_text, timed, print_table
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--docs", type=int, default=64)
+    parser.add_argument("--doc-chars", type=int, default=2000)
+    parser.add_argument("--vocab", type=int, default=512)
+    parser.add_argument("--workers", type=int, nargs="+", default=[1, 2, 4, 8])
+    args = parser.parse_args()
+
+    coder = HierachicalLZCoder(output_vocab_size=args.vocab, input_vocab=set(range(256)))
+    coder.encode(load_corpus(20000), learn=True)
+    coder.freeze()
+    docs = [synthetic_text(args.doc_chars, seed=i) for i in range(args.docs)]
+    total = args.docs * args.doc_chars
+
+    print(f"free-threaded build with the GIL disabled: {free_threaded()}")
+    rows = []
+    for use_threads in [True, False]:
+        baseline = None
+        for workers in args.workers:
+            with BatchEncoder(coder, workers, use_threads) as encoder:
+                encoder.encode(docs[:workers])  # start the pool
+                _, elapsed = timed(lambda: encoder.encode(docs))
+            baseline = baseline or elapsed
+            rows.append(["threads" if use_threads else "processes", workers, total / elapsed / 1e3, baseline / elapsed])
+    print_table(["executor", "workers", "kchar/s", "speedup"], rows)
+
+
+if __name__ == "__main__":
+    main()
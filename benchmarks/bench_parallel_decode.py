@@ -0,0 +1,49 @@
+import argparse
+import os
+from array import array
+
+from src.lz import HierachicalLZCoder
+from src.flat import FlatCoder, to_flat_bytes
+from src.native import NativeCoder
+from src.parallel import ParallelDecoder
+from .common import load_corpus, synthetic_text, timed, print_table
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--doc-chars", type=int, default=2000000)
+    parser.add_argument("--vocab", type=int, default=1024)
+    parser.add_argument("--workers", type=int, nargs="+", default=[1, 2, 4, 8])
+    args = parser.parse_args()
+
+    coder = HierachicalLZCoder(output_vocab_size=args.vocab, input_vocab=set(range(256)))
+    coder.encode(load_corpus(20000), learn=True)
+    flat = FlatCoder(to_flat_bytes(coder))
+    native = NativeCoder.from_coder(coder)
+
+    doc = synthetic_text(args.doc_chars, seed=1).encode()
+    tokens = array('i', native.encode(doc))
+    out = array('i', bytes(4 * len(doc)))
+    print(f"{len(tokens)} tokens, {len(doc)} symbols, {os.cpu_count()} cores")
+
+    small = tokens[:len(tokens) // 20]
+    small_length = len(coder.decode(small))
+    rows = []
+    for name, decode in [("object loop", lambda: coder.decode(small)), ("flat loop", lambda: flat.decode(small)),
+                         ("flat 3-pass", lambda: ParallelDecoder(flat, 1).decode(small))]:
+        _, elapsed = timed(decode, repeat=3)
+        rows.append([name, 1, small_length / elapsed / 1e6])
+
+    _, elapsed = timed(lambda: native.decode_into(tokens, out), repeat=3)
+    rows.append(["native loop", 1, len(doc) / elapsed / 1e6])
+    for workers in args.workers:
+        with ParallelDecoder(native, workers) as decoder:
+            assert decoder.decode_into(tokens, out) == len(doc)
+            _, elapsed = timed(lambda: decoder.decode_into(tokens, out), repeat=3)
+        rows.append(["native 3-pass", workers, len(doc) / elapsed / 1e6])
+    assert out.tolist() == list(doc)
+    print_table(["decoder", "workers", "MSymbols/s"], rows)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,52 @@
+import argparse
+from array import array
+
+from src.lz import HierachicalLZCoder
+from src.entropy import FrequencyTable, rans_encode, rans_decode
+from src.native import NativeRansTable, native_available
+from .common import load_corpus, timed, print_table
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--chars", type=int, default=50000)
+    parser.add_argument("--vocab", type=int, default=1024)
+    parser.add_argument("--native-tokens", type=int, default=4000000)
+    parser.add_argument("--repeat", type=int, default=5)
+    args = parser.parse_args()
+
+    text = load_corpus(args.chars)
+    coder = HierachicalLZCoder(args.vocab, input_vocab=set(range(256)))
+    tokens = coder.encode(text, learn=True)
+    counts = [0] * (coder.vocab_size + 1)
+    for t in tokens:
+        counts[t + 1] += 1
+    table = FrequencyTable.from_counts(counts)
+    symbols = [t + 1 for t in tokens]
+    # native decode is far too fast to time on one corpus, so repeat it.
+    long_tokens = tokens * (args.native_tokens // len(tokens) + 1)
+    expected = array('i', long_tokens).tobytes()
+    native = NativeRansTable(table) if native_available() else None
+
+    rows = []
+    for lanes in [1, 2, 4, 8]:
+        data = rans_encode(table, symbols, lanes)
+        (decoded, _), seconds = timed(lambda: rans_decode(table, data, len(symbols), lanes=lanes))
+        assert decoded == symbols
+        row = [lanes, len(data), f"{len(symbols) / seconds / 1e6:.2f}"]
+        if native is not None:
+            data = native.encode(long_tokens, lanes)
+            out = array('i', bytes(4 * len(long_tokens)))
+            _, seconds = timed(lambda: native.decode_into(data, len(long_tokens), out, lanes), args.repeat)
+            assert out.tobytes() == expected
+            row.append(f"{len(long_tokens) / seconds / 1e6:.1f}")
+        rows.append(row)
+
+    print(f"{len(tokens)} tokens of {coder.vocab_size} (+ EMPTY_TOKEN), {table.precision} bit frequencies")
+    print_table(["lanes", "bytes", "python decode Mtokens/s", "native decode Mtokens/s"], rows)
+    if native is not None:
+        native.close()
+
+
+if __name__ == "__main__":
+    main()
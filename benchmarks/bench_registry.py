@@ -0,0 +1,77 @@
+import argparse
+import os
+import pickle
+import random
+import shutil
+import tempfile
+import time
+
+from src.lz import HierachicalLZCoder
+from src.flat import dump_flat
+from src.native import NativeCoder
+from src.registry import DictionaryRegistry
+from .common import synthetic_text, print_table
+
+
+def percentiles(samples, ps=(50, 99)):
+    samples = sorted(samples)
+    return [samples[min(len(samples) - 1, len(samples) * p // 100)] for p in ps]
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--tenants", type=int, default=40)
+    parser.add_argument("--distinct", type=int, default=4)
+    parser.add_argument("--requests", type=int, default=5000)
+    parser.add_argument("--vocab", type=int, default=1024)
+    parser.add_argument("--train-chars", type=int, default=10000)
+    parser.add_argument("--budgets", type=float, nargs="+", default=[0.1, 0.25, 0.5, 1.0])
+    args = parser.parse_args()
+
+    directory = tempfile.mkdtemp()
+    try:
+        # a few trained coders, each copied to several tenants' files.
+        pickles = []
+        for i in range(args.distinct):
+            coder = HierachicalLZCoder(args.vocab, input_vocab=set(range(256)))
+            coder.encode(synthetic_text(args.train_chars, seed=i), learn=True)
+            dump_flat(coder, os.path.join(directory, "trained.flat"))
+            pickles.append(pickle.dumps(coder))
+            for t in range(i, args.tenants, args.distinct):
+                shutil.copy(os.path.join(directory, "trained.flat"), os.path.join(directory, f"t{t}.flat"))
+        total = sum(os.path.getsize(os.path.join(directory, f"t{t}.flat")) for t in range(args.tenants))
+
+        # zipf-ish popularity, 200 byte requests.
+        rng = random.Random(0)
+        weights = [1.0 / (t + 1) for t in range(args.tenants)]
+        requests = rng.choices(range(args.tenants), weights, k=args.requests)
+        message = synthetic_text(200, seed=99).encode()
+
+        rows = []
+        for budget in args.budgets:
+            registry = DictionaryRegistry(int(budget * total), directory=directory, coder_class=NativeCoder)
+            latencies = []
+            for t in requests:
+                start = time.perf_counter()
+                registry.encode(f"t{t}", message)
+                latencies.append((time.perf_counter() - start) * 1e6)
+            stats = registry.stats
+            rows.append([f"registry {budget:g}x", registry.loaded_bytes / 1e6, stats.hit_rate, stats.mean_load_seconds * 1e6,
+                         stats.max_load_seconds * 1e6] + percentiles(latencies))
+            registry.close()
+
+        # for comparison: unpickling the tenant's coder for every request.
+        latencies = []
+        for t in requests[:args.requests // 20]:
+            start = time.perf_counter()
+            pickle.loads(pickles[t % args.distinct]).encode(message)
+            latencies.append((time.perf_counter() - start) * 1e6)
+        rows.append(["unpickle per request", "-", 0.0, "-", "-"] + percentiles(latencies))
+        print(f"{args.tenants} tenants, {total / 1e6:.3g} MB of coders")
+        print_table(["strategy", "loaded_MB", "hit_rate", "mean_load_us", "max_load_us", "p50_us", "p99_us"], rows)
+    finally:
+        shutil.rmtree(directory)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,52 @@
+import argparse
+
+from src.lz import HierachicalLZCoder
+from src.train import sampled_training
+from .common import synthetic_text, print_table
+
+
+# a few "sources" with their own jargon, of very different sizes, so that
+# stratified sampling has something to do.
+SOURCES = [
+    ("docs", {}, 0.7),
+    ("infra", {"the ": "kubernetes ", "of ": "replica ", "data ": "pod "}, 0.25),
+    ("legal", {"the ": "heretofore ", "and ": "notwithstanding ", "is ": "shall "}, 0.05),
+]
+
+
+def corpus(num_chars: int, doc_chars: int, seed: int):
+    documents, sources = [], []
+    for source, jargon, share in SOURCES:
+        for i in range(max(1, int(num_chars * share) // doc_chars)):
+            text = synthetic_text(doc_chars * 2, seed=seed + 1000 * len(documents) + i)
+            for word, replacement in jargon.items():
+                text = text.replace(word, replacement)
+            documents.append(text[:doc_chars])
+            sources.append(source)
+    return documents, sources
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--corpus-chars", type=int, default=400000)
+    parser.add_argument("--doc-chars", type=int, default=4000)
+    parser.add_argument("--vocab", type=int, default=1024)
+    parser.add_argument("--block", type=int, default=1024)
+    parser.add_argument("--budgets", type=int, nargs="+", default=[4096, 16384, 32768, 65536])
+    args = parser.parse_args()
+
+    documents, sources = corpus(args.corpus_chars, args.doc_chars, seed=0)
+    held_out_documents, _ = corpus(args.corpus_chars // 10, args.doc_chars, seed=1)
+    held_out = "".join(held_out_documents)
+
+    rows = []
+    for budget in args.budgets:
+        for method, strata in [("reservoir", None), ("stratified", lambda i, d: sources[i])]:
+            _, report = sampled_training(documents, budget, held_out, block_size=args.block, strata=strata,
+                                         make_coder=lambda: HierachicalLZCoder(output_vocab_size=args.vocab, input_vocab=set(range(256))))
+            rows.append([method, budget, report.sample_bytes, report.train_seconds, report.bytes_per_token])
+    print_table(["method", "budget", "sample_bytes", "train_s", "held_out_bytes_per_token"], rows)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,62 @@
+import argparse
+import pickle
+import time
+from multiprocessing import get_context
+
+from src.lz import HierachicalLZCoder
+from src.shared import SharedCoderSegment, attach
+from .common import load_corpus, print_table
+
+
+def memory_kb():
+    # private (anonymous) and shared memory of this process, linux only.
+    fields = {}
+    with open("/proc/self/status") as f:
+        for line in f:
+            key, _, value = line.partition(":")
+            if key in ("RssAnon", "RssShmem"):
+                fields[key] = int(value.split()[0])
+    return fields.get("RssAnon", 0), fields.get("RssShmem", 0)
+
+
+def worker(args):
+    mode, payload, doc = args
+    anon_before, shmem_before = memory_kb()
+    start = time.perf_counter()
+    coder = pickle.loads(payload) if mode == "pickle" else attach(payload)
+    load_time = time.perf_counter() - start
+    coder.encode(doc)
+    anon_after, shmem_after = memory_kb()
+    if mode != "pickle":
+        coder.close()
+    return load_time, anon_after - anon_before, shmem_after - shmem_before
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--chars", type=int, default=50000)
+    parser.add_argument("--vocab", type=int, default=1024)
+    parser.add_argument("--workers", type=int, default=4)
+    args = parser.parse_args()
+
+    text = load_corpus(args.chars)
+    coder = HierachicalLZCoder(output_vocab_size=args.vocab, input_vocab=set(range(256)))
+    coder.encode(text, learn=True)
+    doc = text[:5000]
+
+    payload = pickle.dumps(coder)
+    rows = []
+    with SharedCoderSegment(coder) as segment:
+        for mode, data in [("pickle", payload), ("shared memory", segment.name)]:
+            with get_context("spawn").Pool(args.workers) as pool:
+                results = pool.map(worker, [(mode, data, doc)] * args.workers, chunksize=1)
+            load = sum(r[0] for r in results) / len(results)
+            anon = sum(r[1] for r in results) / len(results)
+            shmem = sum(r[2] for r in results) / len(results)
+            size = len(payload) if mode == "pickle" else segment.shm.size
+            rows.append([mode, size, load * 1e3, anon, shmem])
+    print_table(["mode", "bytes", "load_ms", "private_kb/worker", "shared_kb/worker"], rows)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,38 @@
+import argparse
+import copy
+import os
+
+from src.lz import HierachicalLZCoder
+from src.native import NativeCoder
+from src.parallel import SpeculativeEncoder
+from .common import load_corpus, synthetic_text, timed, print_table
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--doc-chars", type=int, default=4000000)
+    parser.add_argument("--vocab", type=int, default=1024)
+    parser.add_argument("--workers", type=int, nargs="+", default=[1, 2, 4, 8])
+    args = parser.parse_args()
+
+    coder = HierachicalLZCoder(output_vocab_size=args.vocab, input_vocab=set(range(256)))
+    coder.encode(load_corpus(20000), learn=True)
+    native = NativeCoder.from_coder(coder)
+    doc = synthetic_text(args.doc_chars, seed=1).encode()
+    expected, elapsed = timed(lambda: native.encode(doc), repeat=3)
+    print(f"{len(doc)} symbols, {os.cpu_count()} cores")
+
+    rows = [["native encode", 1, len(doc) / elapsed / 1e6, "-", "-"]]
+    for workers in args.workers:
+        with SpeculativeEncoder(native, workers) as encoder:
+            assert encoder.encode(doc) == expected
+            stats = copy.copy(encoder.stats)
+            _, elapsed = timed(lambda: encoder.encode(doc), repeat=3)
+        # the first chunk starts from the real state, so it never needs to converge.
+        speculated = max(0, stats.chunks - 1)
+        rows.append(["speculative", workers, len(doc) / elapsed / 1e6, f"{stats.converged}/{speculated}", stats.resync_symbols])
+    print_table(["encoder", "workers", "MB_per_s", "converged", "resync_symbols"], rows)
+
+
+if __name__ == "__main__":
+    main()
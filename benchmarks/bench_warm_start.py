@@ -0,0 +1,59 @@
+import argparse
+
+from src.lz import LZCoder, HierachicalLZCoder
+from .common import load_corpus, synthetic_text, timed, print_table
+
+
+# jargon the general corpus never saw, swapped in for some common words.
+DOMAIN_WORDS = {"the ": "kubernetes ", "of ": "replica ", "and ": "namespace ", "is ": "ingress ", "data ": "pod "}
+
+
+def domain_text(num_chars: int, seed: int) -> str:
+    text = synthetic_text(num_chars * 2, seed)
+    for word, jargon in DOMAIN_WORDS.items():
+        text = text.replace(word, jargon)
+    return text[:num_chars]
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--pretrain-chars", type=int, default=30000)
+    parser.add_argument("--vocab", type=int, default=512)
+    # online compression on the domain stream is reported per window ending at each of these.
+    parser.add_argument("--windows", type=int, nargs="+", default=[500, 2000, 8000, 32000])
+    parser.add_argument("--evict", type=float, default=0.25)
+    args = parser.parse_args()
+
+    general = load_corpus(args.pretrain_chars)
+    domain = domain_text(max(args.windows), seed=7).encode()
+    # eviction gets to look at a bit of the domain, but not at the stream we measure on.
+    sample = domain_text(2000, seed=8)
+
+    rows = []
+    for name, cls, vocab in [("LZ", LZCoder, 16 * args.vocab), ("HLZ", HierachicalLZCoder, args.vocab)]:
+        pretrained = cls(output_vocab_size=vocab, input_vocab=set(range(256)))
+        pretrained.encode(general, learn=True)
+
+        _, copy_time = timed(lambda: cls.from_pretrained(pretrained), repeat=3)
+        _, evict_time = timed(lambda: cls.from_pretrained(pretrained, evict_fraction=args.evict, sample=sample), repeat=3)
+        print(f"{name}: from_pretrained {copy_time * 1e3:.1f} ms, with eviction {evict_time * 1e3:.1f} ms")
+
+        starts = {
+            "cold": lambda: cls(output_vocab_size=vocab, input_vocab=set(range(256))),
+            "warm": lambda: cls.from_pretrained(pretrained),
+            f"warm evict {args.evict}": lambda: cls.from_pretrained(pretrained, evict_fraction=args.evict, sample=sample),
+        }
+        for start, make in starts.items():
+            coder = make()
+            begin = 0
+            for end in args.windows:
+                # a hierarchical coder has to restart from the EMPTY_TOKEN context
+                # at every window, which costs about one token.
+                tokens = coder.encode(domain[begin:end], learn=True)
+                rows.append([name, start, f"{begin}-{end}", len(tokens) / (end - begin)])
+                begin = end
+    print_table(["coder", "start", "window", "tokens_per_byte"], rows)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,60 @@
+from typing import Callable, List, Tuple, TypeVar
+import os
+import random
+import time
+
+
+T = TypeVar("T")
+
+CORPUS_PATH = os.path.join(os.path.dirname(__file__), "..", "test", "compression_test_text.txt")
+
+_WORDS = (
+    "the of and to in is that for it as was with be by on not he this are or his from at which "
+    "but have an they you were her she there been one all we their has would when if so no will "
+    "compression token context dictionary prefix symbol coder entropy stream hierarchical model "
+    "data input output learn encode decode vocabulary trie match greedy parse chunk cache"
+).split()
+
+
+def synthetic_text(num_chars: int, seed: int=0) -> str:
+    # zipf-ish word salad, so that there is something for the coders to learn.
+    rng = random.Random(seed)
+    weights = [1.0 / (i + 1) for i in range(len(_WORDS))]
+    words = []
+    length = 0
+    while length < num_chars:
+        w = rng.choices(_WORDS, weights)[0]
+        if rng.random() < 0.08:
+            w += "."
+        words.append(w)
+        length += len(w) + 1
+    return " ".join(words)[:num_chars]
+
+
+def load_corpus(num_chars: int=20000) -> str:
+    # the notebook corpus if we have it, otherwise synthetic text.
+    if os.path.exists(CORPUS_PATH):
+        with open(CORPUS_PATH, 'r') as f:
+            text = f.read().strip()
+        while len(text) < num_chars:
+            text = text + "\n" + text
+        return text[:num_chars]
+    return synthetic_text(num_chars)
+
+
+def timed(fn: Callable[[], T], repeat: int=1) -> Tuple[T, float]:
+    # returns the result of the last call and the best wall time in seconds.
+    best = float("inf")
+    result = None
+    for _ in range(repeat):
+        start = time.perf_counter()
+        result = fn()
+        best = min(best, time.perf_counter() - start)
+    return result, best
+
+
+def print_table(header: List[str], rows: List[List]) -> None:
+    cells = [header] + [[f"{c:.4g}" if isinstance(c, float) else str(c) for c in row] for row in rows]
+    widths = [max(len(row[i]) for row in cells) for i in range(len(header))]
+    for row in cells:
+        print("  ".join(c.rjust(w) for c, w in zip(row, widths)))
@@ -0,0 +1,276 @@
+from typing import Dict, List, Optional, Set, Tuple, Union
+import lzma
+import os
+import zlib
+
+from .lz import (Coder, LZCoder, HierachicalLZCoder, EMPTY_TOKEN, TOKEN_TYPE, BYTE_INPUT, CODEPOINT_INPUT, context_coders)
+from .flat import FlatCoder, flat_bytes_from_vocabs
+from .entropy import read_varint, write_varint
+
+
+# Compact serialization of trained coders.
+#
+# Every entry of a dictionary is an earlier entry (its parent) plus one more
+# symbol, so instead of the whole prefix we store, per entry and in creation
+# order within its context:
+#   varint(i - p)              distance back to the parent entry p (the empty
+#                              prefix counts as entry -1, so this is >= 1)
+#   zigzag varint(symbol)      the extra symbol
+#   varint(token - free)       the token, relative to the smallest unused token
+#                              (which is what LZCoder allocates, so usually 0)
+# A distance of 0 marks an entry without a parent, followed by the length and
+# symbols of the whole prefix.
+#
+# layout: MAGIC, compression byte, then the (optionally compressed) varint
+# stream: kind, input mode, output vocab size, alphabet, input vocab, number of
+# contexts, and per context (in creation order) its id and entries.
+#
+# Contexts are stored one after another, so a loaded HierachicalLZCoder has the
+# same dictionaries and allocators, but its entry_log lists entries grouped by
+# context rather than interleaved as they were learned.
+
+MAGIC = b"HLZPACK1"
+# far more than any dictionary we train, small enough that a corrupt size
+# can't make us allocate all memory for the token allocators.
+MAX_VOCAB_SIZE = 1 << 24
+COMPRESSIONS = {None: 0, "zlib": 1, "lzma": 2}
+INPUT_MODES = [BYTE_INPUT, CODEPOINT_INPUT]
+
+
+def _write_signed(out: bytearray, value: int) -> None:
+    out += write_varint((value << 1) if value >= 0 else ((-value << 1) - 1))
+
+
+class _Reader:
+    def __init__(self, data: bytes):
+        self.data = data
+        self.pos = 0
+
+    def varint(self) -> int:
+        value, self.pos = read_varint(self.data, self.pos)
+        return value
+
+    def signed(self) -> int:
+        v = self.varint()
+        return (v >> 1) if not v & 1 else -((v + 1) >> 1)
+
+
+class _FreeTokens:
+    # smallest unused token, for tokens handed out in (mostly) increasing order.
+    def __init__(self):
+        self.used = set()
+        self.smallest = 0
+
+    def take(self, token: TOKEN_TYPE) -> None:
+        self.used.add(token)
+        while self.smallest in self.used:
+            self.smallest += 1
+
+
+def dumps(coder: Coder, compression: Optional[str]=None) -> bytes:
+    hierarchical = isinstance(coder, HierachicalLZCoder)
+    coders = context_coders(coder)
+    input_coder = coders[EMPTY_TOKEN]
+
+    out = bytearray()
+    out += write_varint(int(hierarchical))
+    out += write_varint(INPUT_MODES.index(coder.input_mode))
+    out += write_varint(coder.vocab_size if hierarchical else coder.vocab_size - 1)
+
+    alphabet = coder.alphabet.symbols if coder.alphabet is not None else []
+    out += write_varint(len(alphabet))
+    for c in alphabet:
+        _write_signed(out, c)
+
+    previous = 0
+    out += write_varint(len(input_coder.input_vocab))
+    for c in sorted(input_coder.input_vocab):
+        _write_signed(out, c - previous)
+        previous = c
+
+    out += write_varint(len(coders))
+    for context, lz in coders.items():
+        _write_signed(out, context)
+        entries = [token for token in lz.encoded_vocab if token != EMPTY_TOKEN]
+        out += write_varint(len(entries))
+        index = {EMPTY_TOKEN: -1}
+        free = _FreeTokens()
+        for i, token in enumerate(entries):
+            prefix = lz.encoded_vocab[token]
+            parent = lz.token_map.get(prefix[:-1])
+            if parent is not None and parent in index:
+                out += write_varint(i - index[parent])
+                _write_signed(out, prefix[-1])
+            else:
+                out += write_varint(0)
+                out += write_varint(len(prefix))
+                for c in prefix:
+                    _write_signed(out, c)
+            out += write_varint(token - free.smallest)
+            free.take(token)
+            index[token] = i
+
+    if compression == "zlib":
+        body = zlib.compress(bytes(out), 9)
+    elif compression == "lzma":
+        body = lzma.compress(bytes(out))
+    else:
+        body = bytes(out)
+    return MAGIC + bytes([COMPRESSIONS[compression]]) + body
+
+
+def _corrupt(what: str) -> ValueError:
+    return ValueError(f"corrupt compact coder: {what}")
+
+
+def _valid_symbol(c: int, header: dict) -> bool:
+    n_symbols = header["n_symbols"]
+    return 0 <= c and (n_symbols is None or c < n_symbols)
+
+
+def _read_header(data: bytes) -> Tuple[_Reader, dict]:
+    if data[:len(MAGIC)] != MAGIC:
+        raise ValueError("not a compact coder")
+    if len(data) == len(MAGIC) or data[len(MAGIC)] not in COMPRESSIONS.values():
+        raise _corrupt("bad compression")
+    compression = data[len(MAGIC)]
+    body = data[len(MAGIC) + 1:]
+    try:
+        if compression == COMPRESSIONS["zlib"]:
+            body = zlib.decompress(body)
+        elif compression == COMPRESSIONS["lzma"]:
+            body = lzma.decompress(body)
+    except (zlib.error, lzma.LZMAError, EOFError) as e:
+        raise _corrupt(str(e))
+
+    r = _Reader(body)
+    hierarchical, input_mode, vocab_size = r.varint(), r.varint(), r.varint()
+    if hierarchical > 1 or input_mode >= len(INPUT_MODES):
+        raise _corrupt("bad coder kind")
+    if not 0 < vocab_size <= MAX_VOCAB_SIZE:
+        raise _corrupt("bad vocab size")
+    header = {
+        "hierarchical": bool(hierarchical),
+        "input_mode": INPUT_MODES[input_mode],
+        "vocab_size": vocab_size,
+    }
+    alphabet = [r.signed() for _ in range(r.varint())]
+    if INPUT_MODES[input_mode] == BYTE_INPUT and alphabet:
+        raise _corrupt("alphabet in byte mode")
+    if len(set(alphabet)) != len(alphabet) or not all(0 <= c <= 0x10ffff for c in alphabet):
+        raise _corrupt("bad alphabet")
+    header["alphabet"] = alphabet
+    # alphabet ids in code point mode; any non-negative int in byte mode.
+    header["n_symbols"] = len(alphabet) if INPUT_MODES[input_mode] == CODEPOINT_INPUT else None
+
+    input_vocab: List[int] = []
+    previous = 0
+    for _ in range(r.varint()):
+        previous += r.signed()
+        if (input_vocab and previous <= input_vocab[-1]) or not _valid_symbol(previous, header):
+            raise _corrupt("bad input vocab")
+        input_vocab.append(previous)
+    header["input_vocab"] = input_vocab
+    return r, header
+
+
+def _read_contexts(r: _Reader, header: dict) -> Dict[TOKEN_TYPE, List[Tuple[TOKEN_TYPE, Tuple[TOKEN_TYPE, ...]]]]:
+    # each context with its (token, prefix) entries in creation order.
+    # Prefixes are rebuilt from the parent pointers: each one is its parent's
+    # tuple plus one symbol. Everything a coder would trust is checked here:
+    # tokens in range and used once, prefixes well formed and distinct.
+    vocab_size = header["vocab_size"]
+    contexts = {}
+    for _ in range(r.varint()):
+        context = r.signed()
+        if context in contexts or not (context == EMPTY_TOKEN or header["hierarchical"] and 0 <= context < vocab_size):
+            raise _corrupt("bad context")
+        count = r.varint()
+        if count > vocab_size:
+            raise _corrupt("too many entries")
+        prefixes: List[Tuple[TOKEN_TYPE, ...]] = []
+        seen: Set[Tuple[TOKEN_TYPE, ...]] = set()
+        entries = []
+        free = _FreeTokens()
+        for i in range(count):
+            distance = r.varint()
+            if distance > i + 1:
+                raise _corrupt("bad parent")
+            if distance > 0:
+                parent = i - distance
+                prefix = (prefixes[parent] if parent >= 0 else ()) + (r.signed(),)
+            else:
+                length = r.varint()
+                if length == 0 or length > len(r.data):
+                    raise _corrupt("bad prefix length")
+                prefix = tuple(r.signed() for _ in range(length))
+            if prefix in seen or not all(_valid_symbol(c, header) for c in prefix):
+                raise _corrupt("bad prefix")
+            token = free.smallest + r.varint()
+            if token >= vocab_size or token in free.used:
+                raise _corrupt("bad token")
+            free.take(token)
+            seen.add(prefix)
+            prefixes.append(prefix)
+            entries.append((token, prefix))
+        contexts[context] = entries
+    if EMPTY_TOKEN not in contexts:
+        raise _corrupt("no EMPTY_TOKEN context")
+    known = set(prefix for _, prefix in contexts[EMPTY_TOKEN])
+    if not all((c,) in known for c in header["input_vocab"]):
+        raise _corrupt("input symbol without an entry")
+    return contexts
+
+
+def loads(data: bytes) -> Coder:
+    r, header = _read_header(data)
+    contexts = _read_contexts(r, header)
+    cls = HierachicalLZCoder if header["hierarchical"] else LZCoder
+    try:
+        coder = cls(header["vocab_size"], input_vocab=set(), input_mode=header["input_mode"])
+        for c in header["alphabet"]:
+            coder.alphabet.add(c)
+
+        for context, entries in contexts.items():
+            if not header["hierarchical"]:
+                lz = coder
+            elif context in coder.coders:
+                lz = coder.coders[context]
+            else:
+                lz = coder._new_coder(context)
+            for token, prefix in entries:
+                lz._add_new_token(prefix, token)
+
+        (coder.coders[EMPTY_TOKEN] if header["hierarchical"] else coder).input_vocab.update(header["input_vocab"])
+    except (KeyError, IndexError, AssertionError) as e:
+        # anything the checks above missed.
+        raise _corrupt(repr(e))
+    return coder
+
+
+def loads_flat(data: bytes) -> FlatCoder:
+    # straight to a frozen FlatCoder, without building any pygtrie tries.
+    r, header = _read_header(data)
+    vocabs = {}
+    for context, entries in _read_contexts(r, header).items():
+        vocab = {EMPTY_TOKEN: ()}
+        vocab.update(entries)
+        vocabs[context] = vocab
+    try:
+        return FlatCoder(flat_bytes_from_vocabs(header["hierarchical"], header["input_mode"], header["vocab_size"],
+                                                header["alphabet"], vocabs))
+    except (KeyError, IndexError, AssertionError, OverflowError) as e:
+        raise _corrupt(repr(e))
+
+
+def dump(coder: Coder, path: Union[str, os.PathLike], compression: Optional[str]=None) -> None:
+    with open(path, 'wb') as f:
+        f.write(dumps(coder, compression))
+
+
+def load(path: Union[str, os.PathLike]) -> Coder:
+    with open(path, 'rb') as f:
+        return loads(f.read())
+
+
+__all__ = ["dumps", "loads", "loads_flat", "dump", "load"]
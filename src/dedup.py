@@ -0,0 +1,135 @@
+from typing import Dict, List, Optional, Tuple
+from collections import OrderedDict
+from array import array
+from dataclasses import dataclass
+import hashlib
+import random
+
+from .lz import Coder, ensure_buffer, EMPTY_TOKEN, TOKEN_TYPE, INPUT_SYMBOL_SEQUENCE_TYPE
+
+
+# content-defined chunking with a "gear" rolling hash (as in FastCDC).
+# each input symbol shifts the hash left by one and adds a random 64 bit value,
+# so the hash only depends on the last 64 symbols. We cut a chunk whenever the
+# masked hash is zero, which means chunk boundaries move with the content:
+# inserting a few bytes near the start of a document only changes the chunks
+# around the insertion, and the rest of the document still hits the cache.
+HASH_MASK = (1 << 64) - 1
+HASH_WINDOW = 64
+
+_gear_rng = random.Random(0x6765617220636463)
+GEAR = [_gear_rng.getrandbits(64) for _ in range(256)]
+
+
+def chunk_boundaries(data: List[TOKEN_TYPE], min_size: int=256, avg_size: int=1024, max_size: int=8192) -> List[int]:
+    '''
+    returns the end offsets of the content-defined chunks of data.
+    the last offset is always len(data).
+    '''
+    assert 0 < min_size <= avg_size <= max_size, "need 0 < min_size <= avg_size <= max_size"
+    assert avg_size & (avg_size - 1) == 0, "avg_size should be a power of two"
+
+    mask = avg_size - 1
+    gear = GEAR
+    n = len(data)
+    boundaries = []
+    start = 0
+    while start < n:
+        end = min(start + max_size, n)
+        # nothing before min_size can be a boundary, and the hash forgets
+        # everything older than HASH_WINDOW symbols, so skip ahead.
+        i = max(start, start + min_size - HASH_WINDOW)
+        h = 0
+        cut = end
+        while i < end:
+            h = ((h << 1) + gear[data[i] & 0xff]) & HASH_MASK
+            i += 1
+            if (h & mask) == 0 and i - start >= min_size:
+                cut = i
+                break
+        boundaries.append(cut)
+        start = cut
+    return boundaries
+
+
+@dataclass
+class DedupStats:
+    chunks: int = 0
+    hits: int = 0
+    symbols: int = 0
+    hit_symbols: int = 0
+
+    @property
+    def hit_rate(self) -> float:
+        return self.hits / self.chunks if self.chunks > 0 else 0.0
+
+    @property
+    def symbol_hit_rate(self) -> float:
+        return self.hit_symbols / self.symbols if self.symbols > 0 else 0.0
+
+
+class DedupEncoder:
+    '''
+    front-end for a frozen coder: splits the input into content-defined chunks
+    and encodes every chunk from a reset context, so that the tokens for a chunk
+    only depend on the chunk itself and can be cached by a hash of its content.
+
+    For hierarchical coders the chunks are separated by EMPTY_TOKEN, which
+    decodes to nothing and switches back to the EMPTY_TOKEN context, so the
+    output can be decoded with the coder's usual decode.
+    '''
+    coder: Coder
+    cache: Dict[bytes, Tuple[TOKEN_TYPE, ...]]
+    stats: DedupStats
+
+    def __init__(self, coder: Coder, min_chunk: int=256, avg_chunk: int=1024, max_chunk: int=8192, max_cache_entries: Optional[int]=None):
+        self.coder = coder
+        self.min_chunk = min_chunk
+        self.avg_chunk = avg_chunk
+        self.max_chunk = max_chunk
+        self.max_cache_entries = max_cache_entries
+        self.cache = OrderedDict()
+        self.stats = DedupStats()
+        self.separator = [EMPTY_TOKEN] if coder.hierarchical else []
+
+    def encode(self, to_encode: INPUT_SYMBOL_SEQUENCE_TYPE) -> List[TOKEN_TYPE]:
+        # chunk the symbols the coder sees: bytes (str as UTF-8), or code points
+        # for a CODEPOINT_INPUT coder.
+        data = ensure_buffer(to_encode, self.coder.input_mode)
+
+        encoded = []
+        start = 0
+        for end in chunk_boundaries(data, self.min_chunk, self.avg_chunk, self.max_chunk):
+            if start > 0:
+                encoded += self.separator
+            encoded += self.encode_chunk(data[start:end])
+            start = end
+        return encoded
+
+    def encode_chunk(self, chunk: INPUT_SYMBOL_SEQUENCE_TYPE) -> Tuple[TOKEN_TYPE, ...]:
+        chunk = ensure_buffer(chunk, self.coder.input_mode)
+        raw = chunk.tobytes() if isinstance(chunk, memoryview) else array('q', chunk).tobytes()
+        key = hashlib.blake2b(raw, digest_size=16).digest()
+
+        self.stats.chunks += 1
+        self.stats.symbols += len(chunk)
+
+        tokens = self.cache.get(key)
+        if tokens is not None:
+            self.cache.move_to_end(key)
+            self.stats.hits += 1
+            self.stats.hit_symbols += len(chunk)
+            return tokens
+
+        # a fresh call to encode always starts from the EMPTY_TOKEN context.
+        tokens = tuple(self.coder.encode(chunk, learn=False))
+        self.cache[key] = tokens
+        if self.max_cache_entries is not None and len(self.cache) > self.max_cache_entries:
+            self.cache.popitem(last=False)
+        return tokens
+
+    def decode(self, to_decode: List[TOKEN_TYPE]) -> List[TOKEN_TYPE]:
+        return self.coder.decode(to_decode)
+
+
+__all__ = ["DedupEncoder", "DedupStats", "chunk_boundaries"]
@@ -0,0 +1,189 @@
+from typing import List, Optional, Sequence, Tuple
+from array import array
+import math
+
+
+# Static entropy coding of symbols 0..n-1 (token + 1, for token streams) with
+# rANS: the coder state x is a single integer, and coding symbol s with
+# frequency f out of M = 1 << precision maps x to about x * M / f, so a symbol
+# costs log2(M / f) bits, fractions of bits included. The state is kept in
+# [RANS_L, RANS_L << 8) by shifting bytes out (encoding) or in (decoding).
+#
+# rANS is last in, first out, so the encoder goes through the symbols
+# backwards and the decoder forwards. The stream is the final encoder state
+# (4 bytes, little endian) followed by the renormalization bytes in the order
+# the decoder reads them; lznative.c writes exactly the same bytes.
+#
+# Decoding a symbol needs the state the previous one left, so a single stream
+# is one long dependency chain. With lanes > 1, symbol i is coded by lane
+# i % lanes, each with its own state (all stored up front), and the lanes
+# share the stream of renormalization bytes. The lanes are independent, so
+# native code can work on several symbols at once (see rans_decode in
+# lznative.c); in Python they only cost a little.
+
+RANS_L = 1 << 23
+MAX_PRECISION = 16
+MAX_LANES = 32
+
+
+def normalize(counts: Sequence[int], precision: int) -> List[int]:
+    '''
+    frequencies proportional to counts that sum to 1 << precision, with every
+    symbol at least 1, so that symbols never seen can still be coded.
+    '''
+    if not 0 <= precision <= MAX_PRECISION:
+        raise ValueError(f"precision must be between 0 and {MAX_PRECISION}")
+    total_slots = 1 << precision
+    if len(counts) > total_slots:
+        raise ValueError("more symbols than slots: increase the precision")
+    total = sum(counts)
+    if total == 0:
+        counts = [1] * len(counts)
+        total = len(counts)
+    freq = [max(1, c * total_slots // total) for c in counts]
+    # hand out (or take back) what rounding got wrong, most frequent first.
+    by_count = sorted(range(len(counts)), key=lambda s: -counts[s])
+    excess = sum(freq) - total_slots
+    i = 0
+    while excess != 0:
+        s = by_count[i % len(by_count)]
+        if excess < 0:
+            freq[s] += 1
+            excess += 1
+        elif freq[s] > 1:
+            freq[s] -= 1
+            excess -= 1
+        i += 1
+    return freq
+
+
+def write_varint(value: int) -> bytes:
+    out = bytearray()
+    while value >= 0x80:
+        out.append((value & 0x7f) | 0x80)
+        value >>= 7
+    out.append(value)
+    return bytes(out)
+
+
+def read_varint(data, offset: int) -> Tuple[int, int]:
+    # the value and the offset right after it.
+    value, shift = 0, 0
+    while True:
+        if offset >= len(data) or shift >= 64:
+            raise ValueError("corrupt varint")
+        b = data[offset]
+        offset += 1
+        value |= (b & 0x7f) << shift
+        if b < 0x80:
+            return value, offset
+        shift += 7
+
+
+class FrequencyTable:
+    '''
+    normalized frequencies of n symbols for rANS, with the cumulative
+    frequencies for encoding and the slot -> symbol map for decoding.
+    '''
+    precision: int
+    freq: array
+    cum: array
+    slot_symbol: array
+
+    def __init__(self, freq: Sequence[int], precision: int):
+        # the coders keep states below 1 << 32 only up to MAX_PRECISION.
+        if not 0 <= precision <= MAX_PRECISION:
+            raise ValueError(f"precision must be between 0 and {MAX_PRECISION}")
+        if len(freq) == 0 or sum(freq) != 1 << precision or min(freq) < 1:
+            raise ValueError("frequencies must be positive and sum to 1 << precision")
+        self.precision = precision
+        self.freq = array('I', freq)
+        self.cum = array('I', [0]) * len(freq)
+        slot_symbol = array('i')
+        total = 0
+        for s, f in enumerate(freq):
+            self.cum[s] = total
+            total += f
+            slot_symbol.extend(array('i', [s]) * f)
+        self.slot_symbol = slot_symbol
+
+    @classmethod
+    def from_counts(cls, counts: Sequence[int], precision: Optional[int]=None) -> "FrequencyTable":
+        # by default, enough precision for a few slots per symbol.
+        if precision is None:
+            precision = min(MAX_PRECISION, max(12, math.ceil(math.log2(max(len(counts), 2))) + 2))
+        return cls(normalize(counts, precision), precision)
+
+    def __len__(self) -> int:
+        return len(self.freq)
+
+    def bits(self, symbol: int) -> float:
+        return self.precision - math.log2(self.freq[symbol])
+
+    def to_bytes(self) -> bytes:
+        return bytes([self.precision]) + write_varint(len(self.freq)) + b"".join(write_varint(f) for f in self.freq)
+
+    @classmethod
+    def from_bytes(cls, data, offset: int=0) -> "FrequencyTable":
+        precision = data[offset]
+        n, offset = read_varint(data, offset + 1)
+        freq = []
+        for _ in range(n):
+            f, offset = read_varint(data, offset)
+            freq.append(f)
+        return cls(freq, precision)
+
+
+def rans_encode(table: FrequencyTable, symbols: Sequence[int], lanes: int=1) -> bytes:
+    if not 1 <= lanes <= MAX_LANES:
+        raise ValueError("bad number of lanes")
+    freq, cum, precision = table.freq, table.cum, table.precision
+    bound = (RANS_L >> precision) << 8
+    states = [RANS_L] * lanes
+    out = bytearray()
+    for i in range(len(symbols) - 1, -1, -1):
+        s = symbols[i]
+        f = freq[s]
+        x_max = bound * f
+        x = states[i % lanes]
+        while x >= x_max:
+            out.append(x & 0xff)
+            x >>= 8
+        states[i % lanes] = ((x // f) << precision) + (x % f) + cum[s]
+    out.reverse()
+    return b"".join(x.to_bytes(4, 'little') for x in states) + bytes(out)
+
+
+def rans_decode(table: FrequencyTable, data, count: int, offset: int=0, lanes: int=1) -> Tuple[List[int], int]:
+    '''
+    decodes count symbols from data at offset. Returns them and the offset
+    right after the stream.
+    '''
+    if not 1 <= lanes <= MAX_LANES:
+        raise ValueError("bad number of lanes")
+    freq, cum, slot_symbol, precision = table.freq, table.cum, table.slot_symbol, table.precision
+    mask = (1 << precision) - 1
+    p = offset + 4 * lanes
+    if p > len(data):
+        raise ValueError("corrupt rANS stream")
+    states = [int.from_bytes(data[offset + 4 * j:offset + 4 * j + 4], 'little') for j in range(lanes)]
+    end = len(data)
+    out = []
+    for i in range(count):
+        x = states[i % lanes]
+        slot = x & mask
+        s = slot_symbol[slot]
+        out.append(s)
+        x = freq[s] * (x >> precision) + slot - cum[s]
+        while x < RANS_L:
+            if p == end:
+                raise ValueError("corrupt rANS stream")
+            x = (x << 8) | data[p]
+            p += 1
+        states[i % lanes] = x
+    if any(x != RANS_L for x in states):
+        raise ValueError("corrupt rANS stream")
+    return out, p
+
+
+__all__ = ["FrequencyTable", "normalize", "rans_encode", "rans_decode", "read_varint", "write_varint", "RANS_L", "MAX_LANES"]
@@ -0,0 +1,376 @@
+from typing import Dict, List, Optional, Tuple, Union
+from array import array
+from bisect import bisect_left
+import os
+import struct
+
+from .lz import (Coder, HierachicalLZCoder, EMPTY_TOKEN, TOKEN_TYPE, INPUT_SYMBOL_SEQUENCE_TYPE,
+                 BYTE_INPUT, CODEPOINT_INPUT, context_coders, ensure_buffer, map_file)
+
+
+# A flat binary layout for frozen coders. Everything is stored in plain int32
+# arrays, so loading a coder is just slicing memoryviews out of a buffer (a file
+# mapping, a shared memory segment, ...) without reading or copying anything,
+# and the same layout can be walked by native code.
+#
+# Every context (the single dictionary of an LZCoder, or each context of a
+# HierachicalLZCoder) gets a trie of nodes. The nodes of a context are stored
+# contiguously and sorted by token, so decode can bisect for a token, and the
+# trie edges of all contexts live in one open addressing hash table keyed by
+# (node, symbol).
+#
+# layout: MAGIC, the header fields below as int64, then the arrays in the order
+# of ARRAYS, each starting at a multiple of 8 bytes.
+
+MAGIC = b"HLZFLAT1"
+HEADER_FIELDS = ["kind", "input_mode", "vocab_size", "n_contexts", "n_nodes", "edge_capacity", "alphabet_size", "expansion_size"]
+HEADER = struct.Struct("<8s" + "q" * len(HEADER_FIELDS))
+
+LZ_KIND = 0
+HIERARCHICAL_KIND = 1
+INPUT_MODES = [BYTE_INPUT, CODEPOINT_INPUT]
+
+# node_token of a trie node that is only a prefix of an entry, not an entry.
+NO_TOKEN = -2
+EMPTY_SLOT = -1
+
+ARRAYS = [
+    # token + 1 -> index of the context for that token, or -1 if it has none.
+    ("context_of", lambda h: h["vocab_size"] + 1),
+    # context index -> first node of the context. The context's root comes first
+    # among its entries, right after any NO_TOKEN nodes.
+    ("context_start", lambda h: h["n_contexts"] + 1),
+    ("root", lambda h: h["n_contexts"]),
+    ("node_token", lambda h: h["n_nodes"]),
+    ("node_offset", lambda h: h["n_nodes"]),
+    ("node_length", lambda h: h["n_nodes"]),
+    ("edge_node", lambda h: h["edge_capacity"]),
+    ("edge_symbol", lambda h: h["edge_capacity"]),
+    ("edge_child", lambda h: h["edge_capacity"]),
+    ("alphabet", lambda h: h["alphabet_size"]),
+    ("expansion", lambda h: h["expansion_size"]),
+]
+
+INT32_MIN = -(1 << 31)
+INT32_MAX = (1 << 31) - 1
+
+
+def edge_slot(node: int, symbol: int, mask: int) -> int:
+    # any mixing will do as long as the native code uses the same one.
+    return ((node * 0x9E3779B1) ^ (symbol * 0x85EBCA77)) & mask
+
+
+def _align(n: int) -> int:
+    return (n + 7) & ~7
+
+
+def _check_header(header: Dict[str, int], nbytes: int) -> None:
+    if header["kind"] not in (LZ_KIND, HIERARCHICAL_KIND):
+        raise ValueError("corrupt flat coder: unknown kind")
+    if not 0 <= header["input_mode"] < len(INPUT_MODES):
+        raise ValueError("corrupt flat coder: unknown input mode")
+    # node and token ids are int32.
+    if any(not 0 <= header[f] <= INT32_MAX for f in HEADER_FIELDS[2:]):
+        raise ValueError("corrupt flat coder: bad sizes")
+    capacity = header["edge_capacity"]
+    if capacity & (capacity - 1) != 0:
+        raise ValueError("corrupt flat coder: the edge table size is not a power of two")
+    # every node but the roots has one edge, and the table needs an empty slot
+    # to end a probe.
+    if header["n_nodes"] < header["n_contexts"] or header["n_nodes"] - header["n_contexts"] >= capacity:
+        raise ValueError("corrupt flat coder: the edge table is too small")
+    offset = HEADER.size
+    for _, length in ARRAYS:
+        offset = _align(offset) + 4 * length(header)
+    if offset > nbytes:
+        raise ValueError("corrupt flat coder: truncated")
+
+
+def to_flat_bytes(coder: Coder) -> bytes:
+    hierarchical = isinstance(coder, HierachicalLZCoder)
+    vocabs = {context: c.encoded_vocab for context, c in context_coders(coder).items()}
+    vocab_size = coder.vocab_size if hierarchical else coder.vocab_size - 1
+    alphabet = coder.alphabet.symbols if coder.alphabet is not None else []
+    return flat_bytes_from_vocabs(hierarchical, coder.input_mode, vocab_size, alphabet, vocabs)
+
+
+def flat_bytes_from_vocabs(hierarchical: bool, input_mode: str, vocab_size: int, alphabet: List[int],
+                           vocabs: Dict[TOKEN_TYPE, Dict[TOKEN_TYPE, Tuple[TOKEN_TYPE, ...]]]) -> bytes:
+    # vocabs maps each context to its encoded_vocab (token -> prefix).
+    contexts = sorted(vocabs)
+    context_of = array('i', [-1] * (vocab_size + 1))
+    context_start = array('i')
+    root = array('i')
+    node_token = array('i')
+    node_offset = array('i')
+    node_length = array('i')
+    expansion = array('i')
+    edges: List[Tuple[int, int, int]] = []
+
+    for index, context in enumerate(contexts):
+        context_of[context + 1] = index
+        encoded_vocab = vocabs[context]
+
+        # every prefix of an entry is a node of the trie.
+        nodes = {prefix: token for token, prefix in encoded_vocab.items()}
+        for prefix in list(nodes):
+            for i in range(len(prefix)):
+                nodes.setdefault(prefix[:i], NO_TOKEN)
+
+        first = len(node_token)
+        context_start.append(first)
+        ordered = sorted(nodes, key=lambda prefix: (nodes[prefix], prefix))
+        ids = {prefix: first + i for i, prefix in enumerate(ordered)}
+        root.append(ids[()])
+        for prefix in ordered:
+            node_token.append(nodes[prefix])
+            node_offset.append(len(expansion))
+            node_length.append(len(prefix))
+            expansion.extend(prefix)
+            if len(prefix) > 0:
+                edges.append((ids[prefix[:-1]], prefix[-1], ids[prefix]))
+    context_start.append(len(node_token))
+
+    edge_capacity = 8
+    while edge_capacity < 2 * len(edges):
+        edge_capacity *= 2
+    mask = edge_capacity - 1
+    edge_node = array('i', [EMPTY_SLOT] * edge_capacity)
+    edge_symbol = array('i', [0] * edge_capacity)
+    edge_child = array('i', [0] * edge_capacity)
+    for node, symbol, child in edges:
+        slot = edge_slot(node, symbol, mask)
+        while edge_node[slot] != EMPTY_SLOT:
+            slot = (slot + 1) & mask
+        edge_node[slot] = node
+        edge_symbol[slot] = symbol
+        edge_child[slot] = child
+
+    alphabet = array('i', alphabet)
+
+    header = {
+        "kind": HIERARCHICAL_KIND if hierarchical else LZ_KIND,
+        "input_mode": INPUT_MODES.index(input_mode),
+        "vocab_size": vocab_size,
+        "n_contexts": len(contexts),
+        "n_nodes": len(node_token),
+        "edge_capacity": edge_capacity,
+        "alphabet_size": len(alphabet),
+        "expansion_size": len(expansion),
+    }
+    arrays = {
+        "context_of": context_of, "context_start": context_start, "root": root,
+        "node_token": node_token, "node_offset": node_offset, "node_length": node_length,
+        "edge_node": edge_node, "edge_symbol": edge_symbol, "edge_child": edge_child,
+        "alphabet": alphabet, "expansion": expansion,
+    }
+
+    out = bytearray(HEADER.pack(MAGIC, *[header[f] for f in HEADER_FIELDS]))
+    for name, _ in ARRAYS:
+        out += b"\0" * (_align(len(out)) - len(out))
+        out += arrays[name].tobytes()
+    return bytes(out)
+
+
+def dump_flat(coder: Coder, path: Union[str, os.PathLike]) -> None:
+    with open(path, 'wb') as f:
+        f.write(to_flat_bytes(coder))
+
+
+class FlatCoder(Coder):
+    '''
+    a frozen LZCoder or HierachicalLZCoder backed by the flat layout above.
+    Construction slices views out of the buffer and checks that every index
+    in them is in range, without copying anything; pass check=False to skip
+    the check on a buffer from to_flat_bytes and open it in O(1).
+    '''
+    frozen = True
+    hierarchical: bool
+    vocab_size: int
+    nbytes: int
+    offsets: Dict[str, int]
+
+    def __init__(self, buffer, owner=None, check: bool=True):
+        # owner, if given, is closed along with the coder (e.g. a SharedMemory).
+        # check walks the arrays once to make sure every index in them is in
+        # range; only skip it for buffers from to_flat_bytes.
+        self._owner = owner
+        view = memoryview(buffer).cast('B')
+        if len(view) < HEADER.size:
+            raise ValueError("not a flat coder: too short")
+        magic, *fields = HEADER.unpack_from(view, 0)
+        # the last byte of the magic is the layout version.
+        if magic != MAGIC:
+            raise ValueError("not a flat coder, or an unsupported version of the layout")
+        header = dict(zip(HEADER_FIELDS, fields))
+        _check_header(header, len(view))
+
+        self.hierarchical = header["kind"] == HIERARCHICAL_KIND
+        self.input_mode = INPUT_MODES[header["input_mode"]]
+        self.vocab_size = header["vocab_size"]
+        self.n_contexts = header["n_contexts"]
+
+        offset = HEADER.size
+        self._views = [view]
+        self.offsets = {}
+        for name, length in ARRAYS:
+            offset = _align(offset)
+            self.offsets[name] = offset
+            size = 4 * length(header)
+            array_view = view[offset:offset + size].cast('i')
+            setattr(self, name, array_view)
+            self._views.append(array_view)
+            offset += size
+        self.nbytes = offset
+        self.edge_mask = header["edge_capacity"] - 1
+        self._alphabet_ids = None
+        if check:
+            self._check_arrays()
+
+    def _check_arrays(self) -> None:
+        # everything encode and decode (and the native code) index with.
+        n_contexts, n_nodes = self.n_contexts, len(self.node_token)
+        if len(self.context_of) > 0 and not -1 <= min(self.context_of) <= max(self.context_of) < n_contexts:
+            raise ValueError("corrupt flat coder: bad context index")
+        context_start = self.context_start
+        if context_start[0] != 0 or context_start[-1] != n_nodes or \
+                any(a > b for a, b in zip(context_start, context_start[1:])):
+            raise ValueError("corrupt flat coder: bad context bounds")
+        for index, node in enumerate(self.root):
+            if not context_start[index] <= node < context_start[index + 1]:
+                raise ValueError("corrupt flat coder: bad context root")
+        node_token = self.node_token
+        if n_nodes > 0 and not NO_TOKEN <= min(node_token) <= max(node_token) < self.vocab_size:
+            raise ValueError("corrupt flat coder: bad token")
+        for index in range(n_contexts):
+            start, end = context_start[index], context_start[index + 1]
+            if any(a > b for a, b in zip(node_token[start:end], node_token[start + 1:end])):
+                raise ValueError("corrupt flat coder: nodes are not sorted by token")
+        n_expansion = len(self.expansion)
+        if n_nodes > 0 and (min(self.node_offset) < 0 or min(self.node_length) < 0 or
+                            any(o + l > n_expansion for o, l in zip(self.node_offset, self.node_length))):
+            raise ValueError("corrupt flat coder: bad expansion")
+        edge_node = self.edge_node
+        if not -1 <= min(edge_node) <= max(edge_node) < n_nodes:
+            raise ValueError("corrupt flat coder: bad edge")
+        if EMPTY_SLOT not in edge_node:
+            raise ValueError("corrupt flat coder: the edge table is full")
+        if any(not 0 <= c < n_nodes for n, c in zip(edge_node, self.edge_child) if n != EMPTY_SLOT):
+            raise ValueError("corrupt flat coder: bad edge")
+
+    @classmethod
+    def open(cls, path: Union[str, os.PathLike]) -> "FlatCoder":
+        return cls(map_file(path))
+
+    def close(self) -> None:
+        # release our views; a file mapping is unmapped once nothing else uses it.
+        views, self._views = self._views, []
+        for v in reversed(views):
+            v.release()
+        if self._owner is not None:
+            self._owner.close()
+            self._owner = None
+
+    def update_vocab(self, to_encode: INPUT_SYMBOL_SEQUENCE_TYPE) -> None:
+        raise ValueError("flat coders are frozen")
+
+    def _to_symbols(self, to_encode: INPUT_SYMBOL_SEQUENCE_TYPE, learn: bool=False):
+        if learn:
+            raise ValueError("flat coders are frozen: learning is not possible")
+        to_encode = ensure_buffer(to_encode, self.input_mode)
+        if len(self.alphabet) > 0:
+            if self._alphabet_ids is None:
+                self._alphabet_ids = {c: i for i, c in enumerate(self.alphabet)}
+            ids = self._alphabet_ids
+            try:
+                to_encode = ensure_buffer([ids[c] for c in to_encode])
+            except KeyError:
+                raise ValueError("unknown input symbol: did you mean to enable learning?")
+        return to_encode
+
+    def _from_symbols(self, decoded: List[TOKEN_TYPE]) -> List[TOKEN_TYPE]:
+        if len(self.alphabet) > 0:
+            alphabet = self.alphabet
+            return [alphabet[i] for i in decoded]
+        return decoded
+
+    def child(self, node: int, symbol: int) -> int:
+        edge_node = self.edge_node
+        mask = self.edge_mask
+        if not INT32_MIN <= symbol <= INT32_MAX:
+            return -1
+        slot = edge_slot(node, symbol, mask)
+        # at most one lap, even if a table that was not checked has no empty slot.
+        for _ in range(mask + 1):
+            n = edge_node[slot]
+            if n == node and self.edge_symbol[slot] == symbol:
+                return self.edge_child[slot]
+            if n == EMPTY_SLOT:
+                return -1
+            slot = (slot + 1) & mask
+        return -1
+
+    def context_root(self, context: TOKEN_TYPE) -> int:
+        index = self.context_of[context + 1] if -1 <= context < self.vocab_size else -1
+        if index < 0:
+            raise ValueError("context not in coders")
+        return self.root[index]
+
+    def encode_one_token(self, to_encode, context: TOKEN_TYPE=EMPTY_TOKEN, learn: bool=False) -> Tuple[int, TOKEN_TYPE]:
+        # returns the number of symbols consumed rather than the prefix itself.
+        if learn:
+            raise ValueError("flat coders are frozen: learning is not possible")
+        node_token = self.node_token
+        node = self.context_root(context)
+        token, length = node_token[node], 0
+        for i, symbol in enumerate(to_encode):
+            node = self.child(node, symbol)
+            if node < 0:
+                break
+            if node_token[node] != NO_TOKEN:
+                token, length = node_token[node], i + 1
+        return length, token
+
+    def encode(self, to_encode: INPUT_SYMBOL_SEQUENCE_TYPE, learn: bool=False) -> List[TOKEN_TYPE]:
+        to_encode = self._to_symbols(to_encode, learn)
+        context = EMPTY_TOKEN
+        encoded = []
+        while len(to_encode) > 0:
+            length, token = self.encode_one_token(to_encode, context)
+            if length == 0 and context == EMPTY_TOKEN:
+                raise ValueError("could not match any tokens: did you mean to enable learning?")
+            encoded.append(token)
+            if self.hierarchical:
+                context = token
+            to_encode = to_encode[length:]
+        return encoded
+
+    def find_node(self, context: TOKEN_TYPE, token: TOKEN_TYPE) -> int:
+        index = self.context_of[context + 1] if -1 <= context < self.vocab_size else -1
+        if index < 0:
+            raise KeyError(context)
+        # NO_TOKEN nodes are prefixes, not entries.
+        if token < EMPTY_TOKEN:
+            raise KeyError(token)
+        start, end = self.context_start[index], self.context_start[index + 1]
+        node = bisect_left(self.node_token, token, start, end)
+        if node == end or self.node_token[node] != token:
+            raise KeyError(token)
+        return node
+
+    def decode_one_token(self, to_decode: TOKEN_TYPE, context: TOKEN_TYPE=EMPTY_TOKEN) -> List[TOKEN_TYPE]:
+        node = self.find_node(context, to_decode)
+        offset = self.node_offset[node]
+        return self.expansion[offset:offset + self.node_length[node]].tolist()
+
+    def decode(self, to_decode: List[TOKEN_TYPE]) -> List[TOKEN_TYPE]:
+        context = EMPTY_TOKEN
+        decoded = []
+        for t in to_decode:
+            decoded += self.decode_one_token(t, context)
+            if self.hierarchical:
+                context = t
+        return self._from_symbols(decoded)
+
+
+__all__ = ["FlatCoder", "to_flat_bytes", "flat_bytes_from_vocabs", "dump_flat"]
@@ -0,0 +1,336 @@
+from typing import Dict, Iterable, List, Optional, Sequence, Tuple, Union
+from array import array
+import heapq
+import os
+
+from .lz import Coder, TOKEN_TYPE, INPUT_SYMBOL_SEQUENCE_TYPE, EMPTY_TOKEN
+from .entropy import read_varint, write_varint
+
+
+# Static per-context Huffman codes for the token streams of frozen coders.
+# With a frozen dictionary we can afford two passes: count which tokens follow
+# each context (the previous token, which for a HierachicalLZCoder is the
+# context the next token is chosen in) over a training set, then fix a code
+# per context. A token is coded as symbol token + 1, so EMPTY_TOKEN is 0.
+#
+# Contexts only get a table of the tokens actually seen after them, plus an
+# ESCAPE symbol for the rest, which are then coded with the global (order 0)
+# table, which has every token. A context that was rarely seen, or whose table
+# would not save more than it costs to store, just uses the global table.
+#
+# Codes are canonical, so a table is stored as its code lengths only, and are
+# limited to MAX_CODE_LENGTH bits, so that decoding is one lookup in a table
+# of 1 << max_length entries (symbol << 5 | length) per code. The global table
+# has a code for every token, so for large vocabs it gets a few more bits (up
+# to MAX_GLOBAL_CODE_LENGTH, enough for a million tokens); an escaped token is
+# then at most 32 bits, a single refill of the decoder's bit buffer.
+
+MAX_CODE_LENGTH = 12
+MAX_GLOBAL_CODE_LENGTH = 20
+MAGIC = b"HLZHUFF1"
+
+
+def code_lengths(counts: Dict[int, int], max_length: int=MAX_CODE_LENGTH) -> Dict[int, int]:
+    '''
+    Huffman code lengths, at most max_length, of the symbols with a count.
+    '''
+    symbols = [s for s, c in counts.items() if c > 0]
+    if len(symbols) > 1 << max_length:
+        raise ValueError("more symbols than codes of max_length bits")
+    if len(symbols) == 1:
+        return {symbols[0]: 1}
+    # leaves are nodes 0..n-1, and each merge adds a node; lengths are depths.
+    heap = [(counts[s], i) for i, s in enumerate(symbols)]
+    heapq.heapify(heap)
+    parent = [0] * (2 * len(symbols) - 1)
+    node = len(symbols)
+    while len(heap) > 1:
+        c1, a = heapq.heappop(heap)
+        c2, b = heapq.heappop(heap)
+        parent[a] = parent[b] = node
+        heapq.heappush(heap, (c1 + c2, node))
+        node += 1
+    depth = [0] * len(parent)
+    for i in range(len(parent) - 2, -1, -1):
+        depth[i] = depth[parent[i]] + 1
+    lengths = {s: depth[i] for i, s in enumerate(symbols)}
+
+    if max(lengths.values()) > max_length:
+        # clamp, then make the code fit again (kraft sum <= 1, here in units of
+        # 2 ** -max_length) by lengthening the rarest codes that still can be.
+        for s in symbols:
+            lengths[s] = min(lengths[s], max_length)
+        kraft = sum(1 << (max_length - l) for l in lengths.values())
+        rarest_first = sorted(symbols, key=lambda s: counts[s])
+        while kraft > 1 << max_length:
+            for s in rarest_first:
+                if lengths[s] < max_length:
+                    lengths[s] += 1
+                    kraft -= 1 << (max_length - lengths[s])
+                    break
+    return lengths
+
+
+def global_code_length(n_symbols: int) -> int:
+    # the code length limit of a global table of n_symbols: room to spare for
+    # the skew of the token frequencies.
+    length = max(MAX_CODE_LENGTH, (n_symbols - 1).bit_length() + 2)
+    if length > MAX_GLOBAL_CODE_LENGTH:
+        if n_symbols > 1 << MAX_GLOBAL_CODE_LENGTH:
+            raise ValueError("too many tokens for Huffman tables")
+        length = MAX_GLOBAL_CODE_LENGTH
+    return length
+
+
+class HuffmanTable:
+    '''
+    canonical code of the given code lengths, with a lookup table for decoding.
+    '''
+    lengths: Dict[int, int]
+    codes: Dict[int, Tuple[int, int]]
+    max_length: int
+    lookup: array
+
+    def __init__(self, lengths: Dict[int, int]):
+        if len(lengths) == 0 or min(lengths.values()) < 1 or max(lengths.values()) > MAX_GLOBAL_CODE_LENGTH:
+            raise ValueError("invalid code lengths")
+        max_length = max(lengths.values())
+        if sum(1 << (max_length - l) for l in lengths.values()) > 1 << max_length:
+            raise ValueError("code lengths are not a prefix code")
+        self.lengths = lengths
+        self.max_length = max_length
+        self.codes = {}
+        # unused codes (only in codes that are not complete) decode to length 0.
+        self.lookup = array('i', [0]) * (1 << max_length)
+        code, previous = 0, 0
+        for s in sorted(lengths, key=lambda s: (lengths[s], s)):
+            length = lengths[s]
+            code <<= length - previous
+            previous = length
+            self.codes[s] = (code, length)
+            start = code << (max_length - length)
+            self.lookup[start:start + (1 << (max_length - length))] = array('i', [s << 5 | length]) * (1 << (max_length - length))
+            code += 1
+
+    @classmethod
+    def from_counts(cls, counts: Dict[int, int], max_length: int=MAX_CODE_LENGTH) -> "HuffmanTable":
+        return cls(code_lengths(counts, max_length))
+
+    def bits(self, counts: Dict[int, int]) -> int:
+        # the size of coding counts with this table (every symbol must have a code).
+        return sum(c * self.lengths[s] for s, c in counts.items())
+
+    def to_bytes(self) -> bytes:
+        out = bytearray(write_varint(len(self.lengths)))
+        previous = -1
+        for s in sorted(self.lengths):
+            out += write_varint(s - previous - 1)
+            out.append(self.lengths[s])
+            previous = s
+        return bytes(out)
+
+    @classmethod
+    def from_bytes(cls, data, offset: int=0) -> Tuple["HuffmanTable", int]:
+        # the table and the offset right after it.
+        n, offset = read_varint(data, offset)
+        lengths = {}
+        s = -1
+        for _ in range(n):
+            delta, offset = read_varint(data, offset)
+            if offset >= len(data):
+                raise ValueError("corrupt Huffman table")
+            s += delta + 1
+            lengths[s] = data[offset]
+            offset += 1
+        return cls(lengths), offset
+
+
+class HuffmanTables:
+    '''
+    the global table and the per-context tables of a frozen coder's tokens
+    (vocab_size tokens other than EMPTY_TOKEN). Fit them with from_tokens or
+    from_coder, and store them next to the dictionary with dump_tables.
+    '''
+    vocab_size: int
+    global_table: HuffmanTable
+    context_tables: Dict[TOKEN_TYPE, HuffmanTable]
+
+    def __init__(self, vocab_size: int, global_table: HuffmanTable, context_tables: Dict[TOKEN_TYPE, HuffmanTable]):
+        self.vocab_size = vocab_size
+        self.escape = vocab_size + 1
+        if any(s < 0 or s > vocab_size for s in global_table.lengths) or len(global_table.lengths) != vocab_size + 1:
+            raise ValueError("the global table must have a code for every token")
+        for table in context_tables.values():
+            if any(s < 0 or s > self.escape for s in table.lengths) or self.escape not in table.lengths:
+                raise ValueError("context tables must have tokens and an escape code")
+            if table.max_length > MAX_CODE_LENGTH:
+                raise ValueError("context table codes are too long")
+        self.global_table = global_table
+        self.context_tables = context_tables
+
+    @classmethod
+    def from_tokens(cls, streams: Iterable[Sequence[TOKEN_TYPE]], vocab_size: int, max_length: int=MAX_CODE_LENGTH,
+                    min_count: int=16) -> "HuffmanTables":
+        '''
+        fits the tables to the token streams: contexts seen fewer than min_count
+        times use the global table. max_length limits the context tables.
+        '''
+        if max_length > MAX_CODE_LENGTH:
+            raise ValueError("context table codes are limited to MAX_CODE_LENGTH bits")
+        escape = vocab_size + 1
+        # every token gets a global code, however rare, so that anything can be coded.
+        global_counts = {s: 1 for s in range(vocab_size + 1)}
+        by_context: Dict[TOKEN_TYPE, Dict[int, int]] = {}
+        for tokens in streams:
+            context = EMPTY_TOKEN
+            for t in tokens:
+                if not -1 <= t < vocab_size:
+                    raise ValueError("token out of range")
+                global_counts[t + 1] += 1
+                counts = by_context.get(context)
+                if counts is None:
+                    counts = by_context[context] = {}
+                counts[t + 1] = counts.get(t + 1, 0) + 1
+                context = t
+        global_table = HuffmanTable.from_counts(global_counts, global_code_length(vocab_size + 1))
+
+        context_tables = {}
+        for context, counts in by_context.items():
+            if sum(counts.values()) < min_count:
+                continue
+            # tokens seen only once are escaped: the table would mostly be paying
+            # for codes that never come up again, and they stand in for the
+            # tokens this context has not been seen with at all.
+            kept = {s: c for s, c in counts.items() if c > 1}
+            once = [s for s, c in counts.items() if c == 1]
+            kept[escape] = max(1, len(once))
+            table = HuffmanTable.from_counts(kept, max_length)
+            without = global_table.bits(counts)
+            with_table = (table.bits(kept) - table.lengths[escape] * (kept[escape] - len(once))
+                          + global_table.bits({s: 1 for s in once}))
+            if without - with_table > 8 * (len(table.to_bytes()) + 2):
+                context_tables[context] = table
+        return cls(vocab_size, global_table, context_tables)
+
+    @classmethod
+    def from_coder(cls, coder: Coder, samples: Iterable[INPUT_SYMBOL_SEQUENCE_TYPE], **kwargs) -> "HuffmanTables":
+        # fits the tables to the greedy encodings of samples with a frozen coder.
+        if not coder.frozen:
+            raise ValueError("static tables need a frozen coder")
+        return cls.from_tokens((coder.encode(sample) for sample in samples), coder.token_count, **kwargs)
+
+    def encode(self, tokens: Sequence[TOKEN_TYPE]) -> bytes:
+        global_codes = self.global_table.codes
+        context_codes = {context: table.codes for context, table in self.context_tables.items()}
+        escape, vocab_size = self.escape, self.vocab_size
+        out = bytearray()
+        acc, n_bits = 0, 0
+        codes = context_codes.get(EMPTY_TOKEN, global_codes)
+        for t in tokens:
+            if not -1 <= t < vocab_size:
+                raise ValueError("token out of range")
+            s = t + 1
+            code = codes.get(s)
+            if code is None:
+                code = global_codes[s]
+                acc = (acc << codes[escape][1]) | codes[escape][0]
+                n_bits += codes[escape][1]
+            acc = (acc << code[1]) | code[0]
+            n_bits += code[1]
+            if n_bits >= 32:
+                n_bits -= 32
+                out += (acc >> n_bits).to_bytes(4, 'big')
+                acc &= (1 << n_bits) - 1
+            codes = context_codes.get(t, global_codes)
+        # the last bits, padded to a byte with zeros.
+        n_bytes = (n_bits + 7) // 8
+        out += (acc << (8 * n_bytes - n_bits)).to_bytes(n_bytes, 'big')
+        return bytes(out)
+
+    def decode(self, data, count: int, offset: int=0) -> Tuple[List[TOKEN_TYPE], int]:
+        '''
+        decodes count tokens from data at offset. Returns them and the offset
+        right after the stream.
+        '''
+        def decoder(table):
+            return table.lookup, table.max_length, (1 << table.max_length) - 1
+
+        global_lookup, global_length, global_mask = decoder(self.global_table)
+        # by symbol (token + 1), the decoder of the context it starts.
+        decoders = {context + 1: decoder(table) for context, table in self.context_tables.items()}
+        default = global_lookup, global_length, global_mask
+        escape = self.escape
+        # read 4 bytes at a time, zeros past the end. An escaped token takes
+        # two codes, so refill whenever fewer than that many bits are left
+        # (at most 32, see above).
+        data = bytes(data[offset:]) + bytes(4)
+        end = len(data) - 4
+        refill = MAX_CODE_LENGTH + global_length
+        position = 0
+        acc, n_bits = 0, 0
+        out = []
+        lookup, max_length, mask = decoders.get(0, default)
+        for _ in range(count):
+            if n_bits < refill:
+                acc = (acc << 32) | int.from_bytes(data[position:position + 4], 'big')
+                position += 4
+                n_bits += 32
+            entry = lookup[(acc >> (n_bits - max_length)) & mask]
+            length = entry & 31
+            if length == 0:
+                raise ValueError("corrupt Huffman stream")
+            n_bits -= length
+            s = entry >> 5
+            if s == escape:
+                entry = global_lookup[(acc >> (n_bits - global_length)) & global_mask]
+                if entry & 31 == 0:
+                    raise ValueError("corrupt Huffman stream")
+                n_bits -= entry & 31
+                s = entry >> 5
+            acc &= (1 << n_bits) - 1
+            out.append(s - 1)
+            lookup, max_length, mask = decoders.get(s, default)
+        used = (8 * position - n_bits + 7) // 8
+        if used > end:
+            raise ValueError("corrupt Huffman stream")
+        return out, offset + used
+
+    def to_bytes(self) -> bytes:
+        out = bytearray(MAGIC)
+        out += write_varint(self.vocab_size)
+        out += self.global_table.to_bytes()
+        out += write_varint(len(self.context_tables))
+        for context in sorted(self.context_tables):
+            out += write_varint(context + 1)
+            out += self.context_tables[context].to_bytes()
+        return bytes(out)
+
+    @classmethod
+    def from_bytes(cls, data) -> "HuffmanTables":
+        if bytes(data[:len(MAGIC)]) != MAGIC:
+            raise ValueError("not Huffman tables")
+        vocab_size, offset = read_varint(data, len(MAGIC))
+        global_table, offset = HuffmanTable.from_bytes(data, offset)
+        n, offset = read_varint(data, offset)
+        context_tables = {}
+        for _ in range(n):
+            context, offset = read_varint(data, offset)
+            context_tables[context - 1], offset = HuffmanTable.from_bytes(data, offset)
+        return cls(vocab_size, global_table, context_tables)
+
+    @classmethod
+    def open(cls, path: Union[str, os.PathLike], coder: Optional[Coder]=None) -> "HuffmanTables":
+        # with coder, checks that the tables were fitted to a dictionary of its size.
+        with open(path, 'rb') as f:
+            tables = cls.from_bytes(f.read())
+        if coder is not None and coder.token_count != tables.vocab_size:
+            raise ValueError("the tables do not match the coder's vocab")
+        return tables
+
+
+def dump_tables(tables: HuffmanTables, path: Union[str, os.PathLike]) -> None:
+    with open(path, 'wb') as f:
+        f.write(tables.to_bytes())
+
+
+__all__ = ["HuffmanTable", "HuffmanTables", "code_lengths", "global_code_length", "dump_tables", "MAX_CODE_LENGTH", "MAX_GLOBAL_CODE_LENGTH"]
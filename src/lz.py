@@ -1,6 +1,13 @@
-from typing import Any, Optional, Dict, Set, Tuple, Union, List
+from typing import Any, Optional, Dict, Set, Tuple, Union, List, Sequence
+from array import array
+import mmap
+import heapq
+import copy
+import os
 import pygtrie
 
+from .overlay import OverlayDict, OverlaySet, OverlayLog, OverlayTrie, ForkedCoders
+
 
 # we will replace input symbols not seen in the "learning" phase with 0
 # in the encoding and decoding phase.
@@ -11,8 +18,22 @@ EMPTY_TOKEN = -1
 
 TOKEN_TYPE = int
 
+# every entry ever added to a dictionary, in creation order, as (context, token).
+# Entries are never removed, so this only grows: anything that wants to know
+# what changed since some point (checkpoints, snapshots) can remember its length.
+ENTRY_LOG_TYPE = List[Tuple[TOKEN_TYPE, TOKEN_TYPE]]
+
+
+INPUT_SYMBOL_SEQUENCE_TYPE = Union[str, bytes, bytearray, memoryview, mmap.mmap, os.PathLike, List[TOKEN_TYPE]]
+
+BUFFER_TYPES = (bytes, bytearray, memoryview, mmap.mmap)
 
-INPUT_SYMBOL_SEQUENCE_TYPE = Union[str, bytes, List[TOKEN_TYPE]]
+
+# how strings are turned into input symbols: either their UTF-8 bytes, or one
+# symbol per unicode code point (so CJK or emoji text costs one symbol per
+# character rather than 3-4).
+BYTE_INPUT = "bytes"
+CODEPOINT_INPUT = "codepoints"
 
 
 def get_set_element(s: Set):
@@ -21,25 +42,146 @@ def get_set_element(s: Set):
         return x
     raise ValueError("set is empty")
 
-def ensure_list(to_encode: INPUT_SYMBOL_SEQUENCE_TYPE) -> List[TOKEN_TYPE]:
+def _check_codepoint_input(to_encode: INPUT_SYMBOL_SEQUENCE_TYPE, input_mode: str) -> None:
+    # code points only come from str. Bytes, mmaps and files would have to be
+    # decoded first, and that means holding the whole text (as str, or as an
+    # array of code points) in memory, which is not what anyone passing a file
+    # or a mapping wants: decode it yourself and pass the str (or a list of
+    # code points) instead. Larger-than-RAM input is byte mode only.
+    if input_mode == CODEPOINT_INPUT and isinstance(to_encode, BUFFER_TYPES + (os.PathLike,)):
+        if not (isinstance(to_encode, memoryview) and to_encode.format != 'B'):
+            raise ValueError("code point input must be a str or a list of code points, not bytes or a file")
+
+def ensure_list(to_encode: INPUT_SYMBOL_SEQUENCE_TYPE, input_mode: str=BYTE_INPUT) -> List[TOKEN_TYPE]:
+    _check_codepoint_input(to_encode, input_mode)
     if isinstance(to_encode, str):
+        if input_mode == CODEPOINT_INPUT:
+            return list(map(ord, to_encode))
         return list(to_encode.encode('utf-8'))
-    elif isinstance(to_encode, bytes):
-        return list(to_encode)
+    elif isinstance(to_encode, BUFFER_TYPES):
+        return list(memoryview(to_encode).cast('B'))
+    elif isinstance(to_encode, os.PathLike):
+        return list(ensure_buffer(to_encode, input_mode))
     elif isinstance(to_encode, list):
         return to_encode
     else:
         raise ValueError("Invalid input type")
 
-def get_input_vocab(to_encode: INPUT_SYMBOL_SEQUENCE_TYPE) -> Set[TOKEN_TYPE]:
+def map_file(path: os.PathLike) -> memoryview:
+    # read-only mapping of the whole file. The page cache is shared with every
+    # other process mapping the same file, and nothing is read until it is used.
+    with open(path, 'rb') as f:
+        if os.fstat(f.fileno()).st_size == 0:
+            return memoryview(b'')
+        return memoryview(mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ))
+
+def ensure_buffer(to_encode: INPUT_SYMBOL_SEQUENCE_TYPE, input_mode: str=BYTE_INPUT) -> Sequence[TOKEN_TYPE]:
+    '''
+    like ensure_list, but returns a memoryview whenever possible so that slicing
+    off the symbols consumed by a token does not copy the rest of the input.
+    bytes-like objects, mmaps and paths (os.PathLike, not str!) are scanned in
+    place through the buffer protocol (byte input mode only, see
+    _check_codepoint_input).
+    '''
+    _check_codepoint_input(to_encode, input_mode)
+    if isinstance(to_encode, os.PathLike):
+        return map_file(to_encode)
+    if isinstance(to_encode, memoryview) and to_encode.format != 'B':
+        # already symbols (e.g. the int64 view _to_symbols returns): reading
+        # them as bytes would split every symbol up.
+        return to_encode
+    if isinstance(to_encode, BUFFER_TYPES):
+        return memoryview(to_encode).cast('B')
+    to_encode = ensure_list(to_encode, input_mode)
+    try:
+        return memoryview(array('q', to_encode))
+    except OverflowError:
+        return to_encode
+
+def get_input_vocab(to_encode: INPUT_SYMBOL_SEQUENCE_TYPE, input_mode: str=BYTE_INPUT) -> Set[TOKEN_TYPE]:
+    _check_codepoint_input(to_encode, input_mode)
     if isinstance(to_encode, str):
+        if input_mode == CODEPOINT_INPUT:
+            return set(map(ord, to_encode))
         return set(to_encode.encode('utf-8'))
-    elif isinstance(to_encode, bytes):
-        return set(to_encode)
+    elif isinstance(to_encode, BUFFER_TYPES) or isinstance(to_encode, os.PathLike):
+        return set(ensure_buffer(to_encode, input_mode))
     else:
         raise ValueError("Invalid input type")
 
+class Alphabet:
+    '''
+    dense remap of the observed input symbols: the i-th distinct symbol we see
+    gets id i. Code points are sparse (up to 0x10FFFF), so this keeps the symbols
+    the coders work with small and contiguous whatever the script of the text.
+    The trie children are hashed (pygtrie keeps a dict per node), so a large
+    alphabet does not cost anything per node beyond the children actually used.
+    '''
+    ids: Dict[int, int]
+    symbols: List[int]
+
+    def __init__(self, symbols: Optional[Set[int]]=None):
+        self.ids = {}
+        self.symbols = []
+        for c in sorted(symbols) if symbols is not None else []:
+            self.add(c)
+
+    def __len__(self):
+        return len(self.symbols)
+
+    def add(self, symbol: int) -> int:
+        if symbol not in self.ids:
+            self.ids[symbol] = len(self.symbols)
+            self.symbols.append(symbol)
+        return self.ids[symbol]
+
+    def to_ids(self, to_encode: List[int], learn: bool=False) -> List[int]:
+        ids = self.ids
+        try:
+            return [ids[c] for c in to_encode]
+        except KeyError:
+            if not learn:
+                raise ValueError("unknown input symbol: did you mean to enable learning?")
+        return [self.add(c) for c in to_encode]
+
+    def from_ids(self, to_decode: List[int]) -> List[int]:
+        symbols = self.symbols
+        return [symbols[i] for i in to_decode]
+
+
 class Coder:
+    input_mode: str = BYTE_INPUT
+    alphabet: Optional[Alphabet] = None
+    # whether each token is the context for encoding the next one.
+    hierarchical: bool = False
+    # frozen coders refuse to learn, so encode and decode never write anything
+    # and a coder can be shared between threads, even without the GIL.
+    frozen: bool = False
+
+    def freeze(self) -> None:
+        self.frozen = True
+
+    @property
+    def token_count(self) -> int:
+        # number of tokens other than EMPTY_TOKEN, e.g. for entropy coding them.
+        return self.vocab_size
+
+    def _check_learn(self, learn: bool) -> None:
+        if learn and self.frozen:
+            raise ValueError("coder is frozen: learning is disabled")
+
+    def _to_symbols(self, to_encode: INPUT_SYMBOL_SEQUENCE_TYPE, learn: bool=False) -> Sequence[TOKEN_TYPE]:
+        self._check_learn(learn)
+        to_encode = ensure_buffer(to_encode, self.input_mode)
+        if self.alphabet is not None:
+            to_encode = ensure_buffer(self.alphabet.to_ids(to_encode, learn))
+        return to_encode
+
+    def _from_symbols(self, decoded: List[TOKEN_TYPE]) -> List[TOKEN_TYPE]:
+        if self.alphabet is not None:
+            return self.alphabet.from_ids(decoded)
+        return decoded
+
     def update_vocab(self, to_encode: INPUT_SYMBOL_SEQUENCE_TYPE) -> None:
         raise NotImplementedError("update_vocab not implemented")
 
@@ -60,9 +202,27 @@ class LZCoder(Coder):
     input_vocab: Set[int]
     vocab_size: int
     unused_tokens: Set[TOKEN_TYPE]
+    context: TOKEN_TYPE
+    entry_log: ENTRY_LOG_TYPE
+    entry_seq: Dict[TOKEN_TYPE, int]
+    created_seq: int
+
+
+    def __init__(self, output_vocab_size: Optional[int]=None, input_vocab: Optional[Set[TOKEN_TYPE]]=None, input_mode: str=BYTE_INPUT,
+                 context: TOKEN_TYPE=EMPTY_TOKEN, entry_log: Optional[ENTRY_LOG_TYPE]=None):
+        # a HierachicalLZCoder shares one entry log between all of its coders.
+        self.context = context
+        self.entry_log = entry_log if entry_log is not None else []
+        # position of each of our entries in the entry log, see DictionarySnapshot.
+        self.entry_seq = {EMPTY_TOKEN: -1}
+        self.created_seq = len(self.entry_log)
+
+        self.input_mode = input_mode
+        if input_mode == CODEPOINT_INPUT:
+            # from here on the coder only sees dense ids, see Alphabet.
+            self.alphabet = Alphabet(input_vocab)
+            input_vocab = set(range(len(self.alphabet)))
 
-
-    def __init__(self, output_vocab_size: Optional[int]=None, input_vocab: Optional[Set[TOKEN_TYPE]]=None):
         self.input_vocab = set(input_vocab) if input_vocab is not None else set([])
         self.unused_tokens = set(range(output_vocab_size))
 
@@ -76,15 +236,69 @@ class LZCoder(Coder):
 
         self.vocab_size = output_vocab_size + 1 # plus one because the empty token is -1
 
+    @property
+    def token_count(self) -> int:
+        return self.vocab_size - 1
+
+    @classmethod
+    def from_pretrained(cls, pretrained: "LZCoder", output_vocab_size: Optional[int]=None, input_vocab: Optional[Set[int]]=None,
+                        evict_fraction: float=0.0, sample: Optional[INPUT_SYMBOL_SEQUENCE_TYPE]=None) -> "LZCoder":
+        '''
+        warm start: a new coder with the dictionary of pretrained, which keeps
+        learning in whatever capacity is left. Entries whose token does not fit
+        output_vocab_size are dropped (with everything that extends them).
+        evict_fraction of the entries can be freed up front for the new domain:
+        the ones used least when encoding sample (a bit of the new domain), see
+        token_usage. input_vocab adds input symbols pretrained has never seen.
+        '''
+        if output_vocab_size is None:
+            output_vocab_size = pretrained.vocab_size - 1
+        coder = cls(output_vocab_size, input_vocab=set(), input_mode=pretrained.input_mode)
+        if pretrained.alphabet is not None:
+            for c in pretrained.alphabet.symbols:
+                coder.alphabet.add(c)
+        usage = token_usage(pretrained, sample).get(EMPTY_TOKEN, {}) if sample is not None else {}
+        coder._warm_start(pretrained, evict_fraction, usage, pretrained.input_vocab)
+        if input_vocab:
+            coder.update_vocab(sorted(input_vocab))
+        return coder
+
+    def _warm_start(self, pretrained: "LZCoder", evict_fraction: float, usage: Dict[TOKEN_TYPE, int], protected: Set[int]) -> None:
+        # entries are copied in creation order, so the token allocator ends up
+        # just as if we had learned them ourselves. An entry whose token does not
+        # fit is dropped along with everything that extends it. Dictionaries
+        # need not be prefix-closed (build_dictionary's are not), so "extends"
+        # means the nearest shorter entry, see _entry_parents.
+        size = self.vocab_size - 1
+        parents = _entry_parents(prefix for token, prefix in pretrained.encoded_vocab.items() if token != EMPTY_TOKEN)
+        kept = {()}
+        for prefix in sorted(parents, key=len):
+            if pretrained.token_map[prefix] < size and parents[prefix] in kept:
+                kept.add(prefix)
+        entries = [(token, prefix) for token, prefix in pretrained.encoded_vocab.items() if token != EMPTY_TOKEN and prefix in kept]
+
+        evict = int(len(entries) * evict_fraction)
+        if evict > 0:
+            entries = _evict_cold(entries, evict, usage, protected)
+        for token, prefix in entries:
+            self._add_new_token(prefix, token)
+        self.input_vocab = set(c for c in protected if (c,) in self.token_map)
+
     def encode_one_token(self, to_encode: List[TOKEN_TYPE], learn: bool = False) -> Tuple[Tuple[TOKEN_TYPE], TOKEN_TYPE]:
 
         prefix, token = self._propose_next_token(to_encode, learn)
-        if token not in self.encoded_vocab:
+        if learn and token not in self.encoded_vocab:
             self._add_new_token(prefix, token)
 
         return prefix, token
 
     def _propose_next_token(self, to_encode: List[TOKEN_TYPE], learn: bool = False) -> Tuple[TOKEN_TYPE]:
+        self._check_learn(learn)
+        return self._propose(to_encode, learn)
+
+    def _propose(self, to_encode: List[TOKEN_TYPE], learn: bool) -> Tuple[TOKEN_TYPE]:
+        # what we would add or use next, without checking that we may learn: the
+        # HierachicalLZCoder asks frozen base coders of a fork, which never add it.
         prefix, token = self.token_map.longest_prefix(to_encode)
         if learn and len(prefix) < len(to_encode):
             if self.vocab_size is None or len(self.token_map) < self.vocab_size:
@@ -97,10 +311,16 @@ class LZCoder(Coder):
         self.encoded_vocab[token] = prefix
         self.token_map[prefix] = token
         self.unused_tokens.remove(token)
+        self.entry_seq[token] = len(self.entry_log)
+        self.entry_log.append((self.context, token))
         assert len(self.token_map) == len(self.encoded_vocab)
     
     def update_vocab(self, to_encode: bytes):
-        for c in to_encode:
+        self._update_input_vocab(self._to_symbols(to_encode, learn=True))
+
+    def _update_input_vocab(self, symbols: Sequence[TOKEN_TYPE]) -> None:
+        # symbols as _to_symbols returns them.
+        for c in symbols:
             if c not in self.input_vocab:
                 new_token = get_set_element(self.unused_tokens)
                 self._add_new_token((c,), new_token)
@@ -110,7 +330,7 @@ class LZCoder(Coder):
 
     def encode(self, to_encode: str, learn: bool=False):
 
-        to_encode = ensure_list(to_encode)
+        to_encode = self._to_symbols(to_encode, learn)
             
         encoded = []
 
@@ -129,34 +349,252 @@ class LZCoder(Coder):
     def decode_one_token(self, to_decode: TOKEN_TYPE):
         return self.encoded_vocab[to_decode]
 
+    def snapshot(self) -> "DictionarySnapshot":
+        return DictionarySnapshot(self)
+
+    def fork(self, entry_log: Optional[ENTRY_LOG_TYPE]=None) -> "LZCoder":
+        '''
+        a coder that starts out with this (frozen) coder's dictionary and learns
+        on its own, in O(1): every container is an overlay that reads through to
+        ours and keeps only the new entries, see overlay.py. The fork can be
+        frozen and forked in turn.
+        '''
+        if not self.frozen:
+            raise ValueError("only frozen coders can be forked: the base must not change under its forks")
+        coder = LZCoder.__new__(LZCoder)
+        coder.context = self.context
+        coder.entry_log = entry_log if entry_log is not None else OverlayLog(self.entry_log)
+        coder.entry_seq = OverlayDict(self.entry_seq)
+        coder.created_seq = self.created_seq
+        coder.input_mode = self.input_mode
+        # bounded by the input symbols rather than the dictionary, so just copied.
+        coder.alphabet = copy.deepcopy(self.alphabet)
+        coder.input_vocab = set(self.input_vocab)
+        coder.unused_tokens = OverlaySet(self.unused_tokens, self._unused_order())
+        coder.token_map = OverlayTrie(self.token_map, pygtrie.Trie())
+        coder.encoded_vocab = OverlayDict(self.encoded_vocab)
+        coder.vocab_size = self.vocab_size
+        return coder
+
+    def _unused_order(self) -> Optional[array]:
+        # our unused tokens in allocation order, made once and shared by all our
+        # forks. Tokens are only ever taken, so the count tells if it is stale.
+        if isinstance(self.unused_tokens, OverlaySet):
+            return None
+        order = getattr(self, "_unused_order_cache", None)
+        if order is None or len(order) != len(self.unused_tokens):
+            order = self._unused_order_cache = array('i', self.unused_tokens)
+        return order
+
+    def _visible(self, token: TOKEN_TYPE, watermark: int) -> bool:
+        return self.entry_seq.get(token, watermark) < watermark
+
+    def _snapshot_match(self, to_encode: List[TOKEN_TYPE], watermark: int) -> Tuple[Tuple[TOKEN_TYPE], TOKEN_TYPE]:
+        # longest prefix of to_encode among the entries older than watermark.
+        # Nothing here writes, so this is safe while another thread learns: we
+        # may see entries newer than the watermark, and just skip them.
+        prefix, token = self.token_map.longest_prefix(to_encode)
+        while not self._visible(token, watermark):
+            prefix = prefix[:-1]
+            token = self.token_map.get(prefix)
+        return prefix, token
+
 
     def decode(self, to_decode: bytes):
         decoded = []
         for t in to_decode:
             decoded += list(self.encoded_vocab[t])
         
+        return self._from_symbols(decoded)
+
+
+
+class DecodeTable:
+    '''
+    every (context, token) -> expansion of a coder, compiled for decoding into
+    one table of rows indexed by context + 1, each indexed by token + 1 (so
+    EMPTY_TOKEN is slot 0): decoding a token is two subscripts instead of two
+    dict lookups, a method call and a tuple-to-list copy. A context with at
+    least density * (vocab_size + 1) entries gets a dense row (a list), the
+    others a dict, so a large vocab with mostly small contexts does not cost
+    (vocab_size + 1)^2 slots. The expansions are the coder's own prefix tuples,
+    not copies. Only valid as long as the coder does not learn.
+    '''
+    vocab_size: int
+    hierarchical: bool
+    rows: List[Union[None, List[Optional[Tuple[TOKEN_TYPE]]], Dict[int, Tuple[TOKEN_TYPE]]]]
+
+    def __init__(self, coder: Union["LZCoder", "HierachicalLZCoder"], density: float=1 / 16):
+        self.hierarchical = coder.hierarchical
+        coders = context_coders(coder)
+        self.vocab_size = coder.vocab_size if coder.hierarchical else coder.vocab_size - 1
+        width = self.vocab_size + 1
+
+        self.rows = [None] * width
+        for context, lz in coders.items():
+            if len(lz.encoded_vocab) >= density * width:
+                row = [None] * width
+                for token, prefix in lz.encoded_vocab.items():
+                    row[token + 1] = prefix
+            else:
+                row = {token + 1: prefix for token, prefix in lz.encoded_vocab.items()}
+            self.rows[context + 1] = row
+
+    @property
+    def dense_rows(self) -> int:
+        return sum(isinstance(row, list) for row in self.rows)
+
+    def decode(self, to_decode: List[TOKEN_TYPE]) -> List[TOKEN_TYPE]:
+        # below -1 a token would index the rows from the end.
+        if len(to_decode) > 0 and min(to_decode) < EMPTY_TOKEN:
+            raise KeyError(min(to_decode))
+        rows = self.rows
+        row = rows[0]
+        decoded = []
+        t = EMPTY_TOKEN
+        try:
+            if self.hierarchical:
+                for t in to_decode:
+                    decoded += row[t + 1]
+                    row = rows[t + 1]
+            else:
+                for t in to_decode:
+                    decoded += row[t + 1]
+        except (TypeError, KeyError, IndexError):
+            # a missing slot (None), token or context.
+            raise KeyError(t)
         return decoded
 
 
+class DictionarySnapshot(Coder):
+    '''
+    read-only view of a coder as it was when the snapshot was taken.
+
+    Dictionaries only ever append entries, and every entry knows its position in
+    the entry log, so a snapshot is just the length of the log: entries at or
+    past the watermark are ignored. Readers never take a lock and never write,
+    so the learner can keep calling encode(learn=True) on the same coder from
+    another thread without blocking (or being blocked by) the readers.
+    '''
+    watermark: int
+
+    def __init__(self, coder: Union["LZCoder", "HierachicalLZCoder"]):
+        self.coder = coder
+        self.watermark = len(coder.entry_log)
+        self.input_mode = coder.input_mode
+        self.alphabet = coder.alphabet
+        self.hierarchical = coder.hierarchical
+
+    def _context_coder(self, context: TOKEN_TYPE) -> LZCoder:
+        if not self.hierarchical:
+            return self.coder
+        coder = self.coder.coders.get(context)
+        # a context coder gets its first entry as soon as it is created.
+        if coder is None or (context != EMPTY_TOKEN and coder.created_seq >= self.watermark):
+            raise ValueError("context not in coders")
+        return coder
+
+    def encode(self, to_encode: INPUT_SYMBOL_SEQUENCE_TYPE, learn: bool=False) -> List[TOKEN_TYPE]:
+        if learn:
+            raise ValueError("snapshots are read-only: learn on the coder instead")
+        to_encode = self._to_symbols(to_encode)
+        context = EMPTY_TOKEN
+        encoded = []
+        while len(to_encode) > 0:
+            prefix, token = self._context_coder(context)._snapshot_match(to_encode, self.watermark)
+            if len(prefix) == 0 and context == EMPTY_TOKEN:
+                raise ValueError("could not match any tokens: did you mean to enable learning?")
+            encoded.append(token)
+            if self.hierarchical:
+                context = token
+            to_encode = to_encode[len(prefix):]
+        return encoded
+
+    def decode(self, to_decode: List[TOKEN_TYPE]) -> List[TOKEN_TYPE]:
+        context = EMPTY_TOKEN
+        decoded = []
+        for t in to_decode:
+            coder = self._context_coder(context)
+            if not coder._visible(t, self.watermark):
+                raise KeyError(t)
+            decoded += list(coder.decode_one_token(t))
+            if self.hierarchical:
+                context = t
+        return self._from_symbols(decoded)
+
 
 class HierachicalLZCoder(Coder):
+    hierarchical = True
     vocab_size: int
     coders: Dict[TOKEN_TYPE, LZCoder]
+    entry_log: ENTRY_LOG_TYPE
+    _decode_table: Optional["DecodeTable"] = None
 
-    def __init__(self, output_vocab_size: Optional[int]=None, input_vocab: Optional[Set[int]]=None):
+    def __init__(self, output_vocab_size: Optional[int]=None, input_vocab: Optional[Set[int]]=None, input_mode: str=BYTE_INPUT):
+        self.input_mode = input_mode
+        if input_mode == CODEPOINT_INPUT:
+            # the per-context coders all work on the dense ids of this alphabet.
+            self.alphabet = Alphabet(input_vocab)
+            input_vocab = set(range(len(self.alphabet))) if input_vocab is not None else None
 
         if input_vocab is not None:
             assert len(input_vocab) <= output_vocab_size, "output vocab size is smaller than input vocab size!"
 
         self.vocab_size = output_vocab_size
+        self.entry_log = []
         self.coders = {
-            EMPTY_TOKEN: LZCoder(output_vocab_size, input_vocab=input_vocab)
+            EMPTY_TOKEN: LZCoder(output_vocab_size, input_vocab=input_vocab, entry_log=self.entry_log)
         }
 
+    @classmethod
+    def from_pretrained(cls, pretrained: "HierachicalLZCoder", output_vocab_size: Optional[int]=None, input_vocab: Optional[Set[int]]=None,
+                        evict_fraction: float=0.0, sample: Optional[INPUT_SYMBOL_SEQUENCE_TYPE]=None) -> "HierachicalLZCoder":
+        '''
+        warm start, see LZCoder.from_pretrained. Every context is copied (and
+        evicted from) separately; contexts whose token does not fit
+        output_vocab_size can never come up again, so they are left out.
+        '''
+        if output_vocab_size is None:
+            output_vocab_size = pretrained.vocab_size
+        coder = cls(output_vocab_size, input_vocab=set(), input_mode=pretrained.input_mode)
+        if pretrained.alphabet is not None:
+            for c in pretrained.alphabet.symbols:
+                coder.alphabet.add(c)
+        usage = token_usage(pretrained, sample) if sample is not None else {}
+        for context, lz in pretrained.coders.items():
+            if context >= output_vocab_size:
+                continue
+            target = coder.coders[EMPTY_TOKEN] if context == EMPTY_TOKEN else coder._new_coder(context)
+            protected = lz.input_vocab if context == EMPTY_TOKEN else set()
+            target._warm_start(lz, evict_fraction, usage.get(context, {}), protected)
+        if input_vocab:
+            coder.update_vocab(sorted(input_vocab))
+        return coder
+
+    def _new_coder(self, context: TOKEN_TYPE) -> LZCoder:
+        self.coders[context] = LZCoder(self.vocab_size, input_vocab=set([]), context=context, entry_log=self.entry_log)
+        return self.coders[context]
+
+    def _writable_coder(self, context: TOKEN_TYPE) -> LZCoder:
+        # a fork shares each context with its base until it adds to it.
+        if isinstance(self.coders, ForkedCoders):
+            return self.coders.writable(context)
+        return self.coders[context]
+
     def update_vocab(self, to_encode: bytes):
-        self.coders[EMPTY_TOKEN].update_vocab(to_encode)
+        self._writable_coder(EMPTY_TOKEN)._update_input_vocab(self._to_symbols(to_encode, learn=True))
+
+    def freeze(self) -> None:
+        self.frozen = True
+        for coder in self.coders.values():
+            coder.freeze()
+        # the dictionaries can't change any more, so compile them once here:
+        # decode only reads the table, so it stays safe to share between threads.
+        if self._decode_table is None:
+            self._decode_table = DecodeTable(self)
 
     def encode_one_token(self, to_encode: INPUT_SYMBOL_SEQUENCE_TYPE, context: TOKEN_TYPE, learn: bool=False):
+        self._check_learn(learn)
         if context not in self.coders:
             if learn:
                 # make a new coder. We can let it learn its own input vocab.
@@ -170,11 +608,11 @@ class HierachicalLZCoder(Coder):
                 # even if the input vocab size is equal to the encoding vocab size.
                 # TODO: check if this is better than just initializing the new coder
                 # with the full input vocab.
-                self.coders[context] = LZCoder(self.vocab_size, input_vocab=set([]))
+                self._new_coder(context)
             else:
                 raise ValueError("context not in coders")
 
-        prefix, token = self.coders[context]._propose_next_token(to_encode, learn)
+        prefix, token = self.coders[context]._propose(to_encode, learn)
 
         if token in self.coders[context].encoded_vocab:
             return prefix, token
@@ -192,11 +630,11 @@ class HierachicalLZCoder(Coder):
         assert token not in self.coders[context].encoded_vocab, "token is already in the encoded vocab!"
         assert token in self.coders[context].unused_tokens, "token is not in the unused tokens!"
 
-        for other_context in self.coders:
+        for other_context, other in self.coders.items():
             if other_context == context:
                 continue
-            _, other_token = self.coders[other_context]._propose_next_token(to_encode, learn)
-            if other_token in self.coders[other_context].encoded_vocab:
+            _, other_token = other._propose(to_encode, learn)
+            if other_token in other.encoded_vocab:
                 symbol_counts[other_token] = symbol_counts.get(other_token, 0) + 1
         
         # now we find the untaken symbol with the highest count
@@ -207,18 +645,42 @@ class HierachicalLZCoder(Coder):
                 token = symbol
                 break
         
-        self.coders[context]._add_new_token(prefix, token)
+        self._writable_coder(context)._add_new_token(prefix, token)
 
         return prefix, token
     
+    def snapshot(self) -> DictionarySnapshot:
+        return DictionarySnapshot(self)
+
+    def fork(self) -> "HierachicalLZCoder":
+        '''
+        see LZCoder.fork. A context is only forked when the fork first adds an
+        entry to it, until then it reads the base coder directly.
+        '''
+        if not self.frozen:
+            raise ValueError("only frozen coders can be forked: the base must not change under its forks")
+        coder = HierachicalLZCoder.__new__(HierachicalLZCoder)
+        coder.input_mode = self.input_mode
+        coder.alphabet = copy.deepcopy(self.alphabet)
+        coder.vocab_size = self.vocab_size
+        coder.entry_log = OverlayLog(self.entry_log)
+        coder.coders = ForkedCoders(self.coders, lambda base: base.fork(coder.entry_log))
+        return coder
+
     def encode(self, to_encode: INPUT_SYMBOL_SEQUENCE_TYPE, learn: bool=False):
         context = EMPTY_TOKEN
         encoded = []
 
-        to_encode = ensure_list(to_encode)
+        to_encode = self._to_symbols(to_encode, learn)
 
         while len(to_encode) > 0:
             prefix, token = self.encode_one_token(to_encode, context, learn)
+            if len(prefix) == 0 and context == EMPTY_TOKEN:
+                # EMPTY_TOKEN only helps if the EMPTY_TOKEN context can do better.
+                if learn:
+                    raise ValueError("could not match any tokens: the output dictionary is full!")
+                else:
+                    raise ValueError("could not match any tokens: did you mean to enable learning?")
             encoded.append(token)
             context = token
             to_encode = to_encode[len(prefix):]
@@ -226,18 +688,109 @@ class HierachicalLZCoder(Coder):
         return encoded
     
     def decode(self, to_decode: bytes):
+        if self.frozen and self._decode_table is not None:
+            return self._from_symbols(self._decode_table.decode(to_decode))
         context = EMPTY_TOKEN
         decoded = []
         for t in to_decode:
             decoded += list(self.coders[context].decode_one_token(t))
             context = t
-        return decoded
-
-
-
-        
-
-
-
-
-__all__ = ["LZCoder", "HierachicalLZCoder"]
\ No newline at end of file
+        return self._from_symbols(decoded)
+
+
+
+
+def context_coders(coder: Coder) -> Dict[TOKEN_TYPE, LZCoder]:
+    '''
+    the dictionary of each context: the coders of a HierachicalLZCoder, or an
+    LZCoder as the only (EMPTY_TOKEN) context.
+    '''
+    if isinstance(coder, HierachicalLZCoder):
+        return coder.coders
+    if isinstance(coder, LZCoder):
+        return {EMPTY_TOKEN: coder}
+    raise ValueError("only LZCoder and HierachicalLZCoder have dictionaries")
+
+
+def token_usage(coder: Union[LZCoder, HierachicalLZCoder], sample: INPUT_SYMBOL_SEQUENCE_TYPE) -> Dict[TOKEN_TYPE, Dict[TOKEN_TYPE, int]]:
+    '''
+    how often each entry of each context is used to greedily encode sample,
+    including EMPTY_TOKEN where a context has to give up and hand over to the
+    EMPTY_TOKEN context. Symbols the coder has never seen, and contexts that
+    were never learned, don't raise, so any sample of a new domain will do: an
+    unseen symbol counts as one EMPTY_TOKEN of the EMPTY_TOKEN context (a
+    learning coder would spend a token on it too), and an unlearned context
+    falls back to the EMPTY_TOKEN context.
+    '''
+    symbols = ensure_buffer(sample, coder.input_mode)
+    if coder.alphabet is not None:
+        ids = coder.alphabet.ids
+        # -2 is never an id, so unknown symbols just don't match.
+        symbols = ensure_buffer([ids.get(c, -2) for c in symbols])
+    coders = context_coders(coder)
+
+    usage = {context: {} for context in coders}
+    context, position = EMPTY_TOKEN, 0
+    while position < len(symbols):
+        if context not in coders:
+            context = EMPTY_TOKEN
+        prefix, token = coders[context].token_map.longest_prefix(symbols[position:])
+        if len(prefix) == 0:
+            if context == EMPTY_TOKEN:
+                usage[context][EMPTY_TOKEN] = usage[context].get(EMPTY_TOKEN, 0) + 1
+                position += 1
+            else:
+                usage[context][EMPTY_TOKEN] = usage[context].get(EMPTY_TOKEN, 0) + 1
+            context = EMPTY_TOKEN
+            continue
+        counts = usage[context]
+        counts[token] = counts.get(token, 0) + 1
+        position += len(prefix)
+        if coder.hierarchical:
+            context = token
+    return usage
+
+
+def _entry_parents(prefixes) -> Dict[Tuple[TOKEN_TYPE], Tuple[TOKEN_TYPE]]:
+    # the longest proper prefix of each entry that is an entry too (() if none):
+    # just prefix[:-1] in a prefix-closed dictionary.
+    prefixes = set(prefixes)
+    parents = {}
+    for prefix in prefixes:
+        k = len(prefix) - 1
+        while k > 0 and prefix[:k] not in prefixes:
+            k -= 1
+        parents[prefix] = prefix[:k]
+    return parents
+
+
+def _evict_cold(entries: List[Tuple[TOKEN_TYPE, Tuple[TOKEN_TYPE]]], evict: int, usage: Dict[TOKEN_TYPE, int],
+                protected: Set[int]) -> List[Tuple[TOKEN_TYPE, Tuple[TOKEN_TYPE]]]:
+    # drops the evict least used entries, only ever taking leaves so that every
+    # remaining entry still has its parent (see _entry_parents). Dropping a leaf
+    # can turn its parent into a leaf, which then competes with the others.
+    # Ties go to the newest.
+    parents = _entry_parents(prefix for _, prefix in entries)
+    children: Dict[Tuple[TOKEN_TYPE], int] = {}
+    for _, prefix in entries:
+        children[parents[prefix]] = children.get(parents[prefix], 0) + 1
+    tokens = {prefix: token for token, prefix in entries}
+    order = {prefix: i for i, (_, prefix) in enumerate(entries)}
+
+    def evictable(prefix):
+        return children.get(prefix, 0) == 0 and not (len(prefix) == 1 and prefix[0] in protected)
+
+    heap = [(usage.get(token, 0), -order[prefix], prefix) for token, prefix in entries if evictable(prefix)]
+    heapq.heapify(heap)
+    evicted = set()
+    while heap and len(evicted) < evict:
+        _, _, prefix = heapq.heappop(heap)
+        evicted.add(prefix)
+        parent = parents[prefix]
+        children[parent] -= 1
+        if len(parent) > 0 and evictable(parent):
+            heapq.heappush(heap, (usage.get(tokens[parent], 0), -order[parent], parent))
+    return [(token, prefix) for token, prefix in entries if prefix not in evicted]
+
+
+__all__ = ["LZCoder", "HierachicalLZCoder", "DictionarySnapshot", "DecodeTable", "Alphabet", "context_coders", "token_usage", "BYTE_INPUT", "CODEPOINT_INPUT"]
\ No newline at end of file
@@ -0,0 +1,572 @@
+/*
+ * Native encode/decode for coders in the flat layout of flat.py.
+ *
+ * The functions only touch the buffers they are given, so the Python side
+ * calls them through ctypes.CDLL, which releases the GIL for the duration of
+ * the call: several threads can encode or decode at the same time.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EMPTY_TOKEN (-1)
+#define NO_TOKEN (-2)
+#define EMPTY_SLOT (-1)
+
+#define ERR_NO_MATCH (-1)
+#define ERR_NO_CONTEXT (-2)
+#define ERR_OUTPUT_FULL (-3)
+#define ERR_UNKNOWN_TOKEN (-4)
+#define ERR_CORRUPT (-5)
+#define ERR_WRONG_DICTIONARY (-6)
+#define ERR_NO_MEMORY (-7)
+#define ERR_TOO_LONG (-8)
+
+typedef struct {
+    const int32_t *context_of;
+    const int32_t *context_start;
+    const int32_t *root;
+    const int32_t *node_token;
+    const int32_t *node_offset;
+    const int32_t *node_length;
+    const int32_t *edge_node;
+    const int32_t *edge_symbol;
+    const int32_t *edge_child;
+    const int32_t *expansion;
+    int64_t vocab_size;
+    int64_t edge_mask;
+    int64_t hierarchical;
+} hlz_flat;
+
+/* must match edge_slot in flat.py */
+static inline int64_t edge_slot(int64_t node, int64_t symbol, int64_t mask) {
+    return (int64_t)(((uint64_t)(node * 0x9E3779B1LL)) ^ ((uint64_t)(symbol * 0x85EBCA77LL))) & mask;
+}
+
+static inline int32_t child(const hlz_flat *f, int32_t node, int64_t symbol) {
+    if (symbol < INT32_MIN || symbol > INT32_MAX)
+        return -1;
+    int64_t slot = edge_slot(node, symbol, f->edge_mask);
+    /* at most one lap, even if a table that was not checked has no empty slot */
+    for (int64_t probe = 0; probe <= f->edge_mask; probe++) {
+        int32_t n = f->edge_node[slot];
+        if (n == node && f->edge_symbol[slot] == symbol)
+            return f->edge_child[slot];
+        if (n == EMPTY_SLOT)
+            return -1;
+        slot = (slot + 1) & f->edge_mask;
+    }
+    return -1;
+}
+
+static inline int32_t context_index(const hlz_flat *f, int64_t context) {
+    if (context < -1 || context >= f->vocab_size)
+        return -1;
+    return f->context_of[context + 1];
+}
+
+static inline int64_t symbol_at(const void *input, int width, int64_t i) {
+    switch (width) {
+    case 1: return ((const uint8_t *)input)[i];
+    case 4: return ((const int32_t *)input)[i];
+    default: return ((const int64_t *)input)[i];
+    }
+}
+
+/*
+ * greedy longest-match encode of input symbols [start, n) of the given width
+ * (1, 4 or 8 bytes), starting in the given context and stopping at the first
+ * token boundary at or after limit. If starts is not NULL, it gets the
+ * position each token starts at, plus the position we stopped at after the
+ * last one (so it needs room for out_cap + 1). Returns the number of tokens
+ * written to out, or an ERR_ code.
+ */
+int64_t hlz_encode_range(const hlz_flat *f, const void *input, int64_t n, int width, int64_t start, int64_t context,
+                         int64_t limit, int32_t *out, int64_t *starts, int64_t out_cap) {
+    int64_t i = start, k = 0;
+    if (!f->hierarchical)
+        context = EMPTY_TOKEN;
+    if (limit > n)
+        limit = n;
+    while (i < limit) {
+        int32_t index = context_index(f, context);
+        if (index < 0)
+            return ERR_NO_CONTEXT;
+        int32_t node = f->root[index];
+        int32_t token = f->node_token[node];
+        int64_t length = 0;
+        for (int64_t j = i; j < n; j++) {
+            node = child(f, node, symbol_at(input, width, j));
+            if (node < 0)
+                break;
+            if (f->node_token[node] != NO_TOKEN) {
+                token = f->node_token[node];
+                length = j + 1 - i;
+            }
+        }
+        if (length == 0 && context == EMPTY_TOKEN)
+            return ERR_NO_MATCH;
+        if (k >= out_cap)
+            return ERR_OUTPUT_FULL;
+        if (starts)
+            starts[k] = i;
+        out[k++] = token;
+        if (f->hierarchical)
+            context = token;
+        i += length;
+    }
+    if (starts)
+        starts[k] = i;
+    return k;
+}
+
+/*
+ * greedy longest-match encode of n input symbols. Returns the number of
+ * tokens written to out, or an ERR_ code.
+ */
+int64_t hlz_encode(const hlz_flat *f, const void *input, int64_t n, int width, int32_t *out, int64_t out_cap) {
+    return hlz_encode_range(f, input, n, width, 0, EMPTY_TOKEN, n, out, NULL, out_cap);
+}
+
+static int32_t find_node(const hlz_flat *f, int64_t context, int32_t token) {
+    int32_t index = context_index(f, context);
+    /* NO_TOKEN nodes are prefixes, not entries */
+    if (index < 0 || token < EMPTY_TOKEN)
+        return -1;
+    int32_t lo = f->context_start[index], hi = f->context_start[index + 1];
+    while (lo < hi) {
+        int32_t mid = lo + (hi - lo) / 2;
+        if (f->node_token[mid] < token)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == f->context_start[index + 1] || f->node_token[lo] != token)
+        return -1;
+    return lo;
+}
+
+/*
+ * decodes n tokens into out, the first of them in the given context: the
+ * token before them for hierarchical coders, so that any range of a token
+ * stream can be decoded on its own. Returns the total number of symbols of
+ * the decoded output, even if that is more than out_cap (in which case only
+ * the first out_cap are written, and with out_cap 0 this just measures the
+ * output), or an ERR_ code.
+ */
+int64_t hlz_decode_range(const hlz_flat *f, const int32_t *tokens, int64_t n, int64_t context, int32_t *out, int64_t out_cap) {
+    int64_t k = 0;
+    if (!f->hierarchical)
+        context = EMPTY_TOKEN;
+    for (int64_t i = 0; i < n; i++) {
+        int32_t node = find_node(f, context, tokens[i]);
+        if (node < 0)
+            return ERR_UNKNOWN_TOKEN;
+        const int32_t *expansion = f->expansion + f->node_offset[node];
+        int32_t length = f->node_length[node];
+        if (k + length <= out_cap)
+            memcpy(out + k, expansion, (size_t)length * sizeof(int32_t));
+        else
+            for (int32_t j = 0; j < length && k + j < out_cap; j++)
+                out[k + j] = expansion[j];
+        k += length;
+        if (f->hierarchical)
+            context = tokens[i];
+    }
+    return k;
+}
+
+int64_t hlz_decode(const hlz_flat *f, const int32_t *tokens, int64_t n, int32_t *out, int64_t out_cap) {
+    return hlz_decode_range(f, tokens, n, EMPTY_TOKEN, out, out_cap);
+}
+
+/*
+ * Static rANS over token + 1 (so EMPTY_TOKEN is symbol 0), with a 32 bit
+ * state renormalized a byte at a time, as in entropy.py. The frequencies sum
+ * to 1 << precision, and slot_symbol maps each of those slots back to its
+ * symbol for decoding.
+ */
+#define RANS_L (1u << 23)
+
+typedef struct {
+    const uint32_t *freq;
+    const uint32_t *cum;
+    const int32_t *slot_symbol;
+    int64_t precision;
+    int64_t n_symbols;
+} rans_table;
+
+/*
+ * Symbol i is coded by lane i % lanes, each lane with its own state, and the
+ * renormalization bytes of all lanes share one stream, in the order the
+ * decoder reads them. The lanes have no data dependencies on each other, so
+ * the decoder can work on several symbols at once; one lane is plain rANS.
+ */
+#define MAX_RANS_LANES 32
+
+/*
+ * rANS encodes backwards, so this fills out from the end: the lane states
+ * come first, little endian, then the renormalization bytes. Returns how many
+ * bytes it wrote (they end at out + out_cap), or an ERR_ code.
+ */
+int64_t rans_encode(const rans_table *t, const int32_t *tokens, int64_t n, int lanes, uint8_t *out, int64_t out_cap) {
+    uint32_t x[MAX_RANS_LANES];
+    if (lanes < 1 || lanes > MAX_RANS_LANES)
+        return ERR_CORRUPT;
+    for (int j = 0; j < lanes; j++)
+        x[j] = RANS_L;
+    uint8_t *p = out + out_cap;
+    uint32_t bound = (RANS_L >> t->precision) << 8;
+    for (int64_t i = n - 1; i >= 0; i--) {
+        int64_t s = (int64_t)tokens[i] + 1;
+        if (s < 0 || s >= t->n_symbols)
+            return ERR_UNKNOWN_TOKEN;
+        uint32_t f = t->freq[s];
+        uint32_t x_max = bound * f;
+        uint32_t *lane = &x[i % lanes];
+        while (*lane >= x_max) {
+            if (p == out)
+                return ERR_OUTPUT_FULL;
+            *--p = (uint8_t)*lane;
+            *lane >>= 8;
+        }
+        *lane = ((*lane / f) << t->precision) + (*lane % f) + t->cum[s];
+    }
+    if (p - out < 4 * lanes)
+        return ERR_OUTPUT_FULL;
+    p -= 4 * lanes;
+    for (int j = 0; j < lanes; j++) {
+        p[4 * j] = (uint8_t)x[j];
+        p[4 * j + 1] = (uint8_t)(x[j] >> 8);
+        p[4 * j + 2] = (uint8_t)(x[j] >> 16);
+        p[4 * j + 3] = (uint8_t)(x[j] >> 24);
+    }
+    return (out + out_cap) - p;
+}
+
+/*
+ * decodes n tokens with a fixed number of lanes; inlined for each lane count
+ * below, so the inner loops over the lanes are unrolled. Every step brings a
+ * state back up from at least RANS_L >> precision, so it reads at most 2
+ * bytes, and the bounds are only checked when fewer than 2 bytes per lane
+ * are left.
+ */
+static inline int64_t rans_decode_lanes(const rans_table *t, const uint8_t *in, int64_t in_len, int32_t *tokens, int64_t n,
+                                        const int lanes) {
+    uint32_t x[MAX_RANS_LANES];
+    if (in_len < 4 * lanes)
+        return ERR_CORRUPT;
+    for (int j = 0; j < lanes; j++)
+        x[j] = (uint32_t)in[4 * j] | (uint32_t)in[4 * j + 1] << 8 | (uint32_t)in[4 * j + 2] << 16 | (uint32_t)in[4 * j + 3] << 24;
+    const uint8_t *p = in + 4 * lanes, *end = in + in_len;
+    const uint32_t *freq = t->freq, *cum = t->cum;
+    const int32_t *slot_symbol = t->slot_symbol;
+    uint32_t precision = (uint32_t)t->precision, mask = (1u << precision) - 1;
+    int64_t i = 0;
+    for (; i + lanes <= n && end - p >= 2 * lanes; i += lanes) {
+        for (int j = 0; j < lanes; j++) {
+            uint32_t slot = x[j] & mask;
+            int32_t s = slot_symbol[slot];
+            tokens[i + j] = s - 1;
+            x[j] = freq[s] * (x[j] >> precision) + slot - cum[s];
+        }
+        for (int j = 0; j < lanes; j++) {
+            if (x[j] < RANS_L) {
+                x[j] = (x[j] << 8) | *p++;
+                if (x[j] < RANS_L)
+                    x[j] = (x[j] << 8) | *p++;
+            }
+        }
+    }
+    for (; i < n; i++) {
+        uint32_t *lane = &x[i % lanes];
+        uint32_t slot = *lane & mask;
+        int32_t s = slot_symbol[slot];
+        tokens[i] = s - 1;
+        *lane = freq[s] * (*lane >> precision) + slot - cum[s];
+        while (*lane < RANS_L) {
+            if (p == end)
+                return ERR_CORRUPT;
+            *lane = (*lane << 8) | *p++;
+        }
+    }
+    for (int j = 0; j < lanes; j++)
+        if (x[j] != RANS_L)
+            return ERR_CORRUPT;
+    return p == end ? n : ERR_CORRUPT;
+}
+
+/*
+ * decodes n tokens from the in_len bytes at in, which must be exactly one
+ * rans_encode output with the same number of lanes: anything else is
+ * ERR_CORRUPT.
+ */
+int64_t rans_decode(const rans_table *t, const uint8_t *in, int64_t in_len, int32_t *tokens, int64_t n, int lanes) {
+    switch (lanes) {
+    case 1: return rans_decode_lanes(t, in, in_len, tokens, n, 1);
+    case 2: return rans_decode_lanes(t, in, in_len, tokens, n, 2);
+    case 4: return rans_decode_lanes(t, in, in_len, tokens, n, 4);
+    case 8: return rans_decode_lanes(t, in, in_len, tokens, n, 8);
+    default:
+        if (lanes < 1 || lanes > MAX_RANS_LANES)
+            return ERR_CORRUPT;
+        return rans_decode_lanes(t, in, in_len, tokens, n, lanes);
+    }
+}
+
+static int64_t put_varint(uint8_t *out, uint64_t v) {
+    int64_t k = 0;
+    while (v >= 0x80) {
+        out[k++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    out[k++] = (uint8_t)v;
+    return k;
+}
+
+static int64_t get_varint(const uint8_t *in, int64_t in_len, int64_t *k, uint64_t *v) {
+    *v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (*k >= in_len)
+            return ERR_CORRUPT;
+        uint8_t b = in[(*k)++];
+        *v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return 0;
+    }
+    return ERR_CORRUPT;
+}
+
+/*
+ * one message, see message.py: varint dictionary id, varint token count,
+ * then the rANS coded tokens (nothing at all for an empty message). out
+ * needs room for 4 bytes per input symbol plus 32 (up to 2 tokens per
+ * symbol, up to 2 bytes per token, the rANS state and the header).
+ * Returns the length of the message, or an ERR_ code.
+ */
+int64_t msg_encode(const hlz_flat *f, const rans_table *t, int64_t dictionary_id, const void *input, int64_t n, int width,
+                   uint8_t *out, int64_t out_cap) {
+    int32_t stack[256];
+    int64_t cap = 2 * n + 1;
+    int32_t *tokens = cap <= 256 ? stack : malloc((size_t)cap * sizeof(int32_t));
+    if (!tokens)
+        return ERR_NO_MEMORY;
+    int64_t count = hlz_encode(f, input, n, width, tokens, cap);
+    int64_t result = count;
+    if (count >= 0) {
+        int64_t header = put_varint(out, (uint64_t)dictionary_id);
+        header += put_varint(out + header, (uint64_t)count);
+        int64_t size = count > 0 ? rans_encode(t, tokens, count, 1, out + header, out_cap - header) : 0;
+        result = size;
+        if (size >= 0) {
+            memmove(out + header, out + out_cap - size, (size_t)size);
+            result = header + size;
+        }
+    }
+    if (tokens != stack)
+        free(tokens);
+    return result;
+}
+
+/*
+ * decodes one message made by msg_encode with the same dictionary id into
+ * out. Like hlz_decode, returns the whole decoded length even if only out_cap
+ * symbols fit, or an ERR_ code. The token count comes from the message, so a
+ * corrupt one could ask for any amount of memory: messages of more than
+ * max_tokens tokens are ERR_TOO_LONG. (The stream length does not bound the
+ * count: a very frequent symbol costs a tiny fraction of a bit.)
+ */
+int64_t msg_decode(const hlz_flat *f, const rans_table *t, int64_t dictionary_id, const uint8_t *in, int64_t in_len,
+                   int32_t *out, int64_t out_cap, int64_t max_tokens) {
+    int64_t k = 0;
+    uint64_t id, count;
+    if (get_varint(in, in_len, &k, &id) < 0 || get_varint(in, in_len, &k, &count) < 0)
+        return ERR_CORRUPT;
+    if (id != (uint64_t)dictionary_id)
+        return ERR_WRONG_DICTIONARY;
+    if (count == 0)
+        return k == in_len ? 0 : ERR_CORRUPT;
+    if (count > INT32_MAX)
+        return ERR_CORRUPT;
+    if (count > (uint64_t)max_tokens)
+        return ERR_TOO_LONG;
+    int32_t stack[256];
+    int32_t *tokens = count <= 256 ? stack : malloc((size_t)count * sizeof(int32_t));
+    if (!tokens)
+        return ERR_NO_MEMORY;
+    int64_t result = rans_decode(t, in + k, in_len - k, tokens, (int64_t)count, 1);
+    if (result >= 0)
+        result = hlz_decode(f, tokens, (int64_t)count, out, out_cap);
+    if (tokens != stack)
+        free(tokens);
+    return result;
+}
+
+/*
+ * Suffix arrays for suffix_array.py: SA-IS and Kasai's LCP, the same
+ * algorithms as the pure Python fallback there, on int32 arrays. s holds ids
+ * in [0, k) and ends with a 0 that occurs nowhere else.
+ */
+static void sais_induce(const int32_t *s, const uint8_t *t, int64_t n, int64_t k, const int64_t *bucket_starts,
+                        int64_t *ptr, int32_t *sa, const int32_t *lms, int64_t n_lms) {
+    for (int64_t i = 0; i < n; i++)
+        sa[i] = -1;
+    /* LMS suffixes go to the ends of their buckets, keeping their order. */
+    for (int64_t c = 0; c < k; c++)
+        ptr[c] = bucket_starts[c + 1];
+    for (int64_t i = n_lms - 1; i >= 0; i--)
+        sa[--ptr[s[lms[i]]]] = lms[i];
+    /* L suffixes from the front of their buckets, left to right... */
+    for (int64_t c = 0; c < k; c++)
+        ptr[c] = bucket_starts[c];
+    for (int64_t i = 0; i < n; i++) {
+        int32_t j = sa[i] - 1;
+        if (j >= 0 && !t[j])
+            sa[ptr[s[j]]++] = j;
+    }
+    /* ...then S suffixes from the back, right to left. */
+    for (int64_t c = 0; c < k; c++)
+        ptr[c] = bucket_starts[c + 1];
+    for (int64_t i = n - 1; i >= 0; i--) {
+        int32_t j = sa[i] - 1;
+        if (j >= 0 && t[j])
+            sa[--ptr[s[j]]] = j;
+    }
+}
+
+#define IS_LMS(t, i) ((i) > 0 && (t)[i] && !(t)[(i) - 1])
+
+static int sais_same_lms_substring(const int32_t *s, const uint8_t *t, int64_t n, int64_t a, int64_t b) {
+    if (a == n - 1 || b == n - 1)
+        return 0; /* the sentinel is unique. */
+    for (int64_t i = 0;; i++) {
+        int a_end = i > 0 && IS_LMS(t, a + i), b_end = i > 0 && IS_LMS(t, b + i);
+        if (a_end && b_end)
+            return 1;
+        if (a_end != b_end || s[a + i] != s[b + i] || t[a + i] != t[b + i])
+            return 0;
+    }
+}
+
+static int64_t sais(const int32_t *s, int64_t n, int64_t k, int32_t *sa) {
+    if (n == 1) {
+        sa[0] = 0;
+        return 0;
+    }
+    int64_t result = ERR_NO_MEMORY;
+    uint8_t *t = malloc((size_t)n);
+    int64_t *bucket_starts = malloc((size_t)(k + 1) * sizeof(int64_t));
+    int64_t *ptr = malloc((size_t)k * sizeof(int64_t));
+    int32_t *lms = NULL, *reduced = NULL, *reduced_sa = NULL;
+    int64_t n_lms = 0, m = 0, previous = -1;
+    int32_t name = -1;
+    if (!t || !bucket_starts || !ptr)
+        goto done;
+
+    t[n - 1] = 1;
+    for (int64_t i = n - 2; i >= 0; i--)
+        t[i] = s[i] < s[i + 1] || (s[i] == s[i + 1] && t[i + 1]);
+    memset(bucket_starts, 0, (size_t)(k + 1) * sizeof(int64_t));
+    for (int64_t i = 0; i < n; i++)
+        bucket_starts[s[i] + 1]++;
+    for (int64_t c = 0; c < k; c++)
+        bucket_starts[c + 1] += bucket_starts[c];
+
+    /* LMS positions are at least 2 apart, so there are at most n / 2 of them
+     * (the sentinel is always one). They are collected while counting them,
+     * so lms is written before anything reads it. */
+    lms = malloc((size_t)(n / 2 + 1) * sizeof(int32_t));
+    if (!lms)
+        goto done;
+    for (int64_t i = 1; i < n; i++)
+        if (IS_LMS(t, i))
+            lms[n_lms++] = (int32_t)i;
+    reduced = malloc((size_t)n_lms * sizeof(int32_t));
+    reduced_sa = malloc((size_t)n_lms * sizeof(int32_t));
+    if (!reduced || !reduced_sa)
+        goto done;
+
+    /* sort the LMS substrings and name them. The names go in the second half
+     * of sa, indexed by position / 2: LMS positions are at least 2 apart. */
+    sais_induce(s, t, n, k, bucket_starts, ptr, sa, lms, n_lms);
+    for (int64_t i = 0; i < n; i++)
+        if (IS_LMS(t, sa[i]))
+            sa[m++] = sa[i];
+    for (int64_t i = m; i < n; i++)
+        sa[i] = -1;
+    for (int64_t i = 0; i < m; i++) {
+        int64_t p = sa[i];
+        if (previous < 0 || !sais_same_lms_substring(s, t, n, previous, p))
+            name++;
+        sa[m + p / 2] = name;
+        previous = p;
+    }
+    for (int64_t i = 0; i < n_lms; i++)
+        reduced[i] = sa[m + lms[i] / 2];
+
+    if (name + 1 < n_lms) {
+        result = sais(reduced, n_lms, name + 1, reduced_sa);
+        if (result < 0)
+            goto done;
+    } else {
+        for (int64_t i = 0; i < n_lms; i++)
+            reduced_sa[reduced[i]] = (int32_t)i;
+    }
+    for (int64_t i = 0; i < n_lms; i++)
+        reduced[i] = lms[reduced_sa[i]];
+    sais_induce(s, t, n, k, bucket_starts, ptr, sa, reduced, n_lms);
+    result = 0;
+done:
+    free(t);
+    free(bucket_starts);
+    free(ptr);
+    free(lms);
+    free(reduced);
+    free(reduced_sa);
+    return result;
+}
+
+/*
+ * suffix array and LCP array (see suffix_array.py) of the n ids at ids, 1 or
+ * 4 bytes each, all in [1, k). sa and lcp need n entries each. Returns 0, or
+ * ERR_NO_MEMORY. n must be below 2^31 - 1.
+ */
+int64_t suffix_array_build(const void *ids, int64_t n, int width, int64_t k, int32_t *sa, int32_t *lcp) {
+    int32_t *s = malloc((size_t)(n + 1) * sizeof(int32_t));
+    int32_t *full = malloc((size_t)(n + 1) * sizeof(int32_t));
+    if (!s || !full) {
+        free(s);
+        free(full);
+        return ERR_NO_MEMORY;
+    }
+    for (int64_t i = 0; i < n; i++)
+        s[i] = width == 1 ? ((const uint8_t *)ids)[i] : ((const int32_t *)ids)[i];
+    s[n] = 0;
+    int64_t result = sais(s, n + 1, k, full);
+    if (result == 0) {
+        /* the sentinel suffix comes first; drop it. */
+        memcpy(sa, full + 1, (size_t)n * sizeof(int32_t));
+        /* Kasai: full is free again, so it holds the ranks. */
+        int32_t *rank = full;
+        for (int64_t i = 0; i < n; i++)
+            rank[sa[i]] = (int32_t)i;
+        int64_t h = 0;
+        for (int64_t p = 0; p < n; p++) {
+            int64_t r = rank[p];
+            if (r > 0) {
+                int64_t q = sa[r - 1];
+                while (p + h < n && q + h < n && s[p + h] == s[q + h])
+                    h++;
+                lcp[r] = (int32_t)h;
+                if (h > 0)
+                    h--;
+            } else {
+                lcp[0] = 0;
+                h = 0;
+            }
+        }
+    }
+    free(s);
+    free(full);
+    return result;
+}
@@ -0,0 +1,184 @@
+from typing import Dict, List, Tuple, Union
+from array import array
+
+from .lz import (Coder, LZCoder, HierachicalLZCoder, DecodeTable, context_coders, EMPTY_TOKEN, TOKEN_TYPE, INPUT_SYMBOL_SEQUENCE_TYPE)
+
+
+# A frozen coder compiled into one state machine over input symbols.
+#
+# While encoding, all the coder knows is the current context and how far down
+# that context's trie the current match is, so every (context, trie node) is a
+# state. Reading a symbol either moves to a child node, or fails: the match so
+# far is the longest one (online learned dictionaries are prefix-closed, so
+# every node is an entry), we emit its token, go to the root of the context
+# that token selects, and try the symbol again from there. At a root that
+# fails, the token is EMPTY_TOKEN, which sends us to the EMPTY_TOKEN context,
+# whose root knows every input symbol.
+#
+# That chain of emits only depends on the state and the symbol, so we resolve
+# it when compiling: the table holds, for each state and symbol column, either
+# the next state (>= 0, premultiplied by the number of columns so it can be
+# used as a row offset directly) or ~action, an index into a list of
+# (tokens to emit, next state). Encoding is then one table lookup per symbol.
+#
+# The table has a row of 4 byte entries per state and a column per distinct
+# input symbol, so a code point coder with a large alphabet gets big fast
+# (64k entries over 5000 symbols is over a GB): we work out its size first and
+# refuse anything over max_bytes.
+
+NO_MATCH = -1
+NO_CONTEXT = -2
+ERRORS = {
+    NO_MATCH: "could not match any tokens: did you mean to enable learning?",
+    NO_CONTEXT: "context not in coders",
+}
+
+
+class StateMachineCoder(Coder):
+    '''
+    a frozen LZCoder or HierachicalLZCoder compiled into a transition table,
+    see above. Encodes exactly like the coder's greedy encode, and decodes
+    through a DecodeTable. Raises if the table would take more than max_bytes.
+    '''
+    frozen = True
+    n_states: int
+    n_columns: int
+    table: array
+    actions: List[Tuple[Tuple[TOKEN_TYPE, ...], int]]
+    final_token: array
+
+    def __init__(self, coder: Union[LZCoder, HierachicalLZCoder], max_bytes: int=1 << 28):
+        if not coder.frozen:
+            raise ValueError("only frozen coders can be compiled: the table would not follow what they learn")
+        self.hierarchical = coder.hierarchical
+        self.input_mode = coder.input_mode
+        self.alphabet = coder.alphabet
+        self.vocab_size = coder.vocab_size
+        self._token_count = coder.token_count
+        self.decode_table = DecodeTable(coder)
+        coders = context_coders(coder)
+
+        symbols = sorted(set(c for lz in coders.values() for prefix in lz.encoded_vocab.values() for c in prefix))
+        self.column = {c: i for i, c in enumerate(symbols)}
+        # the last column is every symbol the coder has never seen, unless it knows every byte.
+        byte_symbols = all(0 <= c < 256 for c in symbols)
+        self.n_columns = width = len(symbols) + (0 if byte_symbols and len(symbols) == 256 else 1)
+        self._byte_columns = None
+        if byte_symbols:
+            self._byte_columns = bytes(self.column.get(c, width - 1) for c in range(256))
+        # a state per entry, plus the root, of every context.
+        table_bytes = 4 * width * sum(len(lz.encoded_vocab) for lz in coders.values())
+        if table_bytes > max_bytes:
+            raise ValueError(f"transition table would take {table_bytes} bytes, more than max_bytes={max_bytes}")
+
+        # states are numbered context by context, the root of each first.
+        state_of: Dict[Tuple[TOKEN_TYPE, Tuple[TOKEN_TYPE, ...]], int] = {}
+        tokens = []
+        root: Dict[TOKEN_TYPE, int] = {}
+        for context, lz in coders.items():
+            root[context] = len(tokens)
+            state_of[(context, ())] = len(tokens)
+            tokens.append(EMPTY_TOKEN)
+            for token, prefix in lz.encoded_vocab.items():
+                if token != EMPTY_TOKEN:
+                    state_of[(context, prefix)] = len(tokens)
+                    tokens.append(token)
+        self.n_states = len(tokens)
+
+        # children first...
+        unset = -(1 << 31)
+        table = array('i', [unset]) * (self.n_states * width)
+        for (context, prefix), state in state_of.items():
+            if len(prefix) == 0:
+                continue
+            parent = state_of.get((context, prefix[:-1]))
+            if parent is None:
+                raise ValueError("can only compile prefix-closed dictionaries")
+            table[parent * width + self.column[prefix[-1]]] = state * width
+
+        # ...then every failure, resolved to the tokens it emits and where it ends up.
+        actions: List[Tuple[Tuple[TOKEN_TYPE, ...], int]] = []
+        action_of: Dict[Tuple[Tuple[TOKEN_TYPE, ...], int], int] = {}
+        empty_root = root[EMPTY_TOKEN]
+        for state in range(self.n_states):
+            row = state * width
+            for x in range(width):
+                if table[row + x] != unset:
+                    continue
+                emits = []
+                current = state
+                while True:
+                    child = table[current * width + x]
+                    if child >= 0:
+                        target = child
+                        break
+                    if current == empty_root:
+                        target = NO_MATCH
+                        break
+                    emits.append(tokens[current])
+                    context = tokens[current] if self.hierarchical else EMPTY_TOKEN
+                    if context not in root:
+                        target = NO_CONTEXT
+                        break
+                    current = root[context]
+                key = (tuple(emits), target)
+                if key not in action_of:
+                    action_of[key] = len(actions)
+                    actions.append(key)
+                table[row + x] = ~action_of[key]
+
+        self.table = table
+        self.actions = actions
+        self.start = empty_root * width
+        # what a match that runs into the end of the input emits (nothing at a root).
+        self.final_token = array('i', tokens)
+        for state in root.values():
+            self.final_token[state] = NO_MATCH
+
+    @property
+    def token_count(self) -> int:
+        return self._token_count
+
+    @property
+    def nbytes(self) -> int:
+        return self.table.itemsize * len(self.table) + self.final_token.itemsize * len(self.final_token)
+
+    def _columns(self, symbols):
+        if self._byte_columns is not None and isinstance(symbols, memoryview) and symbols.itemsize == 1:
+            return symbols.tobytes().translate(self._byte_columns)
+        column, unknown = self.column, len(self.column)
+        if unknown == self.n_columns:
+            # no column for unknown symbols, none of them can match.
+            try:
+                return [column[c] for c in symbols]
+            except KeyError:
+                raise ValueError(ERRORS[NO_MATCH])
+        return [column.get(c, unknown) for c in symbols]
+
+    def update_vocab(self, to_encode: INPUT_SYMBOL_SEQUENCE_TYPE) -> None:
+        raise ValueError("coder is frozen: learning is disabled")
+
+    def encode(self, to_encode: INPUT_SYMBOL_SEQUENCE_TYPE, learn: bool=False) -> List[TOKEN_TYPE]:
+        columns = self._columns(self._to_symbols(to_encode, learn))
+        table, actions = self.table, self.actions
+        encoded = []
+        state = self.start
+        for x in columns:
+            next_state = table[state + x]
+            if next_state >= 0:
+                state = next_state
+            else:
+                emits, state = actions[~next_state]
+                if state < 0:
+                    raise ValueError(ERRORS[state])
+                encoded += emits
+        final = self.final_token[state // self.n_columns]
+        if final != NO_MATCH:
+            encoded.append(final)
+        return encoded
+
+    def decode(self, to_decode: List[TOKEN_TYPE]) -> List[TOKEN_TYPE]:
+        return self._from_symbols(self.decode_table.decode(to_decode))
+
+
+__all__ = ["StateMachineCoder"]
@@ -0,0 +1,115 @@
+from typing import List, Optional
+from array import array
+
+from .lz import Coder, TOKEN_TYPE, INPUT_SYMBOL_SEQUENCE_TYPE, BYTE_INPUT
+from .flat import FlatCoder
+from .native import NativeCoder, NativeRansTable
+from .entropy import FrequencyTable, rans_encode, rans_decode, read_varint, write_varint
+
+
+# Small messages (RPC payloads of a few hundred bytes) against a shared,
+# frozen dictionary. A coder that learns as it goes has nothing to go on at
+# the start of each message, and one whose state carries over from message to
+# message needs both sides to see every message, in order. Here every message
+# is encoded on its own, from the EMPTY_TOKEN context, with a dictionary both
+# sides already have, so messages can be lost, reordered or decoded anywhere.
+#
+# A message is:
+#   varint dictionary id    so a receiver with another dictionary fails loudly
+#   varint token count
+#   rANS coded tokens       static frequencies, see entropy.py (left out if empty)
+# so the framing costs 2 bytes for most messages, plus the 4 byte rANS state.
+#
+# The token count is whatever the message says, and a corrupt or hostile one
+# could claim billions of tokens (the length of the stream does not bound it:
+# a very frequent token costs a tiny fraction of a bit), so decoding refuses
+# messages of more than max_tokens tokens before allocating anything for them.
+#
+# With a NativeCoder, a message is encoded or decoded in a single native
+# call, which keeps its token buffer on the stack for short messages.
+
+MAX_MESSAGE_TOKENS = 1 << 20
+
+
+class MessageCodec:
+    '''
+    encodes and decodes independent messages with a frozen coder and static
+    token frequencies: estimated from the greedy encoding of sample, or given
+    as table (e.g. the FrequencyTable.from_bytes of the sender's table).
+    Messages of more than max_tokens tokens are refused when decoding.
+    '''
+    table: FrequencyTable
+    dictionary_id: int
+    max_tokens: int
+
+    def __init__(self, coder: Coder, sample: Optional[INPUT_SYMBOL_SEQUENCE_TYPE]=None, table: Optional[FrequencyTable]=None,
+                 dictionary_id: int=0, precision: Optional[int]=None, max_tokens: int=MAX_MESSAGE_TOKENS):
+        if not coder.frozen:
+            raise ValueError("messages need a frozen coder: both sides must have the same dictionary")
+        n_symbols = coder.token_count + 1
+        if table is None:
+            counts = [0] * n_symbols
+            if sample is not None:
+                for t in coder.encode(sample):
+                    counts[t + 1] += 1
+            table = FrequencyTable.from_counts(counts, precision)
+        elif len(table) != n_symbols:
+            raise ValueError("the frequency table does not match the coder's vocab")
+        self.coder = coder
+        self.table = table
+        self.dictionary_id = dictionary_id
+        self.max_tokens = max_tokens
+        self._header = write_varint(dictionary_id)
+        self._native = NativeRansTable(table) if isinstance(coder, NativeCoder) else None
+        self._native_bytes = self._native is not None and coder.input_mode == BYTE_INPUT and len(coder.alphabet) == 0
+
+    def close(self) -> None:
+        if self._native is not None:
+            self._native.close()
+            self._native = None
+
+    def encode(self, message: INPUT_SYMBOL_SEQUENCE_TYPE) -> bytes:
+        if self._native_bytes and isinstance(message, bytes):
+            return self.coder.encode_message(message, self._native, self.dictionary_id)
+        if self._native is not None:
+            symbols = self.coder._to_symbols(message)
+            out = bytearray(4 * len(symbols) + 32)
+            length = self.coder.message_encode_into(symbols, self._native, self.dictionary_id, out)
+            return bytes(out[:length])
+        tokens = self.coder.encode(message)
+        header = self._header + write_varint(len(tokens))
+        if len(tokens) == 0:
+            return header
+        return header + rans_encode(self.table, [t + 1 for t in tokens])
+
+    def decode(self, message: bytes) -> List[TOKEN_TYPE]:
+        if self._native is not None and isinstance(message, bytes):
+            return self.coder.decode_message(message, self._native, self.dictionary_id, self.max_tokens)
+        if self._native is not None:
+            out = array('i', bytes(4 * (8 * len(message) + 64)))
+            length = self.coder.message_decode_into(message, self._native, self.dictionary_id, out, self.max_tokens)
+            if length > len(out):
+                out = array('i', bytes(4 * length))
+                self.coder.message_decode_into(message, self._native, self.dictionary_id, out, self.max_tokens)
+            return self.coder._from_symbols(out[:length].tolist())
+
+        dictionary_id, offset = read_varint(message, 0)
+        if dictionary_id != self.dictionary_id:
+            raise ValueError("message was encoded with another dictionary")
+        count, offset = read_varint(message, offset)
+        if count > self.max_tokens:
+            raise ValueError("message has too many tokens")
+        if count == 0:
+            if offset != len(message):
+                raise ValueError("corrupt message")
+            return self.coder.decode([])
+        symbols, end = rans_decode(self.table, message, count, offset)
+        if end != len(message):
+            raise ValueError("corrupt message")
+        try:
+            return self.coder.decode([s - 1 for s in symbols])
+        except KeyError:
+            raise ValueError("corrupt message")
+
+
+__all__ = ["MessageCodec", "MAX_MESSAGE_TOKENS"]
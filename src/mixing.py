@@ -0,0 +1,232 @@
+from typing import List, Sequence
+
+
+# Adaptive entropy coding of token streams by context mixing.
+#
+# A token (as symbol token + 1, so EMPTY_TOKEN is 0) is coded as its bits,
+# most significant first, each with a binary arithmetic coder. The probability
+# of the next bit comes from several models that each count what followed
+# their own context: order 0 (no context), order 1 (the previous token, which
+# for a HierachicalLZCoder is the context the token was chosen in) and order 2
+# (the two previous tokens). Every context is combined with the bits of the
+# current token so far (its node in the binary tree of symbols).
+#
+# The models are mixed in the logistic domain, as in PAQ: with st(p) =
+# ln(p / (1 - p)), the mixed prediction is squash(sum of w_i * st(p_i)), and
+# after each bit every weight moves along the gradient of the coding cost,
+# w_i += rate * (bit - p) * st(p_i). So whichever model has been predicting
+# best gets the most say, and a model that has never seen its context
+# (p_i = 1/2, st = 0) has none. There is a set of weights per bit position.
+#
+# Each model's probability adapts by p += (bit - p) / (n + 1.5), where n counts
+# the updates so far up to a limit: fast at first, then a slowly moving average.
+#
+# Encoder and decoder must compute exactly the same probabilities, so it is all
+# integer arithmetic, again as in PAQ: no exp or log, whose last bits vary
+# between C libraries. st and squash are tables, stretched values have 8
+# fractional bits (clamped to +-2047), mixer probabilities 12 bits, model
+# probabilities 16 bits and weights 16.16 fixed point. Shifts of negative
+# numbers round down, in Python as with an arithmetic shift in C.
+
+PROBABILITY_BITS = 16
+PROBABILITY_ONE = 1 << PROBABILITY_BITS
+TOP = 0xffffffff
+
+
+class BinaryArithmeticEncoder:
+    '''
+    carry-less binary arithmetic coder over a 32 bit range, fed probabilities
+    of a 1 as PROBABILITY_BITS bit integers.
+    '''
+
+    def __init__(self):
+        self.low = 0
+        self.high = TOP
+        self.out = bytearray()
+
+    def encode(self, bit: int, p1: int) -> None:
+        mid = self.low + ((self.high - self.low) * p1 >> PROBABILITY_BITS)
+        if bit:
+            self.high = mid
+        else:
+            self.low = mid + 1
+        while (self.low ^ self.high) & 0xff000000 == 0:
+            self.out.append(self.high >> 24)
+            self.low = (self.low << 8) & TOP
+            self.high = ((self.high << 8) & TOP) | 0xff
+
+    def finish(self) -> bytes:
+        # the top byte of low, followed by the 0xff bytes the decoder reads past
+        # the end, is inside the final range (high has a larger top byte).
+        self.out.append(self.low >> 24)
+        return bytes(self.out)
+
+
+class BinaryArithmeticDecoder:
+
+    def __init__(self, data, offset: int=0):
+        self.data = data
+        self.position = offset
+        self.low = 0
+        self.high = TOP
+        self.x = 0
+        for _ in range(4):
+            self.x = (self.x << 8) | self._next_byte()
+
+    def _next_byte(self) -> int:
+        # past the end, the stream reads as 0xff, see finish.
+        if self.position < len(self.data):
+            b = self.data[self.position]
+        else:
+            b = 0xff
+        self.position += 1
+        return b
+
+    def decode(self, p1: int) -> int:
+        mid = self.low + ((self.high - self.low) * p1 >> PROBABILITY_BITS)
+        if self.x <= mid:
+            bit = 1
+            self.high = mid
+        else:
+            bit = 0
+            self.low = mid + 1
+        while (self.low ^ self.high) & 0xff000000 == 0:
+            self.low = (self.low << 8) & TOP
+            self.high = ((self.high << 8) & TOP) | 0xff
+            self.x = ((self.x << 8) & TOP) | self._next_byte()
+        return bit
+
+
+def _squash_slow(x: int) -> int:
+    # 4096 / (1 + e^-(x / 256)), interpolated between 33 points, as in PAQ8.
+    if x > 2047:
+        return 4095
+    if x < -2047:
+        return 0
+    points = [1, 2, 3, 6, 10, 16, 27, 45, 73, 120, 194, 310, 488, 747, 1101, 1546, 2047, 2549, 2994, 3348,
+              3607, 3785, 3901, 3975, 4024, 4050, 4068, 4079, 4085, 4089, 4092, 4093, 4094]
+    w = x & 127
+    i = (x >> 7) + 16
+    return (points[i] * (128 - w) + points[i + 1] * w + 64) >> 7
+
+
+# SQUASH[x + 2047] for x in -2047..2047, STRETCH[p] for 12 bit p (its inverse).
+SQUASH = [_squash_slow(x) for x in range(-2047, 2048)]
+STRETCH = [2047] * 4096
+_last = 0
+for _x in range(-2047, 2048):
+    _p = SQUASH[_x + 2047]
+    for _i in range(_last, _p + 1):
+        STRETCH[_i] = _x
+    _last = max(_last, _p + 1)
+del _last, _x, _p, _i
+
+# 2^16 / (n + 1.5), the model adaptation rate after n updates.
+_RECIPROCALS = [(1 << 17) // (2 * n + 3) for n in range(1 << 16)]
+
+
+class ContextMixingModel:
+    '''
+    bit predictions for symbols 0..n_symbols-1 from the models of the given
+    orders, mixed as described above. Encoder and decoder each run their own
+    copy, which sees the same bits in the same order.
+    '''
+
+    def __init__(self, n_symbols: int, orders: Sequence[int]=(0, 1, 2), learning_rate: float=0.02, limit: int=127):
+        assert 0 < limit < len(_RECIPROCALS)
+        self.n_symbols = n_symbols
+        self.bits = max(1, (n_symbols - 1).bit_length())
+        self.orders = list(orders)
+        # the weight step is (rate * error * st) >> 16, with error and st in
+        # their fixed point units (see above) and rate = learning_rate * 2^12.
+        self.rate = round(learning_rate * 4096)
+        self.limit = limit
+        # one table per order, of [probability, count] by (context, node).
+        self.tables = [{} for _ in self.orders]
+        self.weights = [[round(0.3 * 65536)] * len(self.orders) for _ in range(self.bits)]
+        self.history: List[int] = []
+
+    def _contexts(self) -> List[int]:
+        # one number per order naming its context, so that with the node it
+        # makes an int key (much faster to hash than a tuple).
+        history, n = self.history, self.n_symbols + 1
+        contexts = []
+        for order in self.orders:
+            context = 0
+            for s in history[len(history) - order:] if order > 0 else ():
+                context = context * n + s + 1
+            if order > len(history):
+                context = -1 - order
+            contexts.append(context)
+        return contexts
+
+    def code(self, symbol: int, coder) -> int:
+        '''
+        encodes symbol with a BinaryArithmeticEncoder, or decodes one (pass
+        symbol=-1) from a BinaryArithmeticDecoder, and learns from it.
+        '''
+        size = 1 << self.bits
+        decoding = symbol < 0
+        entries_by_order = [self.tables[i] for i in range(len(self.orders))]
+        contexts = [c * size for c in self._contexts()]
+        rate, limit = self.rate, self.limit
+        squash, stretch, reciprocals = SQUASH, STRETCH, _RECIPROCALS
+        node = 1
+        for k in range(self.bits - 1, -1, -1):
+            entries = []
+            stretched = []
+            for table, context in zip(entries_by_order, contexts):
+                entry = table.get(context + node)
+                if entry is None:
+                    entry = table[context + node] = [1 << 15, 0]
+                entries.append(entry)
+                stretched.append(stretch[entry[0] >> 4])
+            weights = self.weights[k]
+            dot = sum(w * s for w, s in zip(weights, stretched)) >> 16
+            p = squash[min(2047, max(-2047, dot)) + 2047]
+            # 12 bits to the coder's 16, never 0 or 1.
+            p1 = (p << 4) | 8
+            if decoding:
+                bit = coder.decode(p1)
+            else:
+                bit = (symbol >> k) & 1
+                coder.encode(bit, p1)
+
+            error = rate * ((bit << 12) - p)
+            for i, s in enumerate(stretched):
+                weights[i] += (error * s) >> 16
+            target = bit << 16
+            for entry in entries:
+                n = entry[1]
+                if n < limit:
+                    n = entry[1] = n + 1
+                q = entry[0] + (((target - entry[0]) * reciprocals[n]) >> 16)
+                entry[0] = min(65529, max(7, q))
+            node = 2 * node + bit
+        symbol = node - size
+        self.history.append(symbol)
+        if len(self.history) > max(self.orders):
+            del self.history[0]
+        return symbol
+
+
+def cm_encode(tokens: Sequence[int], vocab_size: int, orders: Sequence[int]=(0, 1, 2), **kwargs) -> bytes:
+    '''
+    tokens (EMPTY_TOKEN included) of a vocab of vocab_size other tokens.
+    '''
+    model = ContextMixingModel(vocab_size + 1, orders, **kwargs)
+    encoder = BinaryArithmeticEncoder()
+    for t in tokens:
+        if not -1 <= t < vocab_size:
+            raise ValueError("token out of range")
+        model.code(t + 1, encoder)
+    return encoder.finish()
+
+
+def cm_decode(data, count: int, vocab_size: int, orders: Sequence[int]=(0, 1, 2), **kwargs) -> List[int]:
+    model = ContextMixingModel(vocab_size + 1, orders, **kwargs)
+    decoder = BinaryArithmeticDecoder(data)
+    return [model.code(-1, decoder) - 1 for _ in range(count)]
+
+
+__all__ = ["SQUASH", "STRETCH", "ContextMixingModel", "BinaryArithmeticEncoder", "BinaryArithmeticDecoder", "cm_encode", "cm_decode"]
@@ -0,0 +1,395 @@
+from typing import List, Tuple, Union
+from array import array
+import ctypes
+import hashlib
+import os
+import subprocess
+import sys
+import tempfile
+import threading
+
+from .lz import Coder, TOKEN_TYPE, INPUT_SYMBOL_SEQUENCE_TYPE, map_file
+from .flat import FlatCoder, to_flat_bytes
+from .entropy import MAX_PRECISION
+
+
+# The native backend is lznative.c, compiled on first use with the system C
+# compiler (into a per-user cache, see _library_path) and loaded with ctypes. ctypes.CDLL releases the GIL around every
+# call, so while one thread is inside hlz_encode or hlz_decode the others keep
+# running Python, or run their own native encode on another core.
+
+SOURCE = os.path.join(os.path.dirname(os.path.abspath(__file__)), "lznative.c")
+
+ERRORS = {
+    -1: "could not match any tokens: did you mean to enable learning?",
+    -2: "context not in coders",
+    -3: "output buffer is too small",
+    -4: "unknown token",
+    -5: "corrupt message",
+    -6: "message was encoded with another dictionary",
+    -7: "out of memory",
+    -8: "message has too many tokens",
+}
+
+
+class _Flat(ctypes.Structure):
+    _fields_ = [(name, ctypes.c_void_p) for name in [
+        "context_of", "context_start", "root", "node_token", "node_offset", "node_length",
+        "edge_node", "edge_symbol", "edge_child", "expansion",
+    ]] + [("vocab_size", ctypes.c_int64), ("edge_mask", ctypes.c_int64), ("hierarchical", ctypes.c_int64)]
+
+
+class _RansTable(ctypes.Structure):
+    _fields_ = [("freq", ctypes.c_void_p), ("cum", ctypes.c_void_p), ("slot_symbol", ctypes.c_void_p),
+                ("precision", ctypes.c_int64), ("n_symbols", ctypes.c_int64)]
+
+
+class _PyBuffer(ctypes.Structure):
+    _fields_ = [
+        ("buf", ctypes.c_void_p), ("obj", ctypes.py_object), ("len", ctypes.c_ssize_t),
+        ("itemsize", ctypes.c_ssize_t), ("readonly", ctypes.c_int), ("ndim", ctypes.c_int),
+        ("format", ctypes.c_char_p), ("shape", ctypes.c_void_p), ("strides", ctypes.c_void_p),
+        ("suboffsets", ctypes.c_void_p), ("internal", ctypes.c_void_p),
+    ]
+
+
+PyBUF_WRITABLE = 0x0001
+
+_get_buffer = ctypes.pythonapi.PyObject_GetBuffer
+_get_buffer.argtypes = [ctypes.py_object, ctypes.POINTER(_PyBuffer), ctypes.c_int]
+_release_buffer = ctypes.pythonapi.PyBuffer_Release
+_release_buffer.argtypes = [ctypes.POINTER(_PyBuffer)]
+
+
+class PinnedBuffer:
+    '''
+    address of any object with the buffer protocol, read-only ones included
+    (ctypes' from_buffer only takes writable buffers). The buffer can not be
+    resized or unmapped until release() is called.
+    '''
+
+    def __init__(self, obj, writable: bool=False):
+        self._view = _PyBuffer()
+        _get_buffer(obj, ctypes.byref(self._view), PyBUF_WRITABLE if writable else 0)
+        self.address = self._view.buf or 0
+        self.nbytes = self._view.len
+
+    def release(self) -> None:
+        if self._view is not None:
+            _release_buffer(ctypes.byref(self._view))
+            self._view = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.release()
+
+
+_library = None
+_library_lock = threading.Lock()
+
+def _cache_directory() -> str:
+    # a per-user directory rather than the package's own, which may be
+    # read-only and is shared by every process that imports it.
+    uid = os.getuid() if hasattr(os, "getuid") else None
+    directory = os.path.join(tempfile.gettempdir(), f"adatok-{uid if uid is not None else 'user'}")
+    os.makedirs(directory, mode=0o700, exist_ok=True)
+    if uid is not None:
+        # we load code from here, so nobody else may be able to write to it.
+        info = os.stat(directory)
+        if info.st_uid != uid or info.st_mode & 0o022:
+            raise OSError(f"{directory} is not private to this user")
+    return directory
+
+def _library_path() -> str:
+    # named after the source, so a stale build is never loaded and different
+    # versions of the package can share the cache.
+    with open(SOURCE, 'rb') as f:
+        digest = hashlib.sha256(f.read()).hexdigest()[:16]
+    return os.path.join(_cache_directory(), f"_lznative-{digest}" + (".dll" if sys.platform == "win32" else ".so"))
+
+def _build(path: str) -> None:
+    # compile to a file of our own, then rename it into place: the rename is
+    # atomic, so others see either no library or a complete one, and if they
+    # build it at the same time, any of the copies will do.
+    compiler = os.environ.get("CC", "cc")
+    fd, tmp = tempfile.mkstemp(dir=os.path.dirname(path), suffix=".tmp")
+    os.close(fd)
+    try:
+        subprocess.run([compiler, "-O3", "-shared", "-fPIC", "-o", tmp, SOURCE], check=True, capture_output=True)
+        os.replace(tmp, path)
+    finally:
+        if os.path.exists(tmp):
+            os.unlink(tmp)
+
+def load_library() -> ctypes.CDLL:
+    global _library
+    if _library is not None:
+        return _library
+    with _library_lock:
+        if _library is not None:
+            return _library
+        path = _library_path()
+        if not os.path.exists(path):
+            _build(path)
+        lib = ctypes.CDLL(path)
+        lib.hlz_encode.argtypes = [ctypes.POINTER(_Flat), ctypes.c_void_p, ctypes.c_int64, ctypes.c_int, ctypes.c_void_p, ctypes.c_int64]
+        lib.hlz_encode.restype = ctypes.c_int64
+        lib.hlz_encode_range.argtypes = [ctypes.POINTER(_Flat), ctypes.c_void_p, ctypes.c_int64, ctypes.c_int, ctypes.c_int64,
+                                         ctypes.c_int64, ctypes.c_int64, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_int64]
+        lib.hlz_encode_range.restype = ctypes.c_int64
+        lib.hlz_decode.argtypes = [ctypes.POINTER(_Flat), ctypes.c_void_p, ctypes.c_int64, ctypes.c_void_p, ctypes.c_int64]
+        lib.hlz_decode.restype = ctypes.c_int64
+        lib.hlz_decode_range.argtypes = [ctypes.POINTER(_Flat), ctypes.c_void_p, ctypes.c_int64, ctypes.c_int64, ctypes.c_void_p, ctypes.c_int64]
+        lib.hlz_decode_range.restype = ctypes.c_int64
+        lib.msg_encode.argtypes = [ctypes.POINTER(_Flat), ctypes.POINTER(_RansTable), ctypes.c_int64, ctypes.c_void_p,
+                                   ctypes.c_int64, ctypes.c_int, ctypes.c_void_p, ctypes.c_int64]
+        lib.msg_encode.restype = ctypes.c_int64
+        lib.msg_decode.argtypes = [ctypes.POINTER(_Flat), ctypes.POINTER(_RansTable), ctypes.c_int64, ctypes.c_void_p,
+                                   ctypes.c_int64, ctypes.c_void_p, ctypes.c_int64, ctypes.c_int64]
+        lib.msg_decode.restype = ctypes.c_int64
+        lib.rans_encode.argtypes = [ctypes.POINTER(_RansTable), ctypes.c_void_p, ctypes.c_int64, ctypes.c_int, ctypes.c_void_p, ctypes.c_int64]
+        lib.rans_encode.restype = ctypes.c_int64
+        lib.rans_decode.argtypes = [ctypes.POINTER(_RansTable), ctypes.c_void_p, ctypes.c_int64, ctypes.c_void_p, ctypes.c_int64, ctypes.c_int]
+        lib.rans_decode.restype = ctypes.c_int64
+        lib.suffix_array_build.argtypes = [ctypes.c_void_p, ctypes.c_int64, ctypes.c_int, ctypes.c_int64, ctypes.c_void_p, ctypes.c_void_p]
+        lib.suffix_array_build.restype = ctypes.c_int64
+        _library = lib
+        return _library
+
+def native_available() -> bool:
+    try:
+        load_library()
+        return True
+    except (OSError, subprocess.CalledProcessError):
+        return False
+
+
+def _check(result: int) -> int:
+    if result < 0:
+        raise ValueError(ERRORS.get(result, "native error"))
+    return result
+
+
+def build_suffix_array(ids: array, k: int) -> Tuple[array, array]:
+    '''
+    suffix array and LCP array (as array('i')) of ids, an array('B') or
+    array('i') of ids in [1, k). Needs fewer than 2^31 - 1 ids.
+    '''
+    assert ids.itemsize in (1, 4) and len(ids) < (1 << 31) - 1
+    n = len(ids)
+    sa, lcp = array('i', bytes(4 * n)), array('i', bytes(4 * n))
+    with PinnedBuffer(ids) as source, PinnedBuffer(sa, writable=True) as sa_out, PinnedBuffer(lcp, writable=True) as lcp_out:
+        _check(load_library().suffix_array_build(source.address, n, ids.itemsize, k, sa_out.address, lcp_out.address))
+    return sa, lcp
+
+
+class NativeCoder(FlatCoder):
+    '''
+    a FlatCoder whose encode and decode run in native code without the GIL.
+    encode_into / decode_into work on caller supplied buffers, the usual
+    encode / decode return lists like every other coder.
+    '''
+
+    def __init__(self, buffer, owner=None, check: bool=True):
+        super().__init__(buffer, owner, check)
+        self._lib = load_library()
+        self._pin = PinnedBuffer(self._views[0])
+        base = self._pin.address
+        self._flat = _Flat(**{name: base + offset for name, offset in self.offsets.items() if name != "alphabet"},
+                           vocab_size=self.vocab_size, edge_mask=self.edge_mask, hierarchical=int(self.hierarchical))
+
+    @classmethod
+    def open(cls, path: Union[str, os.PathLike]) -> "NativeCoder":
+        return cls(map_file(path))
+
+    @classmethod
+    def from_coder(cls, coder: Coder) -> "NativeCoder":
+        return cls(to_flat_bytes(coder), check=False)
+
+    def close(self) -> None:
+        if self._pin is not None:
+            self._pin.release()
+            self._pin = None
+        super().close()
+
+    def encode_into(self, to_encode, out) -> int:
+        '''
+        encodes a buffer of 1 byte (unsigned), 4 byte or 8 byte (signed) symbols
+        into the writable int32 buffer out, and returns the number of tokens.
+        out needs room for up to 2 tokens per input symbol.
+        '''
+        to_encode = memoryview(to_encode)
+        out = memoryview(out)
+        if to_encode.itemsize not in (1, 4, 8) or out.itemsize != 4:
+            raise ValueError("expected 1, 4 or 8 byte input symbols and 4 byte tokens")
+        with PinnedBuffer(to_encode) as source, PinnedBuffer(out, writable=True) as target:
+            return _check(self._lib.hlz_encode(ctypes.byref(self._flat), source.address, len(to_encode), to_encode.itemsize,
+                                               target.address, len(out)))
+
+    def encode_range(self, symbols, start: int, context: TOKEN_TYPE, limit: int) -> Tuple[List[TOKEN_TYPE], List[int]]:
+        '''
+        greedy encode of the buffer of symbols from start in context, up to the
+        first token boundary at or after limit. Returns the tokens and where
+        each of them starts, followed by where the last one ends.
+        '''
+        symbols = memoryview(symbols)
+        if symbols.itemsize not in (1, 4, 8):
+            raise ValueError("expected 1, 4 or 8 byte input symbols")
+        # every token but EMPTY_TOKEN takes at least one symbol, and EMPTY_TOKEN
+        # is always followed by one that does.
+        capacity = 2 * max(0, min(limit, len(symbols)) - start) + 2
+        out = array('i', bytes(4 * capacity))
+        starts = array('q', bytes(8 * (capacity + 1)))
+        with PinnedBuffer(symbols) as source, PinnedBuffer(out, writable=True) as target, \
+                PinnedBuffer(starts, writable=True) as positions:
+            count = _check(self._lib.hlz_encode_range(ctypes.byref(self._flat), source.address, len(symbols), symbols.itemsize,
+                                                      start, context, limit, target.address, positions.address, capacity))
+        return out[:count].tolist(), starts[:count + 1].tolist()
+
+    def encode(self, to_encode: INPUT_SYMBOL_SEQUENCE_TYPE, learn: bool=False) -> List[TOKEN_TYPE]:
+        to_encode = self._to_symbols(to_encode, learn)
+        if not isinstance(to_encode, memoryview):
+            raise ValueError("input symbols do not fit in 64 bits")
+        out = array('i', bytes(4 * (2 * len(to_encode) + 1)))
+        count = self.encode_into(to_encode, out)
+        return out[:count].tolist()
+
+    def decode_into(self, to_decode, out) -> int:
+        '''
+        decodes a buffer of int32 tokens into the writable int32 buffer out.
+        Returns the length of the whole decoded output: if that is more than
+        len(out), only the beginning was written and the call should be repeated
+        with a larger buffer.
+        '''
+        to_decode = memoryview(to_decode)
+        out = memoryview(out)
+        if to_decode.itemsize != 4 or out.itemsize != 4:
+            raise ValueError("expected 4 byte tokens and output symbols")
+        with PinnedBuffer(to_decode) as source, PinnedBuffer(out, writable=True) as target:
+            return _check(self._lib.hlz_decode(ctypes.byref(self._flat), source.address, len(to_decode), target.address, len(out)))
+
+    def decode_range_into(self, to_decode, context: TOKEN_TYPE, out) -> int:
+        '''
+        decode_into for a range of a token stream, whose first token is decoded
+        in context (the token before the range, for hierarchical coders).
+        '''
+        to_decode = memoryview(to_decode)
+        out = memoryview(out)
+        if to_decode.itemsize != 4 or out.itemsize != 4:
+            raise ValueError("expected 4 byte tokens and output symbols")
+        with PinnedBuffer(to_decode) as source, PinnedBuffer(out, writable=True) as target:
+            return _check(self._lib.hlz_decode_range(ctypes.byref(self._flat), source.address, len(to_decode), context,
+                                                     target.address, len(out)))
+
+    def decode(self, to_decode: List[TOKEN_TYPE]) -> List[TOKEN_TYPE]:
+        tokens = to_decode if isinstance(to_decode, (array, memoryview)) else array('i', to_decode)
+        out = array('i', bytes(4 * 4 * (len(tokens) + 1)))
+        length = self.decode_into(tokens, out)
+        if length > len(out):
+            out = array('i', bytes(4 * length))
+            self.decode_into(tokens, out)
+        return self._from_symbols(out[:length].tolist())
+
+    def message_encode_into(self, to_encode, rans: "NativeRansTable", dictionary_id: int, out) -> int:
+        '''
+        encodes a buffer of symbols as one message (see message.py) into the
+        writable bytes out, which needs room for 4 * len(to_encode) + 32 bytes,
+        in a single native call. Returns the length of the message.
+        '''
+        to_encode = memoryview(to_encode)
+        if to_encode.itemsize not in (1, 4, 8):
+            raise ValueError("expected 1, 4 or 8 byte input symbols")
+        with PinnedBuffer(to_encode) as source, PinnedBuffer(out, writable=True) as target:
+            return _check(self._lib.msg_encode(ctypes.byref(self._flat), ctypes.byref(rans.table), dictionary_id,
+                                               source.address, len(to_encode), to_encode.itemsize, target.address, target.nbytes))
+
+    def message_decode_into(self, message, rans: "NativeRansTable", dictionary_id: int, out, max_tokens: int) -> int:
+        '''
+        decodes one message into the writable int32 buffer out. Like
+        decode_into, returns the whole decoded length even if out is too short.
+        Messages of more than max_tokens tokens are rejected.
+        '''
+        out = memoryview(out)
+        if out.itemsize != 4:
+            raise ValueError("expected 4 byte output symbols")
+        with PinnedBuffer(message) as source, PinnedBuffer(out, writable=True) as target:
+            return _check(self._lib.msg_decode(ctypes.byref(self._flat), ctypes.byref(rans.table), dictionary_id,
+                                               source.address, source.nbytes, target.address, len(out), max_tokens))
+
+
+    def encode_message(self, message: bytes, rans: "NativeRansTable", dictionary_id: int) -> bytes:
+        '''
+        message_encode_into for a bytes message to a byte input coder. bytes go
+        to ctypes as they are, so nothing needs pinning: this is the fast path
+        for short messages.
+        '''
+        out = ctypes.create_string_buffer(4 * len(message) + 32)
+        length = _check(self._lib.msg_encode(ctypes.byref(self._flat), ctypes.byref(rans.table), dictionary_id,
+                                             message, len(message), 1, out, len(out)))
+        return ctypes.string_at(out, length)
+
+    def decode_message(self, message: bytes, rans: "NativeRansTable", dictionary_id: int, max_tokens: int) -> List[TOKEN_TYPE]:
+        # the same for message_decode_into.
+        capacity = 8 * len(message) + 64
+        while True:
+            out = (ctypes.c_int32 * capacity)()
+            length = _check(self._lib.msg_decode(ctypes.byref(self._flat), ctypes.byref(rans.table), dictionary_id,
+                                                 message, len(message), out, capacity, max_tokens))
+            if length <= capacity:
+                return self._from_symbols(out[:length])
+            capacity = length
+
+
+class NativeRansTable:
+    '''
+    an entropy.FrequencyTable pinned for native code. encode and decode code
+    token streams (as symbols token + 1) exactly like entropy.rans_encode and
+    rans_decode with the same number of lanes.
+    '''
+
+    def __init__(self, table):
+        # the lanes shift by the precision in 32 bits, past MAX_PRECISION they overflow.
+        if not 0 <= table.precision <= MAX_PRECISION:
+            raise ValueError(f"precision must be between 0 and {MAX_PRECISION}")
+        self._lib = load_library()
+        self._pins = [PinnedBuffer(a) for a in (table.freq, table.cum, table.slot_symbol)]
+        freq, cum, slot_symbol = (pin.address for pin in self._pins)
+        self.table = _RansTable(freq=freq, cum=cum, slot_symbol=slot_symbol, precision=table.precision, n_symbols=len(table))
+
+    def close(self) -> None:
+        for pin in self._pins:
+            pin.release()
+        self._pins = []
+
+    def encode(self, tokens, lanes: int=1) -> bytes:
+        tokens = tokens if isinstance(tokens, (array, memoryview)) else array('i', tokens)
+        tokens = memoryview(tokens)
+        if tokens.itemsize != 4:
+            raise ValueError("expected 4 byte tokens")
+        # up to 2 bytes per token, and the lane states.
+        capacity = 2 * len(tokens) + 4 * lanes
+        out = ctypes.create_string_buffer(capacity)
+        with PinnedBuffer(tokens) as source:
+            length = _check(self._lib.rans_encode(ctypes.byref(self.table), source.address, len(tokens), lanes, out, capacity))
+        return ctypes.string_at(ctypes.addressof(out) + capacity - length, length)
+
+    def decode_into(self, data, count: int, out, lanes: int=1) -> int:
+        '''
+        decodes count tokens from data, which must be exactly one encoded
+        stream, into the writable int32 buffer out.
+        '''
+        out = memoryview(out)
+        if out.itemsize != 4 or len(out) < count:
+            raise ValueError("expected room for count 4 byte tokens")
+        with PinnedBuffer(data) as source, PinnedBuffer(out, writable=True) as target:
+            return _check(self._lib.rans_decode(ctypes.byref(self.table), source.address, source.nbytes, target.address, count, lanes))
+
+    def decode(self, data, count: int, lanes: int=1) -> List[TOKEN_TYPE]:
+        out = array('i', bytes(4 * count))
+        self.decode_into(data, count, out, lanes)
+        return out.tolist()
+
+
+__all__ = ["NativeCoder", "NativeRansTable", "PinnedBuffer", "native_available", "load_library", "build_suffix_array"]
@@ -0,0 +1,136 @@
+from typing import Dict, Optional, Sequence, Set, Tuple
+import heapq
+
+from .lz import LZCoder, TOKEN_TYPE, INPUT_SYMBOL_SEQUENCE_TYPE, BYTE_INPUT, get_input_vocab, get_set_element
+from .suffix_array import SuffixArray
+
+
+# Offline dictionary construction. An LZCoder learning online adds whatever
+# extends the current match, so its dictionary fills up with whatever came
+# first. Here we look at the whole corpus before choosing anything:
+#
+# 1. count every substring of up to max_length symbols that occurs at least
+#    min_count times, one length at a time: a string can only be frequent if
+#    its prefix one symbol shorter is, so every level only counts extensions of
+#    the frequent strings of the level before (a counting trie, pruned as it
+#    grows).
+# 2. pick entries greedily by estimated savings. Taking s saves, for each of its
+#    occurrences not already covered by a longer chosen entry, the tokens the
+#    current dictionary needs for s minus the one token s needs now. Both parts
+#    only go down as entries are chosen, so we can pick lazily from a heap and
+#    only recompute the savings of the top candidate.
+
+COUNTS_TYPE = Dict[Tuple[TOKEN_TYPE, ...], int]
+
+
+def count_substrings(symbols: Sequence[TOKEN_TYPE], max_length: int=32, min_count: int=2) -> COUNTS_TYPE:
+    '''
+    occurrence counts (overlapping) of every substring of length 2 to
+    max_length that occurs at least min_count times.
+    '''
+    n = len(symbols)
+    counts: COUNTS_TYPE = {}
+    # starting positions of the frequent strings of the current length.
+    frequent_starts = range(n)
+    length = 1
+    previous: Set[Tuple[TOKEN_TYPE, ...]] = set((c,) for c in set(symbols))
+    while length < max_length and previous:
+        length += 1
+        level: COUNTS_TYPE = {}
+        starts = []
+        for i in frequent_starts:
+            if i + length > n:
+                continue
+            key = tuple(symbols[i:i + length])
+            if key[:-1] in previous:
+                level[key] = level.get(key, 0) + 1
+                starts.append(i)
+        previous = set(key for key, count in level.items() if count >= min_count)
+        frequent_starts = [i for i in starts if tuple(symbols[i:i + length]) in previous]
+        for key in previous:
+            counts[key] = level[key]
+    return counts
+
+
+def _greedy_tokens(s: Tuple[TOKEN_TYPE, ...], chosen: Set[Tuple[TOKEN_TYPE, ...]]) -> int:
+    # tokens the longest-match parse of s needs with the chosen entries.
+    tokens, i = 0, 0
+    while i < len(s):
+        j = len(s)
+        while j > i + 1 and s[i:j] not in chosen:
+            j -= 1
+        tokens += 1
+        i = j
+    return tokens
+
+
+def select_entries(counts: COUNTS_TYPE, capacity: int) -> Dict[Tuple[TOKEN_TYPE, ...], int]:
+    '''
+    up to capacity strings of counts, chosen greedily by estimated savings.
+    Returns them with their estimated savings, in the order they were chosen.
+    '''
+    chosen: Dict[Tuple[TOKEN_TYPE, ...], int] = {}
+    # occurrences of each string that a longer chosen entry starting with it
+    # takes care of. (Occurrences inside other entries are not tracked, which
+    # overestimates the savings of some suffixes a bit.)
+    covered: Dict[Tuple[TOKEN_TYPE, ...], int] = {}
+
+    def savings(s):
+        return (counts[s] - covered.get(s, 0)) * (_greedy_tokens(s, chosen) - 1)
+
+    # without any entries, s costs len(s) tokens.
+    heap = [(-count * (len(s) - 1), s) for s, count in counts.items()]
+    heapq.heapify(heap)
+    while heap and len(chosen) < capacity:
+        _, s = heapq.heappop(heap)
+        gain = savings(s)
+        if gain <= 0:
+            continue
+        if heap and gain < -heap[0][0]:
+            heapq.heappush(heap, (-gain, s))
+            continue
+        chosen[s] = gain
+        # the occurrences of s are now off the table for its prefixes, up to the
+        # nearest chosen one, which already counts them once they're covered.
+        uncovered = counts[s] - covered.get(s, 0)
+        for k in range(len(s) - 1, 1, -1):
+            p = s[:k]
+            covered[p] = covered.get(p, 0) + uncovered
+            if p in chosen:
+                break
+    return chosen
+
+
+def build_dictionary(corpus: INPUT_SYMBOL_SEQUENCE_TYPE, output_vocab_size: int, input_mode: str=BYTE_INPUT,
+                     input_vocab: Optional[Set[int]]=None, max_length: int=32, min_count: int=2,
+                     counts: Optional[COUNTS_TYPE]=None, suffix_array: bool=False) -> LZCoder:
+    '''
+    a frozen LZCoder whose entries are chosen by frequency over the whole
+    corpus, rather than learned first-come-first-served. Every input symbol
+    gets an entry, the rest of output_vocab_size goes to the longer strings
+    that save the most tokens. counts can be passed in to reuse the substring
+    counts (in the coder's symbols, see count_substrings). With suffix_array
+    they are counted with a SuffixArray instead of the counting trie, which
+    does not slow down with long repeats.
+
+    The dictionary is not prefix-closed (a chosen string's prefixes are not
+    necessarily entries), which longest-match encoding does not need.
+    '''
+    if input_vocab is None:
+        input_vocab = get_input_vocab(corpus, input_mode)
+    coder = LZCoder(output_vocab_size, input_vocab=input_vocab, input_mode=input_mode)
+    if counts is None and suffix_array:
+        counts = SuffixArray(coder._to_symbols(corpus)).frequent_substrings(min_count, max_length)
+    elif counts is None:
+        counts = count_substrings(coder._to_symbols(corpus), max_length, min_count)
+
+    capacity = output_vocab_size - len(coder.input_vocab)
+    chosen = select_entries(counts, capacity)
+    # shorter first, so that whatever prefixes were chosen come before their extensions.
+    for s in sorted(chosen, key=len):
+        coder._add_new_token(s, get_set_element(coder.unused_tokens))
+    coder.freeze()
+    return coder
+
+
+__all__ = ["count_substrings", "select_entries", "build_dictionary"]
@@ -0,0 +1,235 @@
+from typing import Any, Dict, Iterator, List, Optional, Sequence, Set
+from collections.abc import MutableMapping
+
+
+# Copy-on-write layers over a frozen coder's containers, for forking it (see
+# LZCoder.fork). Dictionaries only ever grow, and a new entry never replaces
+# an old one (its token was unused, its prefix unknown), so each layer is just
+# a small container of its own in front of the base: reads look in both,
+# writes only go to the layer, and sizes are the sum of the two. The base must
+# not change while it has forks, which is why only frozen coders can fork.
+
+
+class OverlayDict(MutableMapping):
+    '''
+    dict of new keys in front of a base mapping. Unlike collections.ChainMap,
+    len() does not have to look at every key.
+    '''
+
+    def __init__(self, base):
+        self.base = base
+        self.layer: Dict = {}
+
+    def __getitem__(self, key):
+        if key in self.layer:
+            return self.layer[key]
+        return self.base[key]
+
+    def get(self, key, default=None):
+        if key in self.layer:
+            return self.layer[key]
+        return self.base.get(key, default)
+
+    def __contains__(self, key) -> bool:
+        return key in self.layer or key in self.base
+
+    def __setitem__(self, key, value) -> None:
+        assert key not in self.base, "overlays only add new keys"
+        self.layer[key] = value
+
+    def __delitem__(self, key) -> None:
+        raise TypeError("dictionaries never remove entries")
+
+    def __iter__(self) -> Iterator:
+        yield from self.base
+        yield from self.layer
+
+    def __len__(self) -> int:
+        return len(self.base) + len(self.layer)
+
+
+class OverlaySet:
+    '''
+    a base set minus the elements removed since: the token allocator of a fork.
+    order lists the base's elements in iteration order; it is shared by every
+    fork of the same base (see LZCoder.fork), so a fork only keeps what it took.
+    '''
+
+    def __init__(self, base: Set, order: Optional[Sequence]=None):
+        if isinstance(base, OverlaySet):
+            # a fork of a fork: read through to the same base, and take what
+            # the parent took (proportional to its new entries, not the base).
+            self.base, self.order = base.base, base._order()
+            self.taken: Set = set(base.taken)
+            self.skip = base.skip
+        else:
+            self.base, self.order = base, order
+            self.taken = set()
+            # how many elements at the start of order are known to be taken, so
+            # taking the first free one again and again starts where the last
+            # one was found (stepping through the base set would still visit
+            # every one of them).
+            self.skip = 0
+
+    def _order(self) -> Sequence:
+        if self.order is None:
+            self.order = list(self.base)
+        return self.order
+
+    def __contains__(self, x) -> bool:
+        return x in self.base and x not in self.taken
+
+    def remove(self, x) -> None:
+        if x not in self:
+            raise KeyError(x)
+        self.taken.add(x)
+
+    def __iter__(self) -> Iterator:
+        order, taken = self._order(), self.taken
+        first = True
+        for i in range(self.skip, len(order)):
+            x = order[i]
+            if x not in taken:
+                if first:
+                    self.skip = i
+                    first = False
+                yield x
+
+    def __len__(self) -> int:
+        return len(self.base) - len(self.taken)
+
+
+class OverlayLog:
+    '''
+    entry log that continues a base log: positions (and so snapshots and
+    checkpoint watermarks) carry on from where the base stopped.
+    '''
+
+    def __init__(self, base: List):
+        self.base = base
+        self.layer: List = []
+
+    def __len__(self) -> int:
+        return len(self.base) + len(self.layer)
+
+    def append(self, entry) -> None:
+        self.layer.append(entry)
+
+    def __getitem__(self, i):
+        if isinstance(i, slice):
+            start, stop, step = i.indices(len(self))
+            if start >= len(self.base) and step == 1:
+                return self.layer[start - len(self.base):stop - len(self.base)]
+            return [self[j] for j in range(start, stop, step)]
+        if i < 0:
+            i += len(self)
+        if i < len(self.base):
+            return self.base[i]
+        return self.layer[i - len(self.base)]
+
+    def __iter__(self) -> Iterator:
+        yield from self.base
+        yield from self.layer
+
+
+class OverlayTrie:
+    '''
+    the parts of pygtrie.Trie a coder uses, over a base trie plus a private
+    trie of new keys. A new key can extend a base key, so a lookup asks both
+    and keeps the longer match.
+    '''
+
+    def __init__(self, base, layer):
+        self.base = base
+        self.layer = layer
+
+    def __len__(self) -> int:
+        return len(self.base) + len(self.layer)
+
+    def __contains__(self, key) -> bool:
+        return key in self.layer or key in self.base
+
+    def __getitem__(self, key):
+        if key in self.layer:
+            return self.layer[key]
+        return self.base[key]
+
+    def get(self, key, default=None):
+        if key in self.layer:
+            return self.layer[key]
+        return self.base.get(key, default)
+
+    def __setitem__(self, key, value) -> None:
+        self.layer[key] = value
+
+    def longest_prefix(self, key):
+        step = self.base.longest_prefix(key)
+        if len(self.layer) == 0:
+            return step
+        layer_step = self.layer.longest_prefix(key)
+        if layer_step and (not step or len(layer_step[0]) > len(step[0])):
+            return layer_step
+        return step
+
+    def prefixes(self, key):
+        steps = list(self.base.prefixes(key)) + list(self.layer.prefixes(key))
+        return sorted(steps, key=lambda step: len(step[0]))
+
+    def items(self) -> List:
+        return list(self.base.items()) + list(self.layer.items())
+
+    def keys(self) -> List:
+        return [key for key, _ in self.items()]
+
+    def __iter__(self) -> Iterator:
+        return iter(self.keys())
+
+
+class ForkedCoders(MutableMapping):
+    '''
+    the per-context coders of a forked HierachicalLZCoder. Lookups hand out
+    the (frozen) base coder of every context the fork has not learned in yet;
+    writable(context) forks it the first time something is added to it.
+    '''
+
+    def __init__(self, base: Dict, fork: Any):
+        self.base = base
+        # called as fork(base_coder) to fork one context.
+        self.fork = fork
+        self.layer: Dict = {}
+        self.added = 0
+
+    def __getitem__(self, context):
+        coder = self.layer.get(context)
+        if coder is None:
+            return self.base[context]
+        return coder
+
+    def writable(self, context):
+        coder = self.layer.get(context)
+        if coder is None:
+            coder = self.layer[context] = self.fork(self.base[context])
+        return coder
+
+    def __contains__(self, context) -> bool:
+        return context in self.layer or context in self.base
+
+    def __setitem__(self, context, coder) -> None:
+        if context not in self:
+            self.added += 1
+        self.layer[context] = coder
+
+    def __delitem__(self, context) -> None:
+        raise TypeError("contexts are never removed")
+
+    def __iter__(self) -> Iterator:
+        yield from self.base
+        for context in self.layer:
+            if context not in self.base:
+                yield context
+
+    def __len__(self) -> int:
+        return len(self.base) + self.added
+
+
+__all__ = ["OverlayDict", "OverlaySet", "OverlayLog", "OverlayTrie", "ForkedCoders"]
@@ -0,0 +1,346 @@
+from typing import Dict, List, Optional, Sequence, Tuple
+from array import array
+from bisect import bisect_left
+from concurrent.futures import Executor, ThreadPoolExecutor, ProcessPoolExecutor
+from dataclasses import dataclass
+import os
+import sys
+
+from .lz import Coder, EMPTY_TOKEN, TOKEN_TYPE, INPUT_SYMBOL_SEQUENCE_TYPE
+from .flat import FlatCoder
+from .native import NativeCoder
+
+
+def free_threaded() -> bool:
+    # true on free-threaded CPython builds running with the GIL disabled.
+    is_gil_enabled = getattr(sys, "_is_gil_enabled", None)
+    return is_gil_enabled is not None and not is_gil_enabled()
+
+
+# each worker process gets its own copy of the coder once, when it starts.
+_worker_coder: Optional[Coder] = None
+
+def _init_worker(coder: Coder) -> None:
+    global _worker_coder
+    _worker_coder = coder
+
+def _encode_in_worker(to_encode: INPUT_SYMBOL_SEQUENCE_TYPE) -> List[TOKEN_TYPE]:
+    return _worker_coder.encode(to_encode, learn=False)
+
+
+class BatchEncoder:
+    '''
+    encodes batches of documents in parallel with a frozen coder.
+
+    Without the GIL, threads share the coder directly: frozen encode only reads
+    it. With the GIL, threads would just take turns, so we fall back to worker
+    processes that each receive a copy of the coder when they start.
+    '''
+    coder: Coder
+    workers: int
+    use_threads: bool
+
+    def __init__(self, coder: Coder, workers: Optional[int]=None, use_threads: Optional[bool]=None):
+        if not coder.frozen:
+            raise ValueError("batch encoding needs a frozen coder: workers must not see it change")
+        self.coder = coder
+        self.workers = workers if workers is not None else (os.cpu_count() or 1)
+        self.use_threads = free_threaded() if use_threads is None else use_threads
+        self._executor: Optional[Executor] = None
+
+    def _get_executor(self) -> Executor:
+        if self._executor is None:
+            if self.use_threads:
+                self._executor = ThreadPoolExecutor(self.workers)
+            else:
+                self._executor = ProcessPoolExecutor(self.workers, initializer=_init_worker, initargs=(self.coder,))
+        return self._executor
+
+    def encode(self, docs: Sequence[INPUT_SYMBOL_SEQUENCE_TYPE]) -> List[List[TOKEN_TYPE]]:
+        if self.workers == 1:
+            return [self.coder.encode(doc, learn=False) for doc in docs]
+        executor = self._get_executor()
+        if self.use_threads:
+            return list(executor.map(lambda doc: self.coder.encode(doc, learn=False), docs))
+        chunksize = max(1, len(docs) // (4 * self.workers))
+        return list(executor.map(_encode_in_worker, docs, chunksize=chunksize))
+
+    def close(self) -> None:
+        if self._executor is not None:
+            self._executor.shutdown()
+            self._executor = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+
+def encode_batch(coder: Coder, docs: Sequence[INPUT_SYMBOL_SEQUENCE_TYPE], workers: Optional[int]=None,
+                 use_threads: Optional[bool]=None) -> List[List[TOKEN_TYPE]]:
+    with BatchEncoder(coder, workers, use_threads) as encoder:
+        return encoder.encode(docs)
+
+
+class ParallelDecoder:
+    '''
+    decodes one long token stream of a flat coder on several threads.
+
+    Token i is decoded in the context of token i - 1 (or of EMPTY_TOKEN for
+    non-hierarchical coders), so the stream alone says how to decode each
+    token: there is no sequential dependency. We split the stream into one
+    range per worker and
+    1. look up the expansion length of every token, summed per range,
+    2. prefix sum the range lengths into output offsets,
+    3. fill the output, every range into its own slice of one buffer.
+    A NativeCoder does 1. and 3. in native code without the GIL, so the ranges
+    really run in parallel. A FlatCoder only does when Python is free-threaded,
+    and otherwise runs the same passes on the calling thread.
+    '''
+    coder: FlatCoder
+    workers: int
+
+    def __init__(self, coder: FlatCoder, workers: Optional[int]=None, use_threads: Optional[bool]=None):
+        self.coder = coder
+        self.workers = workers if workers is not None else (os.cpu_count() or 1)
+        self.native = isinstance(coder, NativeCoder)
+        self.use_threads = (self.native or free_threaded()) if use_threads is None else use_threads
+        self._executor: Optional[ThreadPoolExecutor] = None
+
+    def _map(self, fn, items):
+        if not self.use_threads or self.workers == 1 or len(items) == 1:
+            return [fn(item) for item in items]
+        if self._executor is None:
+            self._executor = ThreadPoolExecutor(self.workers)
+        return list(self._executor.map(fn, items))
+
+    def _ranges(self, tokens) -> List[Tuple[int, int, TOKEN_TYPE]]:
+        # (start, end, context of the first token) for each worker.
+        n = len(tokens)
+        parts = max(1, min(self.workers, n))
+        bounds = [n * i // parts for i in range(parts + 1)]
+        hierarchical = self.coder.hierarchical
+        return [(start, end, tokens[start - 1] if hierarchical and start > 0 else EMPTY_TOKEN)
+                for start, end in zip(bounds, bounds[1:])]
+
+    def _nodes(self, tokens, start: int, end: int, context: TOKEN_TYPE) -> List[int]:
+        find_node, hierarchical = self.coder.find_node, self.coder.hierarchical
+        nodes = []
+        for i in range(start, end):
+            nodes.append(find_node(context, tokens[i]))
+            if hierarchical:
+                context = tokens[i]
+        return nodes
+
+    def decode_into(self, to_decode, out) -> int:
+        '''
+        decodes the int32 tokens to_decode into the writable int32 buffer out,
+        and returns the decoded length. If that is more than len(out), the
+        output is incomplete and the call should be repeated with a larger
+        buffer.
+        '''
+        tokens = memoryview(to_decode)
+        out = memoryview(out)
+        ranges = self._ranges(tokens)
+        coder = self.coder
+        if self.native and len(ranges) == 1:
+            # nothing to split: one pass instead of measuring first.
+            return coder.decode_range_into(tokens, EMPTY_TOKEN, out)
+
+        if self.native:
+            lengths = self._map(lambda r: coder.decode_range_into(tokens[r[0]:r[1]], r[2], out[:0]), ranges)
+        else:
+            node_length = coder.node_length
+            range_nodes = self._map(lambda r: self._nodes(tokens, *r), ranges)
+            lengths = [sum(node_length[node] for node in nodes) for nodes in range_nodes]
+
+        offsets = [0]
+        for length in lengths:
+            offsets.append(offsets[-1] + length)
+        if offsets[-1] > len(out):
+            return offsets[-1]
+
+        if self.native:
+            self._map(lambda i: coder.decode_range_into(tokens[ranges[i][0]:ranges[i][1]], ranges[i][2],
+                                                        out[offsets[i]:offsets[i + 1]]), range(len(ranges)))
+        else:
+            node_offset, node_length, expansion = coder.node_offset, coder.node_length, coder.expansion
+
+            def fill(i):
+                k = offsets[i]
+                for node in range_nodes[i]:
+                    offset, length = node_offset[node], node_length[node]
+                    out[k:k + length] = expansion[offset:offset + length]
+                    k += length
+            self._map(fill, range(len(ranges)))
+        return offsets[-1]
+
+    def decode(self, to_decode: List[TOKEN_TYPE]) -> List[TOKEN_TYPE]:
+        tokens = to_decode if isinstance(to_decode, (array, memoryview)) else array('i', to_decode)
+        out = array('i', bytes(4 * 4 * (len(tokens) + 1)))
+        length = self.decode_into(tokens, out)
+        if length > len(out):
+            out = array('i', bytes(4 * length))
+            self.decode_into(tokens, out)
+        return self.coder._from_symbols(out[:length].tolist())
+
+    def close(self) -> None:
+        if self._executor is not None:
+            self._executor.shutdown()
+            self._executor = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+
+def encode_range(coder: Coder, symbols, start: int, context: TOKEN_TYPE, limit: int) -> Tuple[List[TOKEN_TYPE], List[int]]:
+    '''
+    greedy encode of the (already mapped) symbols from start in context, up to
+    the first token boundary at or after limit, with any frozen coder. Returns
+    the tokens and where each starts, followed by where the last one ends.
+    '''
+    if isinstance(coder, NativeCoder):
+        return coder.encode_range(symbols, start, context, limit)
+    hierarchical = coder.hierarchical
+    limit = min(limit, len(symbols))
+    tokens, starts = [], []
+    position = start
+    while position < limit:
+        if isinstance(coder, FlatCoder):
+            length, token = coder.encode_one_token(symbols[position:], context)
+        else:
+            prefix, token = (coder.encode_one_token(symbols[position:], context) if hierarchical
+                             else coder.encode_one_token(symbols[position:]))
+            length = len(prefix)
+        if length == 0 and context == EMPTY_TOKEN:
+            raise ValueError("could not match any tokens: did you mean to enable learning?")
+        tokens.append(token)
+        starts.append(position)
+        if hierarchical:
+            context = token
+        position += length
+    starts.append(position)
+    return tokens, starts
+
+
+@dataclass
+class SpeculationStats:
+    chunks: int = 0
+    # chunks whose speculative parse the real one ran into.
+    converged: int = 0
+    # symbols the real parse had to redo sequentially before it converged.
+    resync_symbols: int = 0
+
+
+class SpeculativeEncoder:
+    '''
+    greedy encode of one long input on several threads, with exactly the
+    output of the single-threaded encode.
+
+    Greedy parses resynchronize quickly: started at different offsets, they
+    soon agree on the token boundaries (and contexts). So every chunk but the
+    first is parsed in parallel from a guessed start, the EMPTY_TOKEN context
+    at the chunk's first symbol. Then we walk the chunks in order: where the
+    real parse enters a chunk it is at some (position, context) state, and
+    continues sequentially, window by window, until it reaches a state the
+    speculative parse also went through. From there on the two are the same
+    and we take the speculative tokens. A chunk that never converges is simply
+    parsed sequentially, so the worst case is the single-threaded encode.
+
+    The chunks run on threads, which only run at the same time for a
+    NativeCoder (native code without the GIL) or on free-threaded Python.
+    '''
+    coder: Coder
+    workers: int
+    stats: SpeculationStats
+
+    def __init__(self, coder: Coder, workers: Optional[int]=None, min_chunk: int=1 << 14, window: int=64):
+        if not coder.frozen:
+            raise ValueError("speculative encoding needs a frozen coder: chunks are parsed concurrently")
+        self.coder = coder
+        self.workers = workers if workers is not None else (os.cpu_count() or 1)
+        self.min_chunk = min_chunk
+        self.window = window
+        self.stats = SpeculationStats()
+        self._executor: Optional[ThreadPoolExecutor] = None
+
+    def _speculate(self, symbols, start: int, end: int) -> Tuple[List[TOKEN_TYPE], List[int]]:
+        # a parse that fails (e.g. runs into a context that was never learned)
+        # just gives up: the real parse will cover the rest.
+        try:
+            return encode_range(self.coder, symbols, start, EMPTY_TOKEN, end)
+        except ValueError:
+            return [], [start]
+
+    def _find_state(self, tokens: List[TOKEN_TYPE], starts: List[int], position: int, context: TOKEN_TYPE) -> int:
+        # index of the speculative token parsed from (position, context), or -1.
+        # starts is sorted, and only EMPTY_TOKEN shares its start with the next token.
+        i = bisect_left(starts, position, 0, len(tokens))
+        while i < len(tokens) and starts[i] == position:
+            before = EMPTY_TOKEN if i == 0 or not self.coder.hierarchical else tokens[i - 1]
+            if before == context:
+                return i
+            i += 1
+        return -1
+
+    def encode(self, to_encode: INPUT_SYMBOL_SEQUENCE_TYPE, learn: bool=False) -> List[TOKEN_TYPE]:
+        symbols = self.coder._to_symbols(to_encode, learn)
+        n = len(symbols)
+        parts = max(1, min(self.workers, n // self.min_chunk))
+        bounds = [n * i // parts for i in range(parts + 1)]
+        if parts == 1 and isinstance(self.coder, NativeCoder):
+            out = array('i', bytes(4 * (2 * n + 1)))
+            return out[:self.coder.encode_into(symbols, out)].tolist()
+        if parts == 1:
+            return encode_range(self.coder, symbols, 0, EMPTY_TOKEN, n)[0]
+
+        if self._executor is None:
+            self._executor = ThreadPoolExecutor(self.workers)
+        # the first chunk starts from the real state, so its parse is final.
+        futures = [self._executor.submit(encode_range, self.coder, symbols, 0, EMPTY_TOKEN, bounds[1])]
+        futures += [self._executor.submit(self._speculate, symbols, start, end) for start, end in zip(bounds[1:], bounds[2:])]
+        self.stats.chunks += parts
+
+        encoded, starts = futures[0].result()
+        position = starts[-1]
+        context = encoded[-1] if self.coder.hierarchical and encoded else EMPTY_TOKEN
+        for j in range(1, parts):
+            tokens, spec_starts = futures[j].result()
+            end = bounds[j + 1]
+            resync_from = position
+            i = -1
+            while position < end:
+                i = self._find_state(tokens, spec_starts, position, context)
+                if i >= 0:
+                    self.stats.converged += 1
+                    break
+                more, more_starts = encode_range(self.coder, symbols, position, context, min(position + self.window, end))
+                encoded += more
+                position = more_starts[-1]
+                if self.coder.hierarchical and more:
+                    context = more[-1]
+            self.stats.resync_symbols += min(position, end) - resync_from
+            if i >= 0:
+                encoded += tokens[i:]
+                position = spec_starts[-1]
+                context = tokens[-1] if self.coder.hierarchical else EMPTY_TOKEN
+        return encoded
+
+    def close(self) -> None:
+        if self._executor is not None:
+            self._executor.shutdown()
+            self._executor = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+
+__all__ = ["BatchEncoder", "encode_batch", "ParallelDecoder", "SpeculativeEncoder", "SpeculationStats",
+           "encode_range", "free_threaded"]
@@ -0,0 +1,107 @@
+from typing import Callable, Dict, List, Optional, Tuple, Union
+import math
+
+from .lz import Coder, LZCoder, HierachicalLZCoder, EMPTY_TOKEN, TOKEN_TYPE, INPUT_SYMBOL_SEQUENCE_TYPE, context_coders, token_usage
+
+
+# Optimal parsing. Greedy encoding takes the longest match in the current
+# context, but for a hierarchical coder the token we pick is also the context
+# for the next step, so a shorter match can pay off if it leads to a context
+# with better matches. Here the state is (position, context), every entry of
+# the context that matches at the position moves us to (position + its length,
+# entry), and EMPTY_TOKEN moves us to (position, EMPTY_TOKEN) at the cost of a
+# token. Positions only move forward, so we can go through them in order,
+# keeping the best way into each state, and only the beam_width cheapest
+# contexts per position (or all of them, for an exact search).
+#
+# The output is an ordinary token stream, decoded with the coder's decode.
+
+COST_TYPE = Callable[[TOKEN_TYPE, TOKEN_TYPE], float]
+
+
+def token_count(context: TOKEN_TYPE, token: TOKEN_TYPE) -> float:
+    return 1.0
+
+
+def estimated_bits(coder: Coder, sample: INPUT_SYMBOL_SEQUENCE_TYPE) -> COST_TYPE:
+    '''
+    cost of a token as -log2 of its probability in its context, estimated from
+    how often greedy encoding of sample uses it (add-one smoothed).
+    '''
+    usage = token_usage(coder, sample)
+    coders = context_coders(coder)
+    totals = {context: sum(counts.values()) + len(coders[context].encoded_vocab) for context, counts in usage.items()}
+
+    def cost(context: TOKEN_TYPE, token: TOKEN_TYPE) -> float:
+        return math.log2(totals[context] / (usage[context].get(token, 0) + 1))
+    return cost
+
+
+def optimal_parse(coder: Union[LZCoder, HierachicalLZCoder], to_encode: INPUT_SYMBOL_SEQUENCE_TYPE,
+                  beam_width: Optional[int]=16, cost: COST_TYPE=token_count) -> List[TOKEN_TYPE]:
+    '''
+    encodes to_encode with the cheapest token sequence the (not learning)
+    coder can decode, where cost(context, token) is the price of each token:
+    the token count by default, or e.g. estimated_bits. beam_width=None
+    searches exactly, over every context at every position.
+    '''
+    symbols = coder._to_symbols(to_encode)
+    n = len(symbols)
+    hierarchical = coder.hierarchical
+    coders = context_coders(coder)
+
+    # best[position][context] = (cost, previous position, previous context, token)
+    best: List[Optional[Dict[TOKEN_TYPE, Tuple[float, int, TOKEN_TYPE, TOKEN_TYPE]]]] = [None] * (n + 1)
+    best[0] = {EMPTY_TOKEN: (0.0, -1, EMPTY_TOKEN, EMPTY_TOKEN)}
+
+    for p in range(n):
+        layer = best[p]
+        if layer is None:
+            continue
+        if beam_width is not None and len(layer) > beam_width:
+            kept = sorted(layer.items(), key=lambda item: item[1][0])[:beam_width]
+            layer = best[p] = dict(kept)
+
+        if hierarchical:
+            # hand over to the EMPTY_TOKEN context from the cheapest other one.
+            escapes = [(total + cost(context, EMPTY_TOKEN), context) for context, (total, _, _, _) in layer.items()
+                       if context != EMPTY_TOKEN and context in coders]
+            if escapes:
+                total, context = min(escapes)
+                if EMPTY_TOKEN not in layer or total < layer[EMPTY_TOKEN][0]:
+                    layer[EMPTY_TOKEN] = (total, p, context, EMPTY_TOKEN)
+
+        rest = symbols[p:]
+        for context, (total, _, _, _) in layer.items():
+            if context not in coders:
+                continue
+            for prefix, token in coders[context].token_map.prefixes(rest):
+                if token == EMPTY_TOKEN:
+                    continue
+                q = p + len(prefix)
+                next_context = token if hierarchical else EMPTY_TOKEN
+                if q < n and next_context not in coders:
+                    # nothing can follow a token whose context was never learned.
+                    continue
+                new_total = total + cost(context, token)
+                target = best[q]
+                if target is None:
+                    target = best[q] = {}
+                if next_context not in target or new_total < target[next_context][0]:
+                    target[next_context] = (new_total, p, context, token)
+
+    if best[n] is None:
+        raise ValueError("could not match any tokens: did you mean to enable learning?")
+
+    # walk the back pointers from the cheapest final state.
+    context = min(best[n], key=lambda c: best[n][c][0])
+    p = n
+    tokens = []
+    while p > 0 or context != EMPTY_TOKEN:
+        _, p, context, token = best[p][context]
+        tokens.append(token)
+    tokens.reverse()
+    return tokens
+
+
+__all__ = ["optimal_parse", "estimated_bits", "token_count"]
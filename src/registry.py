@@ -0,0 +1,168 @@
+from typing import Callable, Dict, List, Optional, Type, Union
+from collections import OrderedDict
+from contextlib import contextmanager
+from dataclasses import dataclass
+import os
+import threading
+import time
+
+from .lz import TOKEN_TYPE, INPUT_SYMBOL_SEQUENCE_TYPE
+from .flat import FlatCoder
+from .serving import CoderVersion
+
+
+# Many tenants, each with its own frozen coder in the flat layout (see
+# dump_flat). Opening one is a file mapping, so it is cheap but not free, and
+# every open coder holds on to its mapping (address space, and page cache the
+# kernel will not drop while we keep touching it). The registry opens coders
+# on first use and keeps the most recently used ones open within a byte budget.
+#
+# Requests pin the coder they use, just like HotSwapCoder versions: a coder
+# that falls out of the LRU while requests are using it is only closed when
+# the last of them unpins it.
+
+
+@dataclass
+class RegistryStats:
+    hits: int = 0
+    misses: int = 0
+    evictions: int = 0
+    load_seconds: float = 0.0
+    max_load_seconds: float = 0.0
+
+    @property
+    def hit_rate(self) -> float:
+        requests = self.hits + self.misses
+        return self.hits / requests if requests else 0.0
+
+    @property
+    def mean_load_seconds(self) -> float:
+        return self.load_seconds / self.misses if self.misses else 0.0
+
+
+class DictionaryRegistry:
+    '''
+    frozen coders of many tenants, opened from their files on demand and kept
+    open least-recently-used first within budget bytes (of mapped files). A
+    tenant's file is what register() said, or else path(tenant), by default
+    <directory>/<tenant>.flat. coder_class can be NativeCoder.
+    '''
+    budget: int
+    loaded_bytes: int
+    stats: RegistryStats
+
+    def __init__(self, budget: int, directory: Optional[Union[str, os.PathLike]]=None,
+                 path: Optional[Callable[[str], Union[str, os.PathLike]]]=None, coder_class: Type[FlatCoder]=FlatCoder):
+        if path is None and directory is not None:
+            path = lambda tenant: os.path.join(directory, f"{tenant}.flat")
+        self.budget = budget
+        self.coder_class = coder_class
+        self._path = path
+        self._paths: Dict[str, Union[str, os.PathLike]] = {}
+        self._lock = threading.Lock()
+        self._loaded: "OrderedDict[str, CoderVersion]" = OrderedDict()
+        self.loaded_bytes = 0
+        self.stats = RegistryStats()
+
+    def register(self, tenant: str, path: Union[str, os.PathLike]) -> None:
+        with self._lock:
+            self._paths[tenant] = path
+
+    def path(self, tenant: str) -> Union[str, os.PathLike]:
+        if tenant in self._paths:
+            return self._paths[tenant]
+        if self._path is None:
+            raise KeyError(tenant)
+        return self._path(tenant)
+
+    @property
+    def loaded(self) -> List[str]:
+        # least recently used first.
+        with self._lock:
+            return list(self._loaded)
+
+    def pin(self, tenant: str) -> CoderVersion:
+        with self._lock:
+            entry = self._pin_loaded(tenant)
+            if entry is not None:
+                return entry
+            path = self.path(tenant)
+        # opening checks the whole file (see FlatCoder), so do it without the
+        # lock: requests for other tenants go on meanwhile.
+        start = time.perf_counter()
+        coder = self.coder_class.open(path)
+        elapsed = time.perf_counter() - start
+        with self._lock:
+            # another request may have opened the tenant while we did.
+            entry = self._pin_loaded(tenant)
+            if entry is None:
+                self.stats.misses += 1
+                self.stats.load_seconds += elapsed
+                self.stats.max_load_seconds = max(self.stats.max_load_seconds, elapsed)
+                entry = self._loaded[tenant] = CoderVersion(coder, self.stats.misses)
+                entry.pins += 1
+                self.loaded_bytes += coder.nbytes
+                self._evict_over_budget()
+                return entry
+        coder.close()
+        return entry
+
+    def _pin_loaded(self, tenant: str) -> Optional[CoderVersion]:
+        entry = self._loaded.get(tenant)
+        if entry is not None:
+            self.stats.hits += 1
+            self._loaded.move_to_end(tenant)
+            entry.pins += 1
+        return entry
+
+    def unpin(self, pinned: CoderVersion) -> None:
+        with self._lock:
+            pinned.pins -= 1
+            release = pinned.retired and pinned.pins == 0
+        if release:
+            pinned.release()
+
+    @contextmanager
+    def pinned(self, tenant: str):
+        pinned = self.pin(tenant)
+        try:
+            yield pinned.coder
+        finally:
+            self.unpin(pinned)
+
+    def evict(self, tenant: str) -> bool:
+        # e.g. after the tenant's file was replaced: the next request reopens it.
+        with self._lock:
+            if tenant not in self._loaded:
+                return False
+            self._retire(tenant)
+            return True
+
+    def _evict_over_budget(self) -> None:
+        # the most recently used coder stays, even on its own over budget.
+        while self.loaded_bytes > self.budget and len(self._loaded) > 1:
+            self._retire(next(iter(self._loaded)))
+            self.stats.evictions += 1
+
+    def _retire(self, tenant: str) -> None:
+        entry = self._loaded.pop(tenant)
+        self.loaded_bytes -= entry.coder.nbytes
+        entry.retired = True
+        if entry.pins == 0:
+            entry.release()
+
+    def close(self) -> None:
+        with self._lock:
+            for tenant in list(self._loaded):
+                self._retire(tenant)
+
+    def encode(self, tenant: str, to_encode: INPUT_SYMBOL_SEQUENCE_TYPE) -> List[TOKEN_TYPE]:
+        with self.pinned(tenant) as coder:
+            return coder.encode(to_encode, learn=False)
+
+    def decode(self, tenant: str, to_decode: List[TOKEN_TYPE]) -> List[TOKEN_TYPE]:
+        with self.pinned(tenant) as coder:
+            return coder.decode(to_decode)
+
+
+__all__ = ["DictionaryRegistry", "RegistryStats"]
@@ -0,0 +1,104 @@
+from typing import Any, Callable, List, Optional, Union
+from contextlib import contextmanager
+import os
+import threading
+
+from .lz import Coder, TOKEN_TYPE, INPUT_SYMBOL_SEQUENCE_TYPE
+from .flat import FlatCoder
+
+
+class CoderVersion:
+    coder: Coder
+    version: int
+    pins: int
+    retired: bool
+
+    def __init__(self, coder: Coder, version: int):
+        self.coder = coder
+        self.version = version
+        self.pins = 0
+        self.retired = False
+
+    def release(self) -> None:
+        # closes flat coders, which unmaps their file once no view is left.
+        close = getattr(self.coder, "close", None)
+        if close is not None:
+            close()
+        self.coder = None
+
+
+class HotSwapCoder:
+    '''
+    holds the current version of a frozen coder for a long running service.
+
+    Readers pin the current version for the duration of a request, and keep
+    using it even if a new version is swapped in meanwhile. Swapping is a single
+    reference assignment, so new requests see the new version immediately, and
+    the old version is released when its last reader unpins it. The lock is only
+    held to count pins, never while encoding, so a reload does not stall encoders.
+    '''
+    _current: Optional[CoderVersion]
+
+    def __init__(self, coder: Optional[Coder]=None):
+        self._lock = threading.Lock()
+        self._current = None
+        self._next_version = 0
+        if coder is not None:
+            self.swap(coder)
+
+    @property
+    def version(self) -> int:
+        return self._current.version if self._current is not None else -1
+
+    def swap(self, coder: Coder) -> int:
+        with self._lock:
+            new = CoderVersion(coder, self._next_version)
+            self._next_version += 1
+            old, self._current = self._current, new
+            release = old is not None and old.pins == 0
+            if old is not None:
+                old.retired = True
+        if release:
+            old.release()
+        return new.version
+
+    def load(self, path: Union[str, os.PathLike]) -> int:
+        # memory-mapping is O(1), the pages are shared with every other process
+        # serving the same file and are faulted in by the first requests.
+        return self.swap(FlatCoder.open(path))
+
+    def pin(self) -> CoderVersion:
+        with self._lock:
+            current = self._current
+            if current is None:
+                raise ValueError("no coder loaded")
+            current.pins += 1
+        return current
+
+    def unpin(self, pinned: CoderVersion) -> None:
+        with self._lock:
+            pinned.pins -= 1
+            release = pinned.retired and pinned.pins == 0
+        if release:
+            pinned.release()
+
+    @contextmanager
+    def pinned(self):
+        pinned = self.pin()
+        try:
+            yield pinned.coder
+        finally:
+            self.unpin(pinned)
+
+    def encode(self, to_encode: INPUT_SYMBOL_SEQUENCE_TYPE) -> List[TOKEN_TYPE]:
+        with self.pinned() as coder:
+            return coder.encode(to_encode, learn=False)
+
+    def decode(self, to_decode: List[TOKEN_TYPE]) -> List[TOKEN_TYPE]:
+        # tokens are only meaningful for the version that produced them, so a
+        # caller decoding across a reload should pin that version itself.
+        with self.pinned() as coder:
+            return coder.decode(to_decode)
+
+
+__all__ = ["HotSwapCoder", "CoderVersion"]
@@ -0,0 +1,89 @@
+from typing import Optional, Type
+from multiprocessing.shared_memory import SharedMemory
+import mmap
+import os
+
+from .lz import Coder
+from .flat import FlatCoder, to_flat_bytes
+
+
+# Publishing a frozen coder to multiprocessing workers through shared memory:
+# the parent writes the flat layout (see flat.py) into a segment once, and each
+# worker maps the same pages and reads the dictionaries in place. Attaching is
+# O(1) and the dictionaries are not copied into every worker, unlike pickling.
+
+
+class SharedCoderSegment:
+    '''
+    owns the shared memory segment holding a published coder. The segment is
+    removed by close(), so keep this alive as long as workers may attach.
+    '''
+    shm: SharedMemory
+
+    def __init__(self, coder: Coder, name: Optional[str]=None):
+        data = to_flat_bytes(coder)
+        self.shm = SharedMemory(name=name, create=True, size=len(data))
+        self.shm.buf[:len(data)] = data
+
+    @property
+    def name(self) -> str:
+        return self.shm.name
+
+    def close(self) -> None:
+        if self.shm is not None:
+            self.shm.close()
+            self.shm.unlink()
+            self.shm = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+
+class _AttachedSegment:
+    '''
+    a segment mapped by name, without SharedMemory: before python 3.13,
+    SharedMemory registers every segment it opens with the resource tracker
+    as if we owned it, so it may get unlinked when we exit. Unregistering
+    does not help, as workers share the publisher's tracker.
+    '''
+
+    def __init__(self, name: str):
+        import _posixshmem
+        fd = _posixshmem.shm_open(name if name.startswith("/") else "/" + name, os.O_RDWR, mode=0o600)
+        try:
+            self._mmap = mmap.mmap(fd, os.fstat(fd).st_size)
+        finally:
+            os.close(fd)
+        self.buf = memoryview(self._mmap)
+
+    def close(self) -> None:
+        if self.buf is not None:
+            self.buf.release()
+            self.buf = None
+            self._mmap.close()
+
+
+def _open_segment(name: str):
+    try:
+        return SharedMemory(name=name, track=False)
+    except TypeError:
+        pass
+    if os.name != "posix":
+        # only posix segments are tracked.
+        return SharedMemory(name=name)
+    return _AttachedSegment(name)
+
+
+def attach(name: str, coder_class: Type[FlatCoder]=FlatCoder) -> FlatCoder:
+    '''
+    maps a published coder. close() on the returned coder detaches from the
+    segment. coder_class can be NativeCoder to encode natively in place.
+    '''
+    shm = _open_segment(name)
+    return coder_class(shm.buf, owner=shm)
+
+
+__all__ = ["SharedCoderSegment", "attach"]
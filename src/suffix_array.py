@@ -0,0 +1,256 @@
+from typing import Dict, List, Sequence, Tuple
+from array import array
+
+from .lz import TOKEN_TYPE
+from .native import build_suffix_array, native_available
+
+
+# Suffix array (SA-IS) and LCP array (Kasai) over byte or token id sequences.
+#
+# SA-IS classifies every suffix as S (smaller than the suffix after it) or L
+# (larger). The leftmost S suffixes of each run (LMS) split the text into LMS
+# substrings: we sort those with one round of induced sorting, give equal ones
+# the same name, and if any names repeat, recursively sort the string of names.
+# Once the LMS suffixes are in order, two more induced sorting passes put all
+# the other suffixes in place. Everything is linear time.
+#
+# The arrays are kept as array('i') (or 'q' past 2^31 symbols), so a suffix
+# array takes 4 bytes per symbol instead of a Python int object per entry, and
+# the symbols themselves are stored as dense ids in the smallest typecode that
+# fits.
+#
+# Construction runs in lznative.c when the native backend is available (same
+# algorithms, on int32 arrays, 15 to 30 times faster). The Python code below is
+# the fallback, and works on arrays of the index typecode too, so even there
+# the temporaries are a few machine words per symbol.
+
+COUNTS_TYPE = Dict[Tuple[TOKEN_TYPE, ...], int]
+
+
+def _induce(s: array, t: bytearray, bucket_starts: array, lms: array) -> array:
+    n = len(s)
+    sa = array(s.typecode, [-1]) * n
+    k = len(bucket_starts) - 1
+
+    # LMS suffixes go to the ends of their buckets, keeping their order.
+    tail = bucket_starts[1:]
+    for i in reversed(lms):
+        c = s[i]
+        tail[c] -= 1
+        sa[tail[c]] = i
+
+    # L suffixes from the front of their buckets, left to right...
+    head = bucket_starts[:k]
+    for i in range(n):
+        j = sa[i] - 1
+        if j >= 0 and not t[j]:
+            c = s[j]
+            sa[head[c]] = j
+            head[c] += 1
+
+    # ...then S suffixes from the back, right to left.
+    tail = bucket_starts[1:]
+    for i in range(n - 1, -1, -1):
+        j = sa[i] - 1
+        if j >= 0 and t[j]:
+            c = s[j]
+            tail[c] -= 1
+            sa[tail[c]] = j
+    return sa
+
+
+def _sais(s: array, k: int) -> array:
+    # s holds ids in [0, k), and ends with a 0 that occurs nowhere else.
+    n = len(s)
+    typecode = s.typecode
+    if n == 1:
+        return array(typecode, [0])
+
+    t = bytearray(n)
+    t[n - 1] = 1
+    for i in range(n - 2, -1, -1):
+        t[i] = 1 if s[i] < s[i + 1] or (s[i] == s[i + 1] and t[i + 1]) else 0
+
+    counts = array(typecode, [0]) * k
+    for c in s:
+        counts[c] += 1
+    bucket_starts = array(typecode, [0]) * (k + 1)
+    for c in range(k):
+        bucket_starts[c + 1] = bucket_starts[c] + counts[c]
+
+    lms = array(typecode, [i for i in range(1, n) if t[i] and not t[i - 1]])
+    is_lms = bytearray(n)
+    for i in lms:
+        is_lms[i] = 1
+
+    # sort the LMS substrings and name them.
+    sa = _induce(s, t, bucket_starts, lms)
+    names = array(typecode, [-1]) * n
+    name = -1
+    previous = -1
+    for p in sa:
+        if not is_lms[p]:
+            continue
+        if previous < 0 or not _same_lms_substring(s, t, is_lms, previous, p):
+            name += 1
+        names[p] = name
+        previous = p
+    reduced = array(typecode, [names[p] for p in lms])
+    del names
+
+    if name + 1 < len(lms):
+        reduced_sa = _sais(reduced, name + 1)
+    else:
+        reduced_sa = array(typecode, [0]) * len(lms)
+        for i, c in enumerate(reduced):
+            reduced_sa[c] = i
+    return _induce(s, t, bucket_starts, array(typecode, [lms[i] for i in reduced_sa]))
+
+
+def _same_lms_substring(s: array, t: bytearray, is_lms: bytearray, a: int, b: int) -> bool:
+    n = len(s)
+    if a == n - 1 or b == n - 1:
+        # the sentinel is unique.
+        return False
+    i = 0
+    while True:
+        a_end = i > 0 and is_lms[a + i]
+        b_end = i > 0 and is_lms[b + i]
+        if a_end and b_end:
+            return True
+        if a_end != b_end or s[a + i] != s[b + i] or t[a + i] != t[b + i]:
+            return False
+        i += 1
+
+
+def _index_typecode(n: int) -> str:
+    return 'i' if n < (1 << 31) else 'q'
+
+
+class SuffixArray:
+    '''
+    suffix array and LCP array of a sequence of symbols (bytes, or any ints).
+    sa[i] is the start of the i-th smallest suffix, lcp[i] the length of the
+    longest common prefix of suffixes sa[i - 1] and sa[i] (lcp[0] is 0).
+    '''
+    alphabet: List[TOKEN_TYPE]
+    ids: array
+    sa: array
+    lcp: array
+
+    def __init__(self, symbols: Sequence[TOKEN_TYPE]):
+        if isinstance(symbols, str):
+            symbols = symbols.encode()
+        if isinstance(symbols, (bytes, bytearray)) or (isinstance(symbols, memoryview) and symbols.format == 'B'):
+            # a byte translation table instead of a dict lookup per byte.
+            symbols = bytes(symbols)
+            self.alphabet = [c for c in range(256) if c in symbols]
+            if len(self.alphabet) < 256:
+                table = bytearray(256)
+                for i, c in enumerate(self.alphabet):
+                    table[c] = i + 1
+                self.ids = array('B', symbols.translate(table))
+            else:
+                self.ids = array('i', [c + 1 for c in symbols])
+        else:
+            self.alphabet = sorted(set(symbols))
+            rank = {c: i + 1 for i, c in enumerate(self.alphabet)}
+            self.ids = array('B' if len(self.alphabet) < 256 else 'i', [rank[c] for c in symbols])
+
+        n = len(self.ids)
+        k = len(self.alphabet) + 1
+        if n < (1 << 31) - 1 and native_available():
+            self.sa, self.lcp = build_suffix_array(self.ids, k)
+            return
+        typecode = _index_typecode(n + 1)
+        # 0 is the sentinel, smaller than every symbol.
+        s = array(typecode, self.ids)
+        s.append(0)
+        self.sa = _sais(s, k)[1:]
+        self.lcp = _kasai(self.ids, self.sa)
+
+    def __len__(self) -> int:
+        return len(self.sa)
+
+    def nbytes(self) -> int:
+        return sum(a.itemsize * len(a) for a in [self.ids, self.sa, self.lcp])
+
+    def substring(self, start: int, length: int) -> Tuple[TOKEN_TYPE, ...]:
+        alphabet = self.alphabet
+        return tuple(alphabet[c - 1] for c in self.ids[start:start + length])
+
+    def count(self, pattern: Sequence[TOKEN_TYPE]) -> int:
+        # number of occurrences of pattern, by binary search over the suffixes.
+        if isinstance(pattern, str):
+            pattern = pattern.encode()
+        rank = {c: i + 1 for i, c in enumerate(self.alphabet)}
+        if any(c not in rank for c in pattern):
+            return 0
+        key = [rank[c] for c in pattern]
+        return self._bound(key, upper=True) - self._bound(key, upper=False)
+
+    def _bound(self, key: List[int], upper: bool) -> int:
+        # first suffix whose first len(key) ids are > key (or >= key).
+        ids, sa, m = self.ids, self.sa, len(key)
+        lo, hi = 0, len(sa)
+        while lo < hi:
+            mid = (lo + hi) // 2
+            prefix = ids[sa[mid]:sa[mid] + m].tolist()
+            if prefix < key or (upper and prefix == key):
+                lo = mid + 1
+            else:
+                hi = mid
+        return lo
+
+    def frequent_substrings(self, min_count: int=2, max_length: int=32, min_length: int=2) -> COUNTS_TYPE:
+        '''
+        occurrence counts (overlapping) of every substring of min_length to
+        max_length symbols that occurs at least min_count times.
+
+        Every repeated substring is the common prefix of a run of adjacent
+        suffixes (an lcp-interval), and occurs once per suffix of the run. We
+        find the runs with a stack over the LCP array: a run of lcp h whose
+        parent run has lcp p stands for its substrings of length p+1 to h.
+        '''
+        assert min_count >= 2, "substrings that occur once are not lcp-intervals"
+        sa, lcp, n = self.sa, self.lcp, len(self.sa)
+        counts: COUNTS_TYPE = {}
+        stack = [(0, 0)]  # (lcp, left end)
+        for i in range(1, n + 1):
+            current = lcp[i] if i < n else 0
+            left = i - 1
+            while stack[-1][0] > current:
+                h, left = stack.pop()
+                count = i - left
+                if count >= min_count:
+                    parent = max(current, stack[-1][0])
+                    longest = self.substring(sa[left], min(h, max_length))
+                    for length in range(max(parent + 1, min_length), len(longest) + 1):
+                        counts[longest[:length]] = count
+            if stack[-1][0] < current:
+                stack.append((current, left))
+        return counts
+
+
+def _kasai(ids: Sequence[int], sa: array) -> array:
+    n = len(sa)
+    rank = array(sa.typecode, [0]) * n
+    for i, p in enumerate(sa):
+        rank[p] = i
+    lcp = array(sa.typecode, [0]) * n
+    h = 0
+    for p in range(n):
+        r = rank[p]
+        if r > 0:
+            q = sa[r - 1]
+            while p + h < n and q + h < n and ids[p + h] == ids[q + h]:
+                h += 1
+            lcp[r] = h
+            if h > 0:
+                h -= 1
+        else:
+            h = 0
+    return lcp
+
+
+__all__ = ["SuffixArray"]
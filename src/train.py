@@ -0,0 +1,327 @@
+from typing import Any, Callable, Dict, Iterable, List, Optional, Set, Tuple, Union
+from dataclasses import dataclass
+import json
+import os
+import random
+import time
+
+from .lz import (Coder, LZCoder, HierachicalLZCoder, Alphabet, EMPTY_TOKEN, TOKEN_TYPE,
+                 INPUT_SYMBOL_SEQUENCE_TYPE, CODEPOINT_INPUT, ensure_buffer, token_usage)
+
+
+# Checkpoints are an append-only JSON lines file. The first line describes the
+# coder, and every following line holds only what changed since the line before
+# it: the dictionary entries that were added (in creation order, read off the
+# coder's entry_log), any new input symbols, and where in the input we were.
+# Since the dictionaries never forget an entry, replaying all the lines in order
+# rebuilds the exact learner state, including which tokens are still unused.
+#
+# Each entry is stored as [context, token, parent token, last symbol]: every
+# entry extends an existing entry of the same context by one symbol, so this is
+# enough to recover the whole prefix. If an entry ever has no parent we fall back
+# to [context, token, None, prefix].
+
+
+def _input_coder(coder: Coder) -> LZCoder:
+    if isinstance(coder, HierachicalLZCoder):
+        return coder.coders[EMPTY_TOKEN]
+    return coder
+
+
+def _context_coder(coder: Coder, context: TOKEN_TYPE) -> LZCoder:
+    if isinstance(coder, HierachicalLZCoder):
+        if context not in coder.coders:
+            return coder._new_coder(context)
+        return coder.coders[context]
+    return coder
+
+
+class Checkpointer:
+    coder: Coder
+    path: str
+    watermark: int
+    saved_input_vocab: Set[TOKEN_TYPE]
+    saved_alphabet: int
+
+    def __init__(self, coder: Coder, path: Union[str, os.PathLike], append: bool=False):
+        self.coder = coder
+        self.path = path
+        if append:
+            # the coder was loaded from this file: only write what comes next.
+            self.watermark = len(coder.entry_log)
+            self.saved_input_vocab = set(_input_coder(coder).input_vocab)
+            self.saved_alphabet = len(coder.alphabet) if coder.alphabet is not None else 0
+            _drop_torn_record(path)
+        else:
+            self.watermark = 0
+            self.saved_input_vocab = set()
+            self.saved_alphabet = 0
+            header = {
+                "type": "hierarchical" if isinstance(coder, HierachicalLZCoder) else "lz",
+                "output_vocab_size": coder.vocab_size if isinstance(coder, HierachicalLZCoder) else coder.vocab_size - 1,
+                "input_mode": coder.input_mode,
+            }
+            with open(path, 'w') as f:
+                f.write(json.dumps(header) + "\n")
+                f.flush()
+                os.fsync(f.fileno())
+
+    def write(self, position: int, context: TOKEN_TYPE=EMPTY_TOKEN) -> None:
+        coder = self.coder
+        entries = []
+        for entry_context, token in coder.entry_log[self.watermark:]:
+            lz = _context_coder(coder, entry_context)
+            prefix = lz.encoded_vocab[token]
+            parent = lz.token_map.get(prefix[:-1])
+            # a warm started dictionary need not be prefix-closed, and the parent
+            # may have been learned after the entry: then it is not there yet
+            # when the checkpoint is replayed.
+            if parent is not None and lz.entry_seq[parent] < lz.entry_seq[token]:
+                entries.append([entry_context, token, parent, prefix[-1]])
+            else:
+                entries.append([entry_context, token, None, list(prefix)])
+
+        record = {"position": position, "context": context, "entries": entries}
+
+        input_vocab = _input_coder(coder).input_vocab
+        if len(input_vocab) != len(self.saved_input_vocab):
+            new_symbols = input_vocab - self.saved_input_vocab
+            record["input_vocab"] = sorted(new_symbols)
+            self.saved_input_vocab |= new_symbols
+        if coder.alphabet is not None and len(coder.alphabet) != self.saved_alphabet:
+            record["alphabet"] = coder.alphabet.symbols[self.saved_alphabet:]
+            self.saved_alphabet = len(coder.alphabet)
+
+        with open(self.path, 'a') as f:
+            f.write(json.dumps(record) + "\n")
+            f.flush()
+            os.fsync(f.fileno())
+        self.watermark += len(entries)
+
+
+def _drop_torn_record(path: Union[str, os.PathLike]) -> None:
+    # a crash in the middle of a write leaves a last line without a newline.
+    with open(path, 'rb+') as f:
+        data = f.read()
+        end = data.rfind(b"\n") + 1
+        if end != len(data):
+            f.truncate(end)
+
+
+def load_checkpoint(path: Union[str, os.PathLike]) -> Tuple[Coder, int, TOKEN_TYPE]:
+    '''
+    rebuilds the coder saved by a Checkpointer, and returns it together with the
+    input position and context to resume training from.
+    '''
+    with open(path, 'r') as f:
+        lines = f.read().split("\n")
+    # the last element is either empty or a torn record.
+    lines = lines[:-1]
+
+    header = json.loads(lines[0])
+    cls = HierachicalLZCoder if header["type"] == "hierarchical" else LZCoder
+    coder = cls(header["output_vocab_size"], input_vocab=set(), input_mode=header["input_mode"])
+
+    position, context = 0, EMPTY_TOKEN
+    for line in lines[1:]:
+        record = json.loads(line)
+        for entry_context, token, parent, symbol in record["entries"]:
+            target = _context_coder(coder, entry_context)
+            if parent is not None:
+                prefix = target.encoded_vocab[parent] + (symbol,)
+            else:
+                prefix = tuple(symbol)
+            target._add_new_token(prefix, token)
+        _input_coder(coder).input_vocab.update(record.get("input_vocab", []))
+        for c in record.get("alphabet", []):
+            coder.alphabet.add(c)
+        position, context = record["position"], record["context"]
+
+    return coder, position, context
+
+
+def train(coder: Coder, to_encode: INPUT_SYMBOL_SEQUENCE_TYPE, checkpoint_path: Optional[Union[str, os.PathLike]]=None,
+          checkpoint_every: int=1 << 16, position: int=0, context: TOKEN_TYPE=EMPTY_TOKEN, append: bool=False) -> Coder:
+    '''
+    same as coder.encode(to_encode, learn=True), except that the tokens are not
+    kept, and the learner state is checkpointed to checkpoint_path after roughly
+    every checkpoint_every input symbols (and at the end).
+    position and context say where to start, see resume_training.
+    '''
+    checkpointer = Checkpointer(coder, checkpoint_path, append=append) if checkpoint_path is not None else None
+    hierarchical = isinstance(coder, HierachicalLZCoder)
+
+    to_encode = coder._to_symbols(to_encode, learn=True)
+    last_checkpoint = position
+    while position < len(to_encode):
+        if hierarchical:
+            prefix, token = coder.encode_one_token(to_encode[position:], context, learn=True)
+            if len(prefix) == 0 and context == EMPTY_TOKEN:
+                raise ValueError("could not match any tokens: the output dictionary is full!")
+            context = token
+        else:
+            prefix, token = coder.encode_one_token(to_encode[position:], learn=True)
+            if len(prefix) == 0:
+                raise ValueError("could not match any tokens: the output dictionary is full!")
+        position += len(prefix)
+
+        if checkpointer is not None and position - last_checkpoint >= checkpoint_every:
+            checkpointer.write(position, context)
+            last_checkpoint = position
+
+    if checkpointer is not None:
+        checkpointer.write(position, context)
+    return coder
+
+
+def resume_training(checkpoint_path: Union[str, os.PathLike], to_encode: INPUT_SYMBOL_SEQUENCE_TYPE, checkpoint_every: int=1 << 16) -> Coder:
+    coder, position, context = load_checkpoint(checkpoint_path)
+    return train(coder, to_encode, checkpoint_path, checkpoint_every, position, context, append=True)
+
+
+# Sampled training. Dictionary quality saturates long before the whole corpus
+# has been seen, so we train on a sample of fixed-size blocks up to a byte
+# budget. Blocks are reservoir sampled (one pass, any corpus size), either over
+# the whole corpus or per stratum with each stratum getting its share of the
+# budget, so small sources are not drowned out by large ones. The sampled
+# blocks are trained on in corpus order.
+
+
+def _blocks(document: Union[str, bytes], block_size: int) -> Iterable[bytes]:
+    data = document.encode() if isinstance(document, str) else bytes(document)
+    for start in range(0, len(data), block_size):
+        yield data[start:start + block_size]
+
+
+class _Reservoir:
+    # algorithm R: after n items, each one is in the sample with probability k / n.
+
+    def __init__(self, k: int, rng: random.Random):
+        self.k = k
+        self.rng = rng
+        self.sample: List[Tuple[Tuple[int, int], bytes]] = []
+        self.n = 0
+
+    def add(self, item: Tuple[Tuple[int, int], bytes]) -> None:
+        if len(self.sample) < self.k:
+            self.sample.append(item)
+        else:
+            j = self.rng.randrange(self.n + 1)
+            if j < self.k:
+                self.sample[j] = item
+        self.n += 1
+
+
+def _shares(sizes: List[int], k: int) -> List[int]:
+    # k blocks split in proportion to sizes, at least one for every nonempty
+    # stratum while there are fewer than k of them, never more than k in total
+    # and never more than a stratum has.
+    total = sum(sizes)
+    nonempty = [i for i, n in enumerate(sizes) if n > 0]
+    if len(nonempty) >= k:
+        largest = set(sorted(nonempty, key=lambda i: -sizes[i])[:k])
+        return [1 if i in largest else 0 for i in range(len(sizes))]
+    shares = [min(n, max(1, k * n // total)) if n > 0 else 0 for n in sizes]
+    # the minimum of one can take us over k: take back from the largest...
+    while sum(shares) > k:
+        shares[max(nonempty, key=lambda i: shares[i])] -= 1
+    # ...and rounding down under it: top up whoever is furthest below their share.
+    while sum(shares) < k:
+        below = [i for i in nonempty if shares[i] < sizes[i]]
+        if not below:
+            break
+        shares[max(below, key=lambda i: k * sizes[i] - shares[i] * total)] += 1
+    return shares
+
+
+def sample_blocks(documents: Iterable[Union[str, bytes]], budget: int, block_size: int=4096,
+                  strata: Optional[Callable[[int, Union[str, bytes]], Any]]=None, seed: int=0) -> List[bytes]:
+    '''
+    up to budget bytes of blocks sampled uniformly from documents. With strata,
+    a function of (document index, document), the budget is split between the
+    strata in proportion to their size, and each is sampled separately. Blocks
+    are cut down to the budget if they are larger.
+    '''
+    if budget < 1 or block_size < 1:
+        raise ValueError("the budget and block size must be positive")
+    rng = random.Random(seed)
+    # so that even a single block fits the budget.
+    block_size = min(block_size, budget)
+    k = budget // block_size
+
+    # one reservoir of the whole budget per stratum (just one without strata),
+    # cut down to its share once we know how many blocks each stratum has.
+    # Blocks are numbered (document index, block index), so that the sample
+    # sorts back into corpus order.
+    reservoirs: Dict[Any, _Reservoir] = {}
+    for i, document in enumerate(documents):
+        key = strata(i, document) if strata is not None else None
+        reservoir = reservoirs.get(key)
+        if reservoir is None:
+            reservoir = reservoirs[key] = _Reservoir(k, rng)
+        for j, block in enumerate(_blocks(document, block_size)):
+            reservoir.add(((i, j), block))
+
+    groups = list(reservoirs.values())
+    sample = []
+    if strata is None:
+        for reservoir in groups:
+            sample += reservoir.sample
+    else:
+        for reservoir, share in zip(groups, _shares([r.n for r in groups], k)):
+            sample += rng.sample(reservoir.sample, share)
+
+    sample.sort()
+    return [block for _, block in sample]
+
+
+def held_out_tokens(coder: Coder, held_out: INPUT_SYMBOL_SEQUENCE_TYPE) -> int:
+    '''
+    how many tokens the coder needs for held_out without learning anything.
+    Unlike encode(learn=False) this never fails: contexts the coder has not
+    learned just fall back to the EMPTY_TOKEN context.
+    '''
+    return sum(sum(counts.values()) for counts in token_usage(coder, held_out).values())
+
+
+@dataclass
+class SampleReport:
+    sample_bytes: int
+    train_seconds: float
+    held_out_bytes: int
+    held_out_tokens: int
+
+    @property
+    def bytes_per_token(self) -> float:
+        return self.held_out_bytes / self.held_out_tokens if self.held_out_tokens > 0 else 0.0
+
+
+def sampled_training(documents: Iterable[Union[str, bytes]], budget: int, held_out: Union[str, bytes],
+                     make_coder: Optional[Callable[[], Coder]]=None, block_size: int=4096,
+                     strata: Optional[Callable[[int, Union[str, bytes]], Any]]=None, seed: int=0) -> Tuple[Coder, SampleReport]:
+    '''
+    trains a new coder (by default a HierachicalLZCoder with a 4096 token vocab
+    over bytes) on a sample of budget bytes of documents, see sample_blocks,
+    and reports how well it compresses held_out.
+    Every block starts from the EMPTY_TOKEN context, like a separate document.
+    With a CODEPOINT_INPUT coder the blocks (cut at byte offsets) are decoded
+    as UTF-8, dropping the characters split at their ends, and held_out (a
+    str) is measured in code points rather than bytes.
+    '''
+    if make_coder is None:
+        make_coder = lambda: HierachicalLZCoder(output_vocab_size=4096, input_vocab=set(range(256)))
+    coder = make_coder()
+    blocks = sample_blocks(documents, budget, block_size, strata, seed)
+
+    start = time.perf_counter()
+    for block in blocks:
+        coder.encode(block.decode(errors="ignore") if coder.input_mode == CODEPOINT_INPUT else block, learn=True)
+    train_seconds = time.perf_counter() - start
+
+    held_out_symbols = len(ensure_buffer(held_out, coder.input_mode))
+    report = SampleReport(sum(len(block) for block in blocks), train_seconds, held_out_symbols, held_out_tokens(coder, held_out))
+    return coder, report
+
+
+__all__ = ["Checkpointer", "load_checkpoint", "train", "resume_training",
+           "sample_blocks", "held_out_tokens", "sampled_training", "SampleReport"]
@@ -0,0 +1,29 @@
+import random
+from src.lz import LZCoder, HierachicalLZCoder
+
+
+# helpers shared by the tests: import them with `from test.conftest import ...`.
+
+WORDS = ["abra", "cadabra", "hocus", "pocus", "the", "cat", " ", " "]
+
+
+def random_text(n, seed=0):
+    rng = random.Random(seed)
+    return "".join(rng.choice(WORDS) for _ in range(n))
+
+
+def _trained(cls, text, vocab, input_vocab, freeze):
+    # learns from the bytes of text unless input_vocab is given.
+    coder = cls(output_vocab_size=vocab, input_vocab=set(text.encode()) if input_vocab is None else input_vocab)
+    coder.encode(text, learn=True)
+    if freeze:
+        coder.freeze()
+    return coder
+
+
+def trained(text, vocab=256, input_vocab=None, freeze=False) -> LZCoder:
+    return _trained(LZCoder, text, vocab, input_vocab, freeze)
+
+
+def trained_hierarchical(text, vocab=256, input_vocab=None, freeze=False) -> HierachicalLZCoder:
+    return _trained(HierachicalLZCoder, text, vocab, input_vocab, freeze)
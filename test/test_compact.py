@@ -0,0 +1,98 @@
+import pickle
+import random
+import pytest
+from src.lz import LZCoder, HierachicalLZCoder, CODEPOINT_INPUT
+from src.compact import MAGIC, dumps, loads, loads_flat, dump, load
+from test.conftest import random_text
+
+
+def contexts(coder):
+    return coder.coders if isinstance(coder, HierachicalLZCoder) else {-1: coder}
+
+
+def assert_same_dictionaries(a, b):
+    assert type(a) == type(b)
+    assert contexts(a).keys() == contexts(b).keys()
+    for context in contexts(a):
+        x, y = contexts(a)[context], contexts(b)[context]
+        assert x.encoded_vocab == y.encoded_vocab
+        assert x.unused_tokens == y.unused_tokens
+        assert x.input_vocab == y.input_vocab
+        assert len(x.token_map) == len(y.token_map)
+
+
+@pytest.mark.parametrize("compression", [None, "zlib", "lzma"])
+def test_roundtrip(compression):
+    text = random_text(400)
+    lz = LZCoder(output_vocab_size=512, input_vocab=set(text.encode()))
+    lz.encode(text, learn=True)
+    hlz = HierachicalLZCoder(output_vocab_size=128, input_vocab=set(text.encode()))
+    hlz.encode(text, learn=True)
+
+    for coder in [lz, hlz]:
+        data = dumps(coder, compression)
+        loaded = loads(data)
+        assert_same_dictionaries(coder, loaded)
+        assert loaded.encode(text) == coder.encode(text)
+        assert loads_flat(data).encode(text) == coder.encode(text)
+        assert len(data) < len(pickle.dumps(coder))
+
+    # a loaded coder can keep learning where the original stopped
+    more = random_text(100, seed=1)
+    loaded = loads(dumps(hlz))
+    assert loaded.encode(more, learn=True) == hlz.encode(more, learn=True)
+
+
+def test_codepoints_and_files(tmp_path):
+    text = "日本語のテキスト 日本語のテキスト 🎉🎉"
+    coder = HierachicalLZCoder(output_vocab_size=64, input_mode=CODEPOINT_INPUT)
+    coder.encode(text, learn=True)
+    dump(coder, tmp_path / "coder.hlz", compression="zlib")
+    loaded = load(tmp_path / "coder.hlz")
+    assert loaded.alphabet.symbols == coder.alphabet.symbols
+    assert loaded.encode(text) == coder.encode(text)
+    assert "".join(map(chr, loaded.decode(loaded.encode(text)))) == text
+
+    with pytest.raises(ValueError):
+        loads(b"not a coder")
+
+@pytest.mark.parametrize("compression", [None, "zlib", "lzma"])
+def test_truncated_and_corrupt_data(compression):
+    text = random_text(100)
+    coder = HierachicalLZCoder(output_vocab_size=64, input_vocab=set(text.encode()))
+    coder.encode(text, learn=True)
+    data = dumps(coder, compression)
+    for end in range(len(data) - 1, -1, -1 if compression is None else -7):
+        with pytest.raises(ValueError):
+            loads(data[:end])
+        with pytest.raises(ValueError):
+            loads_flat(data[:end])
+    with pytest.raises(ValueError):
+        loads(data[:8] + bytes([9]) + data[9:])
+
+def test_corruption_fuzz():
+    # any single corrupt byte either loads into a working coder or raises ValueError.
+    text = random_text(150)
+    hlz = HierachicalLZCoder(output_vocab_size=64, input_vocab=set(text.encode()))
+    hlz.encode(text, learn=True)
+    cjk = "日本語のテキスト 日本語"
+    lz = LZCoder(output_vocab_size=64, input_mode=CODEPOINT_INPUT)
+    lz.encode(cjk, learn=True)
+    rng = random.Random(0)
+    for coder, sample in [(hlz, text[:50]), (lz, cjk)]:
+        data = dumps(coder)
+        for _ in range(1500):
+            corrupt = bytearray(data)
+            i = rng.randrange(len(MAGIC) + 1, len(data))
+            corrupt[i] = rng.choice([b for b in range(256) if b != data[i]])
+            for load_fn in [loads, loads_flat]:
+                try:
+                    loaded = load_fn(bytes(corrupt))
+                except ValueError:
+                    continue
+                try:
+                    tokens = loaded.encode(sample)
+                except ValueError:
+                    continue
+                expected = list(map(ord, sample)) if coder.input_mode == CODEPOINT_INPUT else list(sample.encode())
+                assert loaded.decode(tokens) == expected
@@ -0,0 +1,71 @@
+import random
+from src.lz import HierachicalLZCoder, LZCoder, CODEPOINT_INPUT
+from src.dedup import DedupEncoder, chunk_boundaries
+
+
+def random_bytes(n, seed=0):
+    rng = random.Random(seed)
+    return bytes(rng.choice(b"abcdefgh ") for _ in range(n))
+
+
+def test_chunk_boundaries_sizes():
+    data = random_bytes(20000)
+    boundaries = chunk_boundaries(data, min_size=64, avg_size=256, max_size=1024)
+    assert boundaries[-1] == len(data)
+    start = 0
+    for end in boundaries[:-1]:
+        assert 64 <= end - start <= 1024
+        start = end
+
+
+def test_chunk_boundaries_resynchronize():
+    data = random_bytes(20000)
+    shifted = b"inserted" + data
+    original = set(chunk_boundaries(data, 64, 256, 1024))
+    moved = set(b - len(b"inserted") for b in chunk_boundaries(shifted, 64, 256, 1024))
+    # all but the first couple of chunks should line up again
+    assert len(original & moved) >= len(original) - 2
+
+
+def test_dedup_roundtrip_and_hits():
+    training = random_bytes(5000, seed=1)
+    coder = HierachicalLZCoder(output_vocab_size=256, input_vocab=set(training))
+    coder.encode(training, learn=True)
+
+    dedup = DedupEncoder(coder, min_chunk=32, avg_chunk=128, max_chunk=512)
+    doc = random_bytes(3000, seed=2)
+
+    first = dedup.encode(doc)
+    assert bytes(coder.decode(first)) == doc
+    assert dedup.stats.hits == 0
+
+    second = dedup.encode(doc)
+    assert second == first
+    assert dedup.stats.hits == dedup.stats.chunks // 2
+    assert dedup.stats.hit_rate == 0.5
+
+
+def test_dedup_lz_coder():
+    training = random_bytes(2000, seed=3)
+    coder = LZCoder(output_vocab_size=512, input_vocab=set(training))
+    coder.encode(training, learn=True)
+
+    dedup = DedupEncoder(coder, min_chunk=32, avg_chunk=64, max_chunk=256, max_cache_entries=4)
+    doc = random_bytes(1000, seed=4)
+    assert bytes(dedup.decode(dedup.encode(doc))) == doc
+    assert len(dedup.cache) <= 4
+
+def test_dedup_codepoint_coder():
+    rng = random.Random(5)
+    text = "".join(rng.choice("猫犬鳥の ab") for _ in range(3000))
+    coder = HierachicalLZCoder(output_vocab_size=256, input_vocab=set(map(ord, text)), input_mode=CODEPOINT_INPUT)
+    coder.encode(text, learn=True)
+    coder.freeze()
+
+    dedup = DedupEncoder(coder, min_chunk=32, avg_chunk=128, max_chunk=512)
+    doc = text[500:2000]
+    tokens = dedup.encode(doc)
+    assert "".join(map(chr, dedup.decode(tokens))) == doc
+    assert dedup.stats.symbols == len(doc)
+    assert dedup.encode(doc) == tokens
+    assert dedup.stats.hits > 0
@@ -0,0 +1,70 @@
+import random
+import pytest
+from src.entropy import FrequencyTable, MAX_PRECISION, normalize, rans_encode, rans_decode, read_varint, write_varint
+
+
+def test_normalize():
+    freq = normalize([100, 0, 3, 0, 50], 8)
+    assert sum(freq) == 256 and min(freq) == 1
+    assert freq[0] > freq[4] > freq[2]
+    assert sum(normalize([0, 0, 0], 4)) == 16
+    with pytest.raises(ValueError):
+        normalize([1] * 20, 4)
+
+def test_rans_round_trip():
+    rng = random.Random(0)
+    counts = [rng.randrange(1000) ** 2 for _ in range(300)]
+    table = FrequencyTable.from_counts(counts)
+    symbols = rng.choices(range(300), weights=counts, k=5000) + [counts.index(min(counts))]
+    data = rans_encode(table, symbols)
+    decoded, end = rans_decode(table, data + b"tail", len(symbols))
+    assert decoded == symbols and end == len(data)
+    # within a few percent of the entropy under the table.
+    assert len(data) * 8 < 1.02 * sum(table.bits(s) for s in symbols) + 64
+
+    copy = FrequencyTable.from_bytes(table.to_bytes())
+    assert copy.precision == table.precision and copy.freq == table.freq
+    assert rans_decode(copy, data, len(symbols))[0] == symbols
+
+def test_precision_is_bounded():
+    precision = MAX_PRECISION + 1
+    with pytest.raises(ValueError):
+        normalize([1, 2, 3], precision)
+    with pytest.raises(ValueError):
+        FrequencyTable([1 << (precision - 1)] * 2, precision)
+    with pytest.raises(ValueError):
+        FrequencyTable([], 0)
+    data = bytes([precision]) + write_varint(2) + write_varint(1 << (precision - 1)) * 2
+    with pytest.raises(ValueError):
+        FrequencyTable.from_bytes(data)
+
+def test_rans_rejects_corrupt_streams():
+    table = FrequencyTable.from_counts([5, 1, 1, 9])
+    data = rans_encode(table, [0, 3, 3, 1, 2] * 20)
+    with pytest.raises(ValueError):
+        rans_decode(table, data[:-1], 100)
+    with pytest.raises(ValueError):
+        rans_decode(table, data, 99)
+
+def test_varint():
+    for value in [0, 1, 127, 128, 300, 1 << 40]:
+        data = write_varint(value)
+        assert read_varint(b"x" + data, 1) == (value, 1 + len(data))
+    with pytest.raises(ValueError):
+        read_varint(b"\x80", 0)
+
+@pytest.mark.parametrize("lanes", [1, 2, 4, 5, 8])
+def test_rans_lanes(lanes):
+    rng = random.Random(lanes)
+    counts = [rng.randrange(100) ** 2 for _ in range(50)]
+    table = FrequencyTable.from_counts(counts)
+    for n in [0, 1, lanes - 1, 1001]:
+        symbols = rng.choices(range(50), weights=[c + 1 for c in counts], k=n)
+        data = rans_encode(table, symbols, lanes)
+        assert len(data) >= 4 * lanes
+        assert rans_decode(table, data, len(symbols), lanes=lanes) == (symbols, len(data))
+    if lanes > 1:
+        with pytest.raises(ValueError):
+            rans_decode(table, data, len(symbols), lanes=1)
+    with pytest.raises(ValueError):
+        rans_encode(table, symbols, 0)
@@ -0,0 +1,99 @@
+import struct
+import pytest
+from src.lz import LZCoder, HierachicalLZCoder, EMPTY_TOKEN, BYTE_INPUT, CODEPOINT_INPUT
+from src.flat import FlatCoder, to_flat_bytes, flat_bytes_from_vocabs, dump_flat, HEADER_FIELDS, NO_TOKEN
+from test.conftest import random_text, trained_hierarchical
+
+
+def test_flat_lz_matches_coder():
+    text = random_text(300)
+    coder = LZCoder(output_vocab_size=256, input_vocab=set(text.encode()))
+    coder.encode(text, learn=True)
+    flat = FlatCoder(to_flat_bytes(coder))
+
+    other = random_text(200, seed=1)
+    encoded = coder.encode(other)
+    assert flat.encode(other) == encoded
+    assert flat.decode(encoded) == coder.decode(encoded)
+
+    with pytest.raises(ValueError):
+        flat.encode(other, learn=True)
+    with pytest.raises(ValueError):
+        flat.encode("z")
+
+
+def test_flat_hierarchical_matches_coder(tmp_path):
+    text = random_text(300, seed=2)
+    coder = trained_hierarchical(text, 128)
+    dump_flat(coder, tmp_path / "coder.flat")
+    flat = FlatCoder.open(tmp_path / "coder.flat")
+    assert flat.hierarchical
+
+    encoded = coder.encode(text)
+    assert flat.encode(text) == encoded
+    assert bytes(flat.decode(encoded)) == text.encode()
+    # EMPTY_TOKEN resets the context and decodes to nothing
+    assert flat.decode(encoded + [EMPTY_TOKEN] + encoded) == coder.decode(encoded + [EMPTY_TOKEN] + encoded)
+
+    flat.close()
+    with pytest.raises(ValueError):
+        flat.encode(text)
+
+
+def test_flat_codepoints():
+    text = "日本語のテキスト 日本語のテキスト 🎉🎉"
+    coder = HierachicalLZCoder(output_vocab_size=64, input_mode=CODEPOINT_INPUT)
+    coder.encode(text, learn=True)
+    flat = FlatCoder(to_flat_bytes(coder))
+    encoded = flat.encode(text)
+    assert encoded == coder.encode(text)
+    assert "".join(map(chr, flat.decode(encoded))) == text
+
+
+def test_flat_rejects_corrupt_buffers():
+    coder = trained_hierarchical(random_text(300, seed=3), 128)
+    good = to_flat_bytes(coder)
+    flat = FlatCoder(good)
+
+    def with_field(name, value):
+        out = bytearray(good)
+        struct.pack_into("<q", out, 8 + 8 * HEADER_FIELDS.index(name), value)
+        return bytes(out)
+
+    def with_int(array, index, value):
+        out = bytearray(good)
+        struct.pack_into("<i", out, flat.offsets[array] + 4 * index, value)
+        return bytes(out)
+
+    corrupt = [
+        good[:4], b"HLZFLAT9" + good[8:], good[:-4],
+        with_field("kind", 2), with_field("input_mode", 5), with_field("vocab_size", -1),
+        with_field("n_nodes", 1 << 40), with_field("edge_capacity", 12), with_field("edge_capacity", 8),
+        with_int("context_of", 0, flat.n_contexts), with_int("root", 0, -1),
+        with_int("context_start", 1, len(flat.node_token) + 1),
+        with_int("node_token", 0, -3), with_int("node_offset", 1, len(flat.expansion)),
+        with_int("edge_child", flat.edge_node.tolist().index(flat.root[0]), -1),
+    ]
+    for buffer in corrupt:
+        with pytest.raises(ValueError):
+            FlatCoder(buffer)
+
+    # a full edge table: lookups of missing edges must still end
+    full = bytearray(good)
+    edge_node = flat.offsets["edge_node"]
+    for slot, node in enumerate(flat.edge_node):
+        if node == -1:
+            struct.pack_into("<i", full, edge_node + 4 * slot, flat.root[0])
+            struct.pack_into("<i", full, flat.offsets["edge_symbol"] + 4 * slot, -7)
+    with pytest.raises(ValueError):
+        FlatCoder(bytes(full))
+    unchecked = FlatCoder(bytes(full), check=False)
+    assert unchecked.child(unchecked.root[0], 1 << 20) == -1
+
+
+def test_flat_prefix_nodes_are_not_tokens():
+    # "b" is only a prefix of "bc", so its trie node has no token
+    flat = FlatCoder(flat_bytes_from_vocabs(False, BYTE_INPUT, 2, [], {EMPTY_TOKEN: {0: (97,), 1: (98, 99)}}))
+    assert flat.decode(flat.encode(b"abca")) == list(b"abca")
+    with pytest.raises(KeyError):
+        flat.decode([NO_TOKEN])
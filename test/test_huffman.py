@@ -0,0 +1,83 @@
+import copy
+import random
+import pytest
+from src.lz import HierachicalLZCoder
+from src.flat import FlatCoder, to_flat_bytes
+from src.huffman import HuffmanTable, HuffmanTables, code_lengths, dump_tables, MAX_CODE_LENGTH
+from test.conftest import random_text
+
+
+def frozen_coder():
+    coder = HierachicalLZCoder(output_vocab_size=300, input_vocab=set(range(256)))
+    coder.encode(random_text(3000), learn=True)
+    coder.freeze()
+    return coder
+
+
+def test_code_lengths_are_limited_prefix_codes():
+    counts = {s: 2 ** s for s in range(30)}
+    lengths = code_lengths(counts, max_length=10)
+    assert max(lengths.values()) == 10
+    assert sum(2.0 ** -l for l in lengths.values()) <= 1.0
+    table = HuffmanTable(lengths)
+    codes = [format(code, f"0{length}b") for code, length in table.codes.values()]
+    assert not any(a != b and b.startswith(a) for a in codes for b in codes)
+    assert HuffmanTable.from_bytes(table.to_bytes())[0].lengths == lengths
+    assert code_lengths({7: 5}) == {7: 1}
+    with pytest.raises(ValueError):
+        HuffmanTable({0: 1, 1: 1, 2: 1})
+
+
+def test_tables_round_trip(tmp_path):
+    coder = frozen_coder()
+    tables = HuffmanTables.from_coder(coder, [random_text(2000, seed=s) for s in range(1, 4)])
+    assert len(tables.context_tables) > 0
+    # tokens and contexts never seen while fitting still round trip.
+    tokens = coder.encode(random_text(2000, seed=10)) + [coder.vocab_size - 1, -1, 5]
+    data = tables.encode(tokens)
+    assert tables.decode(data, len(tokens)) == (tokens, len(data))
+    assert tables.decode(b"xy" + data, len(tokens), offset=2) == (tokens, len(data) + 2)
+
+    dump_tables(tables, tmp_path / "coder.huff")
+    flat = FlatCoder(to_flat_bytes(coder))
+    loaded = HuffmanTables.open(tmp_path / "coder.huff", flat)
+    assert loaded.encode(tokens) == data
+    with pytest.raises(ValueError):
+        HuffmanTables.open(tmp_path / "coder.huff", HierachicalLZCoder(10, input_vocab=set(range(5))))
+    with pytest.raises(ValueError):
+        tables.decode(data[:len(data) // 2], len(tokens))
+    with pytest.raises(ValueError):
+        tables.encode([coder.vocab_size])
+
+
+def test_unused_codes_are_corrupt():
+    # global codes 00 and 01, so 1x is unused; in the EMPTY_TOKEN context, 1 escapes.
+    tables = HuffmanTables(1, HuffmanTable({0: 2, 1: 2}), {-1: HuffmanTable({0: 1, 2: 1})})
+    assert tables.decode(tables.encode([0, -1]), 2)[0] == [0, -1]
+    for data in [b"\xe0", b"\xc0"]:
+        with pytest.raises(ValueError):
+            tables.decode(data, 1)
+
+
+def test_context_tables_beat_the_global_table():
+    coder = frozen_coder()
+    train = [random_text(3000, seed=s) for s in range(1, 6)]
+    with_contexts = HuffmanTables.from_coder(coder, train)
+    global_only = HuffmanTables.from_coder(coder, train, min_count=10 ** 9)
+    assert global_only.context_tables == {}
+    tokens = coder.encode(random_text(3000, seed=20))
+    assert len(with_contexts.encode(tokens)) < len(global_only.encode(tokens))
+
+def test_tables_for_large_vocabs():
+    # the repo's default vocab: more tokens than codes of MAX_CODE_LENGTH bits.
+    rng = random.Random(0)
+    vocab_size = 4096
+    streams = [[min(vocab_size - 1, int(rng.paretovariate(0.7))) - 1 for _ in range(5000)] for _ in range(3)]
+    tables = HuffmanTables.from_tokens(streams, vocab_size)
+    assert tables.global_table.max_length > MAX_CODE_LENGTH
+    assert HuffmanTables.from_tokens([[1, 2, 3]], vocab_size).decode(b"", 0) == ([], 0)
+    tokens = streams[0][:1000] + [vocab_size - 1, -1, 0, vocab_size - 2]
+    data = tables.encode(tokens)
+    assert tables.decode(data, len(tokens)) == (tokens, len(data))
+    loaded = HuffmanTables.from_bytes(tables.to_bytes())
+    assert loaded.decode(data, len(tokens)) == (tokens, len(data))
@@ -1,6 +1,7 @@
 import pytest
-from src.lz import LZCoder, HierachicalLZCoder, ensure_list, EMPTY_TOKEN
+from src.lz import LZCoder, HierachicalLZCoder, DecodeTable, ensure_list, ensure_buffer, get_input_vocab, EMPTY_TOKEN, CODEPOINT_INPUT
 import math
+import mmap
 
 def test_basic_encode_decode():
     # Test with a simple string
@@ -216,3 +217,227 @@ def test_hierarchical_encode_repeated_compression():
     assert second_encoded_length < double_vocab_size_encoded_length
 
 
+
+def test_codepoint_input_mode():
+    text = "日本語のテキストと emoji 🎉🎉 mixed with english 日本語"
+    assert ensure_list(text, CODEPOINT_INPUT) == [ord(c) for c in text]
+
+    coder = LZCoder(output_vocab_size=512, input_mode=CODEPOINT_INPUT)
+    encoded = coder.encode(text, learn=True)
+    assert "".join(map(chr, coder.decode(encoded))) == text
+    # input symbols are remapped to dense ids
+    assert max(coder.input_vocab | set(s for p in coder.encoded_vocab.values() for s in p)) < len(set(text))
+
+    byte_coder = LZCoder(output_vocab_size=512)
+    assert len(encoded) < len(byte_coder.encode(text, learn=True))
+
+    with pytest.raises(ValueError):
+        coder.encode("未知", learn=False)
+
+def test_codepoint_input_mode_needs_str(tmp_path):
+    path = tmp_path / "input.txt"
+    path.write_text("日本語", encoding="utf-8")
+    coder = LZCoder(output_vocab_size=64, input_mode=CODEPOINT_INPUT)
+    for raw in [path, "日本語".encode(), memoryview(b"abc")]:
+        with pytest.raises(ValueError):
+            coder.encode(raw, learn=True)
+        with pytest.raises(ValueError):
+            get_input_vocab(raw, CODEPOINT_INPUT)
+    assert coder.encode(path.read_text(encoding="utf-8"), learn=True)
+
+def test_hierarchical_codepoint_input_mode():
+    text = "Привет мир! 你好世界! Привет мир! 你好世界!"
+    coder = HierachicalLZCoder(output_vocab_size=256, input_vocab=set(map(ord, text)), input_mode=CODEPOINT_INPUT)
+    assert len(coder.coders[EMPTY_TOKEN].input_vocab) == len(set(text))
+
+    encoded = coder.encode(text, learn=True)
+    assert "".join(map(chr, coder.decode(encoded))) == text
+    assert len(encoded) < len(text)
+
+    coder.update_vocab("😀")
+    assert len(coder.coders[EMPTY_TOKEN].input_vocab) == len(set(text)) + 1
+
+def test_hierarchical_update_vocab():
+    coder = HierachicalLZCoder(output_vocab_size=256)
+    coder.update_vocab("abc")
+    assert coder.coders[EMPTY_TOKEN].input_vocab == {97, 98, 99}
+    coder.update_vocab(b"ca\xff")
+    assert coder.coders[EMPTY_TOKEN].input_vocab == {97, 98, 99, 255}
+
+    coder = HierachicalLZCoder(output_vocab_size=256, input_mode=CODEPOINT_INPUT)
+    coder.update_vocab("b世😀")
+    # the coders see dense ids, one per code point.
+    assert coder.alphabet.symbols == [ord("b"), 0x4e16, 0x1f600]
+    assert coder.coders[EMPTY_TOKEN].input_vocab == {0, 1, 2}
+    coder.update_vocab("😀x")
+    assert coder.coders[EMPTY_TOKEN].input_vocab == {0, 1, 2, 3}
+
+def test_file_and_mmap_input(tmp_path):
+    text = b"abracadabra abracadabra abracadabra"
+    path = tmp_path / "input.txt"
+    path.write_bytes(text)
+
+    assert ensure_list(path) == list(text)
+    assert get_input_vocab(path) == set(text)
+
+    view = ensure_buffer(path)
+    assert isinstance(view, memoryview)
+    assert bytes(view) == text
+
+    coder = HierachicalLZCoder(output_vocab_size=64)
+    coder.update_vocab(path)
+    from_path = coder.encode(path, learn=True)
+
+    reference = HierachicalLZCoder(output_vocab_size=64)
+    reference.update_vocab(text)
+    assert from_path == reference.encode(text, learn=True)
+
+    with open(path, 'rb') as f:
+        mapped = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        assert coder.encode(mapped, learn=False) == coder.encode(text, learn=False)
+        assert bytes(coder.decode(from_path)) == text
+
+    lz = LZCoder(output_vocab_size=64, input_vocab=set(text))
+    assert lz.encode(path, learn=True) == LZCoder(output_vocab_size=64, input_vocab=set(text)).encode(text, learn=True)
+
+def test_snapshot_ignores_later_entries():
+    import copy
+    import random
+    rng = random.Random(0)
+    text = "".join(rng.choice(["abra", "cadabra", "hocus", "pocus", " "]) for _ in range(200))
+    more = "".join(rng.choice(["hocus", "cat", "pocus", " "]) for _ in range(200))
+
+    vocab = set((text + more).encode())
+    for coder in [LZCoder(output_vocab_size=256, input_vocab=vocab),
+                  HierachicalLZCoder(output_vocab_size=128, input_vocab=vocab)]:
+        coder.encode(text, learn=True)
+        frozen = copy.deepcopy(coder)
+        snapshot = coder.snapshot()
+
+        coder.encode(more, learn=True)
+        assert len(coder.entry_log) > snapshot.watermark
+
+        for sample in [text[:100], more[:100]]:
+            try:
+                expected = frozen.encode(sample)
+            except ValueError:
+                with pytest.raises(ValueError):
+                    snapshot.encode(sample)
+                continue
+            assert snapshot.encode(sample) == expected
+            assert snapshot.decode(expected) == list(sample.encode())
+
+        with pytest.raises(ValueError):
+            snapshot.encode(text, learn=True)
+
+def test_snapshot_readers_while_learning():
+    import random
+    import threading
+    rng = random.Random(1)
+    words = ["abra", "cadabra", "hocus", "pocus", "the", "cat", " "]
+    chunks = ["".join(rng.choice(words) for _ in range(50)) for _ in range(20)]
+    sample = "abracadabra hocus pocus the cat"
+
+    coder = HierachicalLZCoder(output_vocab_size=256, input_vocab=set(range(256)))
+    errors = []
+    done = threading.Event()
+
+    def learner():
+        for chunk in chunks:
+            coder.encode(chunk, learn=True)
+        done.set()
+
+    def reader():
+        while not done.is_set():
+            snapshot = coder.snapshot()
+            encoded = snapshot.encode(sample)
+            if bytes(snapshot.decode(encoded)) != sample.encode() or snapshot.encode(sample) != encoded:
+                errors.append(snapshot.watermark)
+
+    threads = [threading.Thread(target=learner)] + [threading.Thread(target=reader) for _ in range(3)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    assert errors == []
+
+def test_warm_start_copies_dictionary():
+    import random
+    rng = random.Random(2)
+    words = ["abra", "cadabra", "hocus", "pocus", "the", "cat", " "]
+    text = "".join(rng.choice(words) for _ in range(300))
+    vocab = set(text.encode())
+
+    for pretrained, size in [(LZCoder(output_vocab_size=512, input_vocab=vocab), 512),
+                             (HierachicalLZCoder(output_vocab_size=128, input_vocab=vocab), 128)]:
+        pretrained.encode(text, learn=True)
+        expected = pretrained.encode(text)
+        coder = type(pretrained).from_pretrained(pretrained)
+        assert coder.encode(text) == expected
+        assert coder.decode(expected) == list(text.encode())
+        assert len(coder.entry_log) == len(pretrained.entry_log)
+
+        # learning goes on in the capacity that is left, reusing no taken token.
+        coder = type(pretrained).from_pretrained(pretrained, output_vocab_size=size * 2, input_vocab=set(b"xyz"))
+        coder.encode("xyzzy the cat", learn=True)
+        assert coder.decode(coder.encode("xyzzy the cat")) == list(b"xyzzy the cat")
+
+def test_warm_start_smaller_vocab_and_eviction():
+    import random
+    rng = random.Random(3)
+    text = "".join(rng.choice(["abra", "cadabra", "hocus", "pocus", " "]) for _ in range(300))
+    domain = "".join(rng.choice(["hocus", "pocus", " "]) for _ in range(100))
+    vocab = set(text.encode())
+    pretrained = LZCoder(output_vocab_size=256, input_vocab=vocab)
+    pretrained.encode(text, learn=True)
+
+    def prefix_closed(coder):
+        return all(prefix[:-1] in coder.token_map for prefix in coder.encoded_vocab.values() if prefix)
+
+    small = LZCoder.from_pretrained(pretrained, output_vocab_size=64)
+    assert max(small.encoded_vocab) < 64
+    assert prefix_closed(small)
+    assert small.decode(small.encode(text)) == list(text.encode())
+
+    evicted = LZCoder.from_pretrained(pretrained, evict_fraction=0.5, sample=domain)
+    assert len(evicted.encoded_vocab) < len(pretrained.encoded_vocab)
+    assert prefix_closed(evicted)
+    assert evicted.input_vocab == pretrained.input_vocab
+    # the entries the domain sample uses are the ones kept.
+    assert evicted.encode(domain) == pretrained.encode(domain)
+    assert len(evicted.unused_tokens) == evicted.vocab_size - len(evicted.token_map)
+
+    hierarchical = HierachicalLZCoder(output_vocab_size=128, input_vocab=vocab)
+    hierarchical.encode(text, learn=True)
+    evicted = HierachicalLZCoder.from_pretrained(hierarchical, evict_fraction=0.5, sample=domain)
+    assert all(prefix_closed(lz) for lz in evicted.coders.values())
+    assert evicted.decode(evicted.encode(text)) == list(text.encode())
+    evicted.encode(text, learn=True)
+
+def test_decode_table():
+    import random
+    rng = random.Random(4)
+    text = "".join(rng.choice(["abra", "cadabra", "hocus", "pocus", " "]) for _ in range(300))
+    vocab = set(text.encode())
+    for coder in [LZCoder(output_vocab_size=256, input_vocab=vocab), HierachicalLZCoder(output_vocab_size=128, input_vocab=vocab)]:
+        encoded = coder.encode(text, learn=True)
+        # EMPTY_TOKEN decodes to nothing in any context.
+        encoded = encoded[:5] + [EMPTY_TOKEN] + coder.encode(text[:50])
+        expected = coder.decode(encoded)
+        for density in [0, 1 / 16, 2]:
+            table = DecodeTable(coder, density)
+            assert table.decode(encoded) == expected
+            assert table.decode([]) == []
+            for bad in [[coder.vocab_size + 5], [-7], [0, 1, 2, 3, 0, 1, 2, 3, 0, 1]]:
+                try:
+                    reference = coder.decode(bad)
+                except KeyError:
+                    with pytest.raises(KeyError):
+                        table.decode(bad)
+                else:
+                    assert table.decode(bad) == reference
+        coder.freeze()
+        assert coder.decode(encoded) == expected
+        if coder.hierarchical:
+            # built by freeze, decode only reads it.
+            assert coder._decode_table is not None
@@ -0,0 +1,74 @@
+import random
+import pytest
+from src.lz import LZCoder, HierachicalLZCoder, CODEPOINT_INPUT
+from src.machine import StateMachineCoder
+from src.offline import build_dictionary
+from test.conftest import random_text
+
+
+def test_machine_matches_greedy_encode():
+    text = random_text(500)
+    lz = LZCoder(output_vocab_size=256, input_vocab=set(text.encode()))
+    lz.encode(text, learn=True)
+    for coder in [lz, HierachicalLZCoder(output_vocab_size=64, input_vocab=set(text.encode()))]:
+        coder.encode(text, learn=True)
+        coder.freeze()
+        machine = StateMachineCoder(coder)
+        for seed in range(5):
+            sample = random_text(100, seed)
+            try:
+                expected = coder.encode(sample)
+            except ValueError:
+                with pytest.raises(ValueError):
+                    machine.encode(sample)
+                continue
+            assert machine.encode(sample) == expected
+            assert machine.decode(expected) == list(sample.encode())
+        assert machine.encode("") == []
+        with pytest.raises(ValueError):
+            machine.encode("xyz")
+        with pytest.raises(ValueError):
+            machine.encode(text, learn=True)
+
+def test_machine_with_full_byte_vocab_and_codepoints():
+    text = random_text(300)
+    coder = HierachicalLZCoder(output_vocab_size=512, input_vocab=set(range(256)))
+    coder.encode(text, learn=True)
+    coder.freeze()
+    machine = StateMachineCoder(coder)
+    assert machine.encode(text) == coder.encode(text)
+    assert machine.encode(text.encode()) == coder.encode(text.encode())
+
+    text = "".join(random.Random(1).choice(["猫", "犬", "鳥", "の", " "]) for _ in range(200))
+    coder = HierachicalLZCoder(output_vocab_size=64, input_vocab=set(map(ord, text)), input_mode=CODEPOINT_INPUT)
+    coder.encode(text, learn=True)
+    coder.freeze()
+    machine = StateMachineCoder(coder)
+    assert machine.encode(text) == coder.encode(text)
+    assert "".join(map(chr, machine.decode(machine.encode(text)))) == text
+
+def test_machine_needs_prefix_closed_dictionary():
+    text = random_text(300)
+    with pytest.raises(ValueError):
+        StateMachineCoder(build_dictionary(text, 64))
+
+def test_machine_without_unknown_column():
+    coder = LZCoder(output_vocab_size=512, input_vocab=set(range(256)))
+    coder.encode(random_text(100), learn=True)
+    coder.freeze()
+    machine = StateMachineCoder(coder)
+    assert machine.n_columns == 256
+    assert machine.encode(bytes(range(256))) == coder.encode(bytes(range(256)))
+    with pytest.raises(ValueError):
+        machine.encode([300])
+
+def test_machine_needs_frozen_coder_and_bounds_table():
+    text = random_text(300)
+    coder = LZCoder(output_vocab_size=256, input_vocab=set(text.encode()))
+    coder.encode(text, learn=True)
+    with pytest.raises(ValueError):
+        StateMachineCoder(coder)
+    coder.freeze()
+    machine = StateMachineCoder(coder)
+    with pytest.raises(ValueError):
+        StateMachineCoder(coder, max_bytes=machine.nbytes // 2)
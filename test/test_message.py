@@ -0,0 +1,88 @@
+import random
+import pytest
+from src.lz import HierachicalLZCoder, CODEPOINT_INPUT
+from src.flat import FlatCoder, to_flat_bytes
+from src.native import NativeCoder, native_available
+from src.entropy import FrequencyTable, write_varint
+from src.message import MessageCodec
+from test.conftest import random_text, trained, trained_hierarchical
+
+
+def frozen_coder(hierarchical=True):
+    text = random_text(400)
+    if hierarchical:
+        return trained_hierarchical(text, input_vocab=set(range(256)), freeze=True), text
+    return trained(text, 512, input_vocab=set(range(256)), freeze=True), text
+
+
+backends = ["python", "flat"] + (["native"] if native_available() else [])
+
+def make_coder(backend, hierarchical=True):
+    coder, text = frozen_coder(hierarchical)
+    if backend == "flat":
+        coder = FlatCoder(to_flat_bytes(coder))
+    elif backend == "native":
+        coder = NativeCoder.from_coder(coder)
+    return coder, text
+
+
+@pytest.mark.parametrize("backend", backends)
+@pytest.mark.parametrize("hierarchical", [True, False])
+def test_messages_round_trip(backend, hierarchical):
+    coder, text = make_coder(backend, hierarchical)
+    codec = MessageCodec(coder, sample=text, dictionary_id=7)
+    for seed in range(10):
+        message = random_text(random.Random(seed).randrange(5, 100), seed=seed).encode()
+        data = codec.encode(message)
+        assert len(data) < len(message)
+        assert codec.decode(data) == list(message)
+        assert codec.decode(bytearray(data)) == list(message)
+    assert codec.decode(codec.encode(b"")) == []
+    assert len(codec.encode(b"")) == 2
+
+    # the table travels separately, and any backend decodes any other's messages.
+    plain, _ = frozen_coder(hierarchical)
+    receiver = MessageCodec(plain, table=FrequencyTable.from_bytes(codec.table.to_bytes()), dictionary_id=7)
+    message = random_text(50, seed=99).encode()
+    assert receiver.encode(message) == codec.encode(message)
+    assert receiver.decode(codec.encode(message)) == list(message)
+    codec.close()
+
+@pytest.mark.parametrize("backend", backends)
+def test_messages_reject_other_dictionary_and_corruption(backend):
+    coder, text = make_coder(backend)
+    codec = MessageCodec(coder, sample=text, dictionary_id=1)
+    other = MessageCodec(coder, sample=text, dictionary_id=2)
+    data = codec.encode(random_text(50, seed=1))
+    with pytest.raises(ValueError):
+        other.decode(data)
+    with pytest.raises(ValueError):
+        codec.decode(data[:-1])
+    with pytest.raises(ValueError):
+        codec.decode(data + b"\0")
+    with pytest.raises(ValueError):
+        codec.decode(b"")
+    # a header claiming billions of tokens is refused before anything is allocated.
+    with pytest.raises(ValueError):
+        codec.decode(write_varint(1) + write_varint((1 << 31) - 1) + data[2:])
+    short = MessageCodec(coder, sample=text, dictionary_id=1, max_tokens=3)
+    with pytest.raises(ValueError):
+        short.decode(data)
+
+def test_message_codec_needs_frozen_coder():
+    coder = HierachicalLZCoder(output_vocab_size=64, input_vocab=set(range(10)))
+    with pytest.raises(ValueError):
+        MessageCodec(coder)
+    coder.freeze()
+    with pytest.raises(ValueError):
+        MessageCodec(coder, table=FrequencyTable.from_counts([1, 2, 3]))
+
+def test_codepoint_messages():
+    text = "".join(random.Random(1).choice(["猫", "犬", "鳥", "の", " "]) for _ in range(300))
+    coder = HierachicalLZCoder(output_vocab_size=64, input_vocab=set(map(ord, text)), input_mode=CODEPOINT_INPUT)
+    coder.encode(text, learn=True)
+    coder.freeze()
+    coders = [coder, FlatCoder(to_flat_bytes(coder))] + ([NativeCoder.from_coder(coder)] if native_available() else [])
+    for c in coders:
+        codec = MessageCodec(c, sample=text)
+        assert "".join(map(chr, codec.decode(codec.encode(text[:40])))) == text[:40]
@@ -0,0 +1,49 @@
+import math
+import random
+import pytest
+from src.lz import HierachicalLZCoder
+from src.mixing import BinaryArithmeticEncoder, BinaryArithmeticDecoder, ContextMixingModel, SQUASH, STRETCH, cm_encode, cm_decode
+from test.conftest import random_text
+
+
+def test_binary_arithmetic_coder():
+    rng = random.Random(0)
+    bits = [(rng.random() < 0.9, rng.randrange(1, 1 << 16)) for _ in range(5000)]
+    encoder = BinaryArithmeticEncoder()
+    for bit, p in bits:
+        encoder.encode(bit, p)
+    data = encoder.finish()
+    decoder = BinaryArithmeticDecoder(data)
+    assert [decoder.decode(p) for _, p in bits] == [int(b) for b, _ in bits]
+
+@pytest.mark.parametrize("orders", [(0,), (0, 1), (0, 1, 2)])
+def test_context_mixing_round_trip(orders):
+    coder = HierachicalLZCoder(output_vocab_size=256, input_vocab=set(range(256)))
+    tokens = coder.encode(random_text(3000), learn=True)
+    data = cm_encode(tokens, 256, orders)
+    assert cm_decode(data, len(tokens), 256, orders) == tokens
+    # far fewer bits than writing every token in log2(vocab) bits.
+    assert 8 * len(data) < 0.8 * len(tokens) * math.log2(257)
+
+def test_context_mixing_orders_help_on_repetitive_streams():
+    tokens = [t for _ in range(300) for t in (5, 9, -1, 7, 9, 3)]
+    sizes = [len(cm_encode(tokens, 16, orders)) for orders in [(0,), (0, 1), (0, 1, 2)]]
+    assert sizes[0] > sizes[1] > sizes[2]
+    assert cm_decode(cm_encode([], 16), 0, 16) == []
+    with pytest.raises(ValueError):
+        cm_encode([16], 16)
+
+def test_integer_mixing():
+    # squash and stretch are integer tables, and close to the real functions.
+    assert all(a <= b for a, b in zip(SQUASH, SQUASH[1:]))
+    assert all(a <= b for a, b in zip(STRETCH, STRETCH[1:]))
+    for x in range(-2047, 2048, 16):
+        assert abs(SQUASH[x + 2047] - 4096 / (1 + math.exp(-x / 256))) < 16
+        assert abs(STRETCH[SQUASH[x + 2047]] - x) < 128
+    # so the whole model state stays integer.
+    model = ContextMixingModel(17)
+    encoder = BinaryArithmeticEncoder()
+    for t in [5, 9, 0, 7, 9, 3] * 20:
+        model.code(t, encoder)
+    assert all(type(w) is int for weights in model.weights for w in weights)
+    assert all(type(p) is int and type(n) is int for table in model.tables for p, n in table.values())
@@ -0,0 +1,118 @@
+import os
+import random
+import threading
+from array import array
+import pytest
+from src.lz import LZCoder, HierachicalLZCoder, EMPTY_TOKEN, BYTE_INPUT, CODEPOINT_INPUT
+from src.flat import dump_flat, flat_bytes_from_vocabs, NO_TOKEN
+from src.native import NativeCoder, NativeRansTable, native_available, load_library, _library_path, SOURCE
+from src.entropy import FrequencyTable, MAX_PRECISION, rans_encode, write_varint
+from test.conftest import random_text, trained_hierarchical
+
+pytestmark = pytest.mark.skipif(not native_available(), reason="no C compiler for the native backend")
+
+
+def test_native_matches_coder(tmp_path):
+    text = random_text(300)
+    coder = trained_hierarchical(text, input_vocab=set(range(256)))
+    dump_flat(coder, tmp_path / "coder.flat")
+    native = NativeCoder.open(tmp_path / "coder.flat")
+
+    other = random_text(200, seed=1)
+    encoded = coder.encode(other)
+    assert native.encode(other) == encoded
+    assert native.decode(encoded) == list(other.encode())
+
+    lz = LZCoder(output_vocab_size=512, input_vocab=set(range(256)))
+    lz.encode(text, learn=True)
+    assert NativeCoder.from_coder(lz).encode(other) == lz.encode(other)
+
+    native.close()
+
+
+def test_native_buffers_and_errors():
+    text = random_text(300, seed=2)
+    coder = trained_hierarchical(text, input_vocab=set(range(256)))
+    native = NativeCoder.from_coder(coder)
+
+    out = array('i', [0] * (2 * len(text)))
+    count = native.encode_into(text.encode(), out)
+    assert out[:count].tolist() == coder.encode(text)
+
+    decoded = array('i', [0] * 4)
+    length = native.decode_into(out[:count], decoded)
+    assert length == len(text)
+    assert decoded.tolist() == list(text[:4].encode())
+
+    with pytest.raises(ValueError):
+        native.encode_into(text.encode(), array('i', [0]))
+    with pytest.raises(ValueError):
+        native.decode([100000])
+
+    # "b" is only a prefix of "bc", so its trie node has no token
+    native = NativeCoder(flat_bytes_from_vocabs(False, BYTE_INPUT, 2, [], {EMPTY_TOKEN: {0: (97,), 1: (98, 99)}}))
+    assert native.decode(native.encode(b"abca")) == list(b"abca")
+    with pytest.raises(ValueError):
+        native.decode([NO_TOKEN])
+
+
+def test_native_codepoints():
+    text = "日本語のテキスト 日本語のテキスト 🎉🎉"
+    coder = HierachicalLZCoder(output_vocab_size=64, input_mode=CODEPOINT_INPUT)
+    coder.encode(text, learn=True)
+    native = NativeCoder.from_coder(coder)
+    assert native.encode(text) == coder.encode(text)
+    assert "".join(map(chr, native.decode(coder.encode(text)))) == text
+
+
+def test_native_threads():
+    text = random_text(300, seed=3)
+    native = NativeCoder.from_coder(trained_hierarchical(text, input_vocab=set(range(256))))
+    docs = [random_text(2000, seed=i) for i in range(4)]
+    expected = [native.encode(d) for d in docs]
+    results = [None] * len(docs)
+
+    def worker(i):
+        for _ in range(10):
+            results[i] = native.decode(native.encode(docs[i]))
+
+    threads = [threading.Thread(target=worker, args=(i,)) for i in range(len(docs))]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    assert results == [list(d.encode()) for d in docs]
+    assert [native.encode(d) for d in docs] == expected
+
+@pytest.mark.parametrize("lanes", [1, 3, 4, 8])
+def test_native_rans_lanes(lanes):
+    rng = random.Random(lanes)
+    counts = [rng.randrange(100) ** 2 for _ in range(257)]
+    table = FrequencyTable.from_counts(counts)
+    native = NativeRansTable(table)
+    for n in [0, 2, 1000]:
+        tokens = [s - 1 for s in rng.choices(range(257), weights=[c + 1 for c in counts], k=n)]
+        data = native.encode(tokens, lanes)
+        assert data == rans_encode(table, [t + 1 for t in tokens], lanes)
+        assert native.decode(data, len(tokens), lanes) == tokens
+    with pytest.raises(ValueError):
+        native.decode(data[:-1], len(tokens), lanes)
+    with pytest.raises(ValueError):
+        native.encode([256], lanes)
+    native.close()
+
+    # a table read from a header with a precision the lanes cannot handle
+    precision = MAX_PRECISION + 1
+    with pytest.raises(ValueError):
+        FrequencyTable.from_bytes(bytes([precision]) + write_varint(2) + write_varint(1 << (precision - 1)) * 2)
+    table.precision = precision
+    with pytest.raises(ValueError):
+        NativeRansTable(table)
+
+
+def test_library_is_built_outside_the_package():
+    load_library()
+    path = _library_path()
+    assert os.path.exists(path)
+    assert os.path.dirname(path) != os.path.dirname(SOURCE)
+    assert [name for name in os.listdir(os.path.dirname(path)) if name.endswith(".tmp")] == []
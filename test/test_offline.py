@@ -0,0 +1,60 @@
+import random
+from src.lz import LZCoder
+from src.offline import count_substrings, select_entries, build_dictionary
+from test.conftest import random_text
+
+
+def test_count_substrings_matches_brute_force():
+    text = list(random_text(200).encode())
+    counts = count_substrings(text, max_length=6, min_count=3)
+    brute = {}
+    for length in range(2, 7):
+        for i in range(len(text) - length + 1):
+            key = tuple(text[i:i + length])
+            brute[key] = brute.get(key, 0) + 1
+    assert counts == {key: count for key, count in brute.items() if count >= 3}
+
+def test_select_entries_prefers_savings():
+    counts = {(1, 2): 10, (1, 2, 3): 9, (4, 5): 2}
+    chosen = select_entries(counts, 1)
+    assert list(chosen) == [(1, 2, 3)]
+    # with (1, 2, 3) taken, (1, 2) is left with 1 occurrence to save on.
+    chosen = select_entries(counts, 3)
+    assert list(chosen) == [(1, 2, 3), (4, 5), (1, 2)]
+
+def test_build_dictionary():
+    text = random_text(500)
+    coder = build_dictionary(text, output_vocab_size=64)
+    assert coder.frozen
+    assert len(coder.token_map) <= 64 + 1
+    assert max(coder.encoded_vocab) < 64
+    held_out = random_text(300, seed=1)
+    encoded = coder.encode(held_out)
+    assert coder.decode(encoded) == list(held_out.encode())
+
+    online = LZCoder(output_vocab_size=64, input_vocab=set(text.encode()))
+    online.encode(text, learn=True)
+    assert len(encoded) < len(online.encode(held_out))
+
+def test_build_dictionary_codepoints():
+    text = "".join(random.Random(2).choice(["猫", "犬", "鳥", "の", " "]) for _ in range(300))
+    coder = build_dictionary(text, output_vocab_size=32, input_mode="codepoints")
+    assert "".join(map(chr, coder.decode(coder.encode(text)))) == text
+    assert len(coder.encode(text)) < len(text)
+
+def test_warm_start_from_built_dictionary():
+    text = random_text(500)
+    built = build_dictionary(text, output_vocab_size=64)
+    # the test only means something if some entry's parent is missing.
+    assert not all(prefix[:-1] in built.token_map for prefix in built.encoded_vocab.values() if prefix)
+
+    warm = LZCoder.from_pretrained(built)
+    assert warm.encoded_vocab == built.encoded_vocab
+    held_out = random_text(300, seed=1)
+    assert warm.encode(held_out) == built.encode(held_out)
+    warm.encode(held_out, learn=True)
+
+    evicted = LZCoder.from_pretrained(built, evict_fraction=0.25, sample=held_out)
+    n_entries = len(built.encoded_vocab) - 1
+    assert len(evicted.encoded_vocab) - 1 == n_entries - int(n_entries * 0.25)
+    assert evicted.decode(evicted.encode(held_out)) == list(held_out.encode())
@@ -0,0 +1,102 @@
+import copy
+import pytest
+from src.lz import LZCoder, HierachicalLZCoder, CODEPOINT_INPUT
+from src.overlay import OverlayLog, OverlaySet
+from test.conftest import random_text
+
+
+@pytest.mark.parametrize("make", [
+    lambda: LZCoder(output_vocab_size=512, input_vocab=set(random_text(50).encode())),
+    lambda: HierachicalLZCoder(output_vocab_size=64, input_vocab=set(random_text(50).encode())),
+    lambda: HierachicalLZCoder(output_vocab_size=64, input_vocab=set(map(ord, random_text(50))), input_mode=CODEPOINT_INPUT),
+])
+def test_fork_learns_like_a_deep_copy(make):
+    base = make()
+    base.encode(random_text(200), learn=True)
+    base.freeze()
+    before = (len(base.entry_log), copy.deepcopy(base.coders if base.hierarchical else base.encoded_vocab))
+
+    doc = random_text(300, seed=1)
+    copied = copy.deepcopy(base)
+    copied.frozen = False
+    for coder in (copied.coders.values() if copied.hierarchical else []):
+        coder.frozen = False
+    fork = base.fork()
+    assert fork.encode(doc, learn=True) == copied.encode(doc, learn=True)
+    tokens = fork.encode(doc)
+    assert tokens == copied.encode(doc)
+    assert fork.decode(tokens) == copied.decode(tokens)
+    assert len(fork.entry_log) == len(copied.entry_log) > before[0]
+
+    # the base did not change, and still works on its own.
+    assert len(base.entry_log) == before[0]
+    if base.hierarchical:
+        assert set(base.coders) == set(before[1])
+        assert all(base.coders[c].encoded_vocab == before[1][c].encoded_vocab for c in base.coders)
+    else:
+        assert base.encoded_vocab == before[1]
+    assert base.decode(base.encode(doc)) == fork.decode(tokens)
+
+def test_fork_needs_frozen_base_and_nests():
+    base = HierachicalLZCoder(output_vocab_size=64, input_vocab=set(random_text(50).encode()))
+    with pytest.raises(ValueError):
+        base.fork()
+    base.encode(random_text(200), learn=True)
+    base.freeze()
+
+    fork = base.fork()
+    assert len(fork.coders.layer) == 0
+    fork.encode(random_text(100, seed=2), learn=True)
+    new_entries = len(fork.entry_log) - len(base.entry_log)
+    assert sum(len(c.encoded_vocab.layer) for c in fork.coders.layer.values() if hasattr(c.encoded_vocab, "layer")) \
+        + sum(len(c.encoded_vocab) - 1 for k, c in fork.coders.layer.items() if k not in base.coders) == new_entries
+
+    fork.freeze()
+    snapshot = fork.snapshot()
+    grandchild = fork.fork()
+    doc = random_text(100, seed=3)
+    assert grandchild.encode(doc, learn=True)
+    assert snapshot.encode(random_text(100, seed=2)) == fork.encode(random_text(100, seed=2))
+    assert grandchild.decode(grandchild.encode(doc)) == list(doc.encode())
+
+def test_overlay_containers():
+    log = OverlayLog([1, 2, 3])
+    log.append(4)
+    assert len(log) == 4 and log[3] == 4 and log[-1] == 4 and log[1:] == [2, 3, 4] and log[3:] == [4]
+    assert list(log) == [1, 2, 3, 4]
+
+    base = {1, 2, 3}
+    free = OverlaySet(base)
+    free.remove(2)
+    assert 2 not in free and 1 in free and len(free) == 2 and sorted(free) == [1, 3]
+    with pytest.raises(KeyError):
+        free.remove(2)
+    assert base == {1, 2, 3}
+
+    # taking the first free element over and over, as the allocator does,
+    # starts each search where the last one stopped.
+    free = OverlaySet(set(range(1000)))
+    for _ in range(990):
+        free.remove(next(iter(free)))
+    assert free.skip >= 980 and len(free) == 10 and sorted(free) == sorted(set(range(1000)) - free.taken)
+
+def test_forks_share_the_free_token_order():
+    base = HierachicalLZCoder(output_vocab_size=256, input_vocab=set(random_text(50).encode()))
+    base.encode(random_text(200), learn=True)
+    base.freeze()
+    doc = random_text(100, seed=4)
+    forks = [base.fork() for _ in range(3)]
+    for fork in forks:
+        fork.encode(doc, learn=True)
+    for context, coder in forks[0].coders.layer.items():
+        if context in base.coders:
+            # one order per base context, however many forks use it.
+            assert all(f.coders.layer[context].unused_tokens.order is coder.unused_tokens.order for f in forks)
+            assert coder.unused_tokens.order is base.coders[context]._unused_order()
+
+    forks[0].freeze()
+    grandchild = forks[0].fork()
+    grandchild.encode(random_text(100, seed=5), learn=True)
+    for context, coder in grandchild.coders.layer.items():
+        if context in base.coders:
+            assert coder.unused_tokens.base is base.coders[context].unused_tokens
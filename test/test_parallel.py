@@ -0,0 +1,124 @@
+import threading
+import pytest
+from src.lz import LZCoder
+from src.parallel import BatchEncoder, encode_batch, ParallelDecoder
+from src.flat import FlatCoder, to_flat_bytes
+from src.native import NativeCoder, native_available
+from test.conftest import random_text, trained_hierarchical
+
+
+def state(coder):
+    return [(c, dict(x.encoded_vocab), set(x.unused_tokens)) for c, x in coder.coders.items()], list(coder.entry_log)
+
+
+def test_frozen_coder_refuses_to_learn():
+    coder = trained_hierarchical(random_text(300), input_vocab=set(range(256)))
+    coder.freeze()
+    with pytest.raises(ValueError):
+        coder.encode("abra", learn=True)
+    with pytest.raises(ValueError):
+        coder.update_vocab(b"abra")
+
+    lz = LZCoder(output_vocab_size=16, input_vocab=set(b"ab"))
+    lz.freeze()
+    with pytest.raises(ValueError):
+        lz.encode_one_token(list(b"abab"), learn=True)
+
+
+def test_frozen_encode_is_read_only_across_threads():
+    coder = trained_hierarchical(random_text(300), input_vocab=set(range(256)))
+    coder.freeze()
+    before = state(coder)
+
+    docs = [random_text(100, seed=i) for i in range(8)]
+    expected = [coder.encode(d) for d in docs]
+    errors = []
+
+    def worker():
+        for _ in range(5):
+            for d, e in zip(docs, expected):
+                encoded = coder.encode(d)
+                if encoded != e or bytes(coder.decode(encoded)) != d.encode():
+                    errors.append(d)
+
+    threads = [threading.Thread(target=worker) for _ in range(4)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    assert errors == []
+    assert state(coder) == before
+
+
+@pytest.mark.parametrize("use_threads", [True, False])
+def test_batch_encoder_matches_sequential(use_threads):
+    coder = trained_hierarchical(random_text(300), input_vocab=set(range(256)))
+    with pytest.raises(ValueError):
+        BatchEncoder(coder)
+    assert not coder.frozen
+    coder.freeze()
+    docs = [random_text(50, seed=i) for i in range(10)]
+    expected = [coder.encode(d) for d in docs]
+    assert encode_batch(coder, docs, workers=2, use_threads=use_threads) == expected
+    with BatchEncoder(coder, workers=1) as encoder:
+        assert encoder.encode(docs) == expected
+
+
+@pytest.mark.parametrize("native", [False, True])
+def test_parallel_decoder_matches_decode(native):
+    if native and not native_available():
+        pytest.skip("no C compiler")
+    cls = NativeCoder if native else FlatCoder
+    text = random_text(300)
+    lz = LZCoder(output_vocab_size=256, input_vocab=set(range(256)))
+    lz.encode(text, learn=True)
+    for coder in [trained_hierarchical(random_text(300), input_vocab=set(range(256))), lz]:
+        flat = cls(to_flat_bytes(coder))
+        tokens = coder.encode(random_text(200, seed=5))
+        for workers in [1, 3, 8, 1000]:
+            for use_threads in [True, False]:
+                with ParallelDecoder(flat, workers, use_threads) as decoder:
+                    assert decoder.decode(tokens) == coder.decode(tokens)
+                    assert decoder.decode([]) == []
+        flat.close()
+
+
+@pytest.mark.parametrize("native", [False, True])
+def test_speculative_encoder_matches_encode(native):
+    if native and not native_available():
+        pytest.skip("no C compiler")
+    from src.parallel import SpeculativeEncoder
+    text = random_text(2000)
+    lz = LZCoder(output_vocab_size=256, input_vocab=set(range(256)))
+    lz.encode(text, learn=True)
+    with pytest.raises(ValueError):
+        SpeculativeEncoder(lz)
+    lz.freeze()
+    hierarchical = trained_hierarchical(random_text(300), input_vocab=set(range(256)))
+    hierarchical.freeze()
+    doc = random_text(3000, seed=9)
+    for coder in [hierarchical, lz]:
+        expected = coder.encode(doc)
+        targets = [coder, FlatCoder(to_flat_bytes(coder))]
+        if native:
+            targets = [NativeCoder.from_coder(coder)]
+        for target in targets:
+            for workers, min_chunk in [(1, 100), (4, 100), (16, 50), (3, 10000)]:
+                with SpeculativeEncoder(target, workers, min_chunk=min_chunk, window=16) as encoder:
+                    assert encoder.encode(doc) == expected
+                    assert encoder.encode("") == []
+                    if workers == 4:
+                        assert encoder.stats.chunks == 4 and encoder.stats.converged == 3
+
+def test_speculative_encoder_without_convergence():
+    # a run of one symbol never resynchronizes with a parse that starts off
+    # by one: every chunk falls back to the sequential parse.
+    from src.parallel import SpeculativeEncoder
+    coder = LZCoder(output_vocab_size=4, input_vocab=set(b"a"))
+    coder.encode(b"a" * 10, learn=True)
+    coder.freeze()
+    doc = b"a" * 1002
+    with SpeculativeEncoder(coder, workers=4, min_chunk=100, window=8) as encoder:
+        assert encoder.encode(doc) == coder.encode(doc)
+        assert encoder.stats.converged == 0
+        assert encoder.stats.resync_symbols > len(doc) - 250 - 3 * 4
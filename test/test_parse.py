@@ -0,0 +1,48 @@
+from src.lz import LZCoder
+from src.parse import optimal_parse, estimated_bits
+from test.conftest import random_text, trained, trained_hierarchical
+
+
+def test_optimal_parse_decodes_and_beats_greedy():
+    text = random_text(400)
+    for coder in [trained(text, 128, freeze=True), trained_hierarchical(text, 64, freeze=True)]:
+        sample = text[:200]
+        greedy = coder.encode(sample)
+        for beam_width in [1, 4, None]:
+            tokens = optimal_parse(coder, sample, beam_width=beam_width)
+            assert coder.decode(tokens) == list(sample.encode())
+            # only the exact search is sure to do at least as well as greedy:
+            # a narrow beam can prune the greedy path.
+            if beam_width is None:
+                assert len(tokens) <= len(greedy)
+        assert len(optimal_parse(coder, sample, beam_width=None)) <= len(optimal_parse(coder, sample, beam_width=2))
+
+def test_optimal_parse_flat_lz_is_exact():
+    # for a single dictionary the DP is exact: check against brute force.
+    coder = LZCoder(output_vocab_size=8, input_vocab=set(b"ab"))
+    coder.encode("aabab", learn=True)
+    sample = list(b"ababaab")
+
+    def fewest(i):
+        if i == len(sample):
+            return 0
+        return min(1 + fewest(i + len(p)) for p, t in coder.token_map.prefixes(sample[i:]) if len(p) > 0)
+    assert len(optimal_parse(coder, sample, beam_width=None)) == fewest(0)
+
+def test_optimal_parse_estimated_bits():
+    text = random_text(400)
+    coder = trained_hierarchical(text, 64, freeze=True)
+    sample = text[:200]
+    cost = estimated_bits(coder, text)
+    greedy = coder.encode(sample)
+    assert coder.decode(optimal_parse(coder, sample, cost=cost)) == list(sample.encode())
+    tokens = optimal_parse(coder, sample, beam_width=None, cost=cost)
+    assert coder.decode(tokens) == list(sample.encode())
+
+    def bits(tokens):
+        total, context = 0.0, -1
+        for t in tokens:
+            total += cost(context, t)
+            context = t
+        return total
+    assert bits(tokens) <= bits(greedy) + 1e-9
@@ -0,0 +1,91 @@
+import os
+import threading
+import pytest
+from src.flat import FlatCoder, dump_flat
+from src.registry import DictionaryRegistry
+from test.conftest import trained_hierarchical
+
+
+@pytest.fixture
+def tenants(tmp_path):
+    coders = {"a": trained_hierarchical("abababab abab", 64), "b": trained_hierarchical("abcabcabc abc", 64),
+              "c": trained_hierarchical("cacacaca cac", 64)}
+    for tenant, coder in coders.items():
+        dump_flat(coder, tmp_path / f"{tenant}.flat")
+    return coders, tmp_path
+
+
+def test_registry_lru_within_budget(tenants):
+    coders, directory = tenants
+    size = max(os.path.getsize(directory / f"{t}.flat") for t in coders)
+    registry = DictionaryRegistry(2 * size, directory=directory)
+
+    for tenant in ["a", "b", "a", "c", "a", "b"]:
+        text = {"a": "abab", "b": "abcabc", "c": "caca"}[tenant]
+        assert registry.encode(tenant, text) == coders[tenant].encode(text)
+    # b was evicted for c, then c (least recently used) for b.
+    assert registry.loaded == ["a", "b"]
+    assert registry.stats.hits == 2 and registry.stats.misses == 4 and registry.stats.evictions == 2
+    assert registry.stats.hit_rate == pytest.approx(1 / 3)
+    assert registry.stats.mean_load_seconds > 0
+    assert registry.loaded_bytes <= 2 * size
+
+    with pytest.raises(FileNotFoundError):
+        registry.encode("missing", "ab")
+    registry.close()
+    assert registry.loaded == [] and registry.loaded_bytes == 0
+
+def test_pinned_coder_survives_eviction(tenants):
+    coders, directory = tenants
+    registry = DictionaryRegistry(1)
+    for tenant in coders:
+        registry.register(tenant, directory / f"{tenant}.flat")
+
+    pinned = registry.pin("a")
+    registry.encode("b", "abc")
+    # over budget, so a is gone from the registry, but still open for us.
+    assert registry.loaded == ["b"]
+    assert pinned.coder.encode("abab") == coders["a"].encode("abab")
+    registry.unpin(pinned)
+    assert pinned.coder is None
+
+    assert registry.evict("b") and not registry.evict("b")
+    assert registry.loaded == []
+    with pytest.raises(KeyError):
+        registry.pin("d")
+
+
+def test_loading_does_not_block_other_tenants(tenants):
+    coders, directory = tenants
+    opening, release = threading.Event(), threading.Event()
+    opened = []
+
+    class SlowCoder(FlatCoder):
+        @classmethod
+        def open(cls, path):
+            coder = super().open(path)
+            opened.append(coder)
+            if str(path).endswith("a.flat"):
+                opening.set()
+                release.wait(10)
+            return coder
+
+    registry = DictionaryRegistry(1 << 20, directory=directory, coder_class=SlowCoder)
+    registry.encode("b", "abc")
+    results = []
+    threads = [threading.Thread(target=lambda: results.append(registry.encode("a", "abab"))) for _ in range(2)]
+    for t in threads:
+        t.start()
+    assert opening.wait(10)
+    # while a is being opened, b is still served.
+    assert registry.encode("b", "abcabc") == coders["b"].encode("abcabc")
+    release.set()
+    for t in threads:
+        t.join()
+    assert results == [coders["a"].encode("abab")] * 2
+
+    # if both requests opened a, only one copy is kept and the other is closed.
+    assert registry.loaded == ["b", "a"]
+    assert registry.stats.misses == 2
+    assert sum(coder._views == [] for coder in opened) == len(opened) - 2
+    registry.close()
@@ -0,0 +1,61 @@
+import threading
+from src.flat import FlatCoder, dump_flat
+from src.serving import HotSwapCoder
+from test.conftest import trained_hierarchical
+
+
+def test_pinned_version_survives_swap(tmp_path):
+    first, second = trained_hierarchical("abababab abab", 64), trained_hierarchical("abcabcabc abc", 64)
+    dump_flat(first, tmp_path / "first.flat")
+    dump_flat(second, tmp_path / "second.flat")
+
+    slot = HotSwapCoder()
+    assert slot.load(tmp_path / "first.flat") == 0
+
+    pinned = slot.pin()
+    old = pinned.coder
+    assert slot.load(tmp_path / "second.flat") == 1
+    assert slot.version == 1
+
+    # the old version is still usable until it is unpinned
+    assert old.encode("abab") == first.encode("abab")
+    assert slot.encode("abcabc") == second.encode("abcabc")
+
+    slot.unpin(pinned)
+    assert pinned.coder is None
+
+
+def test_unpinned_version_released_on_swap():
+    flat = FlatCoder.__new__(FlatCoder)
+    closed = []
+    flat.close = lambda: closed.append(True)
+    slot = HotSwapCoder(flat)
+    slot.swap(trained_hierarchical("abab", 64))
+    assert closed == [True]
+
+
+def test_concurrent_encode_during_swaps(tmp_path):
+    text = "abcabc abab cab"
+    coders = [trained_hierarchical(text, 64), trained_hierarchical(text + " cc", 64)]
+    for i, c in enumerate(coders):
+        dump_flat(c, tmp_path / f"{i}.flat")
+    expected = [c.encode(text) for c in coders]
+
+    slot = HotSwapCoder()
+    slot.load(tmp_path / "0.flat")
+    errors = []
+
+    def reader():
+        for _ in range(200):
+            with slot.pinned() as coder:
+                if coder.encode(text) not in expected:
+                    errors.append("bad encoding")
+
+    threads = [threading.Thread(target=reader) for _ in range(4)]
+    for t in threads:
+        t.start()
+    for i in range(50):
+        slot.load(tmp_path / f"{i % 2}.flat")
+    for t in threads:
+        t.join()
+    assert errors == []
@@ -0,0 +1,46 @@
+from multiprocessing import get_context, resource_tracker
+from src.lz import HierachicalLZCoder
+from src.shared import SharedCoderSegment, attach
+from test.conftest import random_text
+
+
+def encode_in_worker(args):
+    name, doc = args
+    coder = attach(name)
+    try:
+        return coder.encode(doc)
+    finally:
+        coder.close()
+
+
+def test_shared_memory_roundtrip():
+    text = random_text(300)
+    coder = HierachicalLZCoder(output_vocab_size=256, input_vocab=set(range(256)))
+    coder.encode(text, learn=True)
+    docs = [random_text(100, seed=i) for i in range(4)]
+
+    with SharedCoderSegment(coder) as segment:
+        attached = attach(segment.name)
+        assert attached.encode(docs[0]) == coder.encode(docs[0])
+        attached.close()
+
+        with get_context("spawn").Pool(2) as pool:
+            results = pool.map(encode_in_worker, [(segment.name, d) for d in docs])
+        assert results == [coder.encode(d) for d in docs]
+
+
+def test_attach_leaves_the_segment_to_its_publisher(monkeypatch):
+    text = random_text(100)
+    coder = HierachicalLZCoder(output_vocab_size=64, input_vocab=set(text.encode()))
+    coder.encode(text, learn=True)
+
+    with SharedCoderSegment(coder) as segment:
+        registered = []
+        monkeypatch.setattr(resource_tracker, "register", lambda *args: registered.append(args))
+        attached = attach(segment.name)
+        assert attached.encode(text) == coder.encode(text)
+        attached.close()
+        assert registered == []
+        # still there after the attached coder is gone.
+        attached = attach(segment.name)
+        attached.close()
@@ -0,0 +1,74 @@
+import random
+import pytest
+from src import suffix_array
+from src.suffix_array import SuffixArray
+from src.offline import count_substrings, build_dictionary
+from test.conftest import random_text
+
+
+def naive_suffix_array(s):
+    return sorted(range(len(s)), key=lambda i: s[i:])
+
+
+@pytest.fixture(params=["native", "python"])
+def backend(request, monkeypatch):
+    if request.param == "native" and not suffix_array.native_available():
+        pytest.skip("no C compiler")
+    if request.param == "python":
+        monkeypatch.setattr(suffix_array, "native_available", lambda: False)
+    return request.param
+
+
+def test_suffix_array_matches_naive(backend):
+    rng = random.Random(0)
+    cases = [b"", b"a", b"banana", b"aaaaaaaa", b"abababab", b"mississippi", random_text(200).encode()]
+    cases += [bytes(rng.choice(b"ab") for _ in range(rng.randrange(1, 60))) for _ in range(50)]
+    for s in cases:
+        index = SuffixArray(s)
+        assert list(index.sa) == naive_suffix_array(s)
+        for i in range(1, len(s)):
+            a, b = s[index.sa[i - 1]:], s[index.sa[i]:]
+            h = 0
+            while h < min(len(a), len(b)) and a[h] == b[h]:
+                h += 1
+            assert index.lcp[i] == h
+
+def test_token_ids_and_count(backend):
+    tokens = [1000, 5, 1000, 5, 7, 1000, 5]
+    index = SuffixArray(tokens)
+    assert list(index.sa) == naive_suffix_array(tokens)
+    assert index.count([1000, 5]) == 3
+    assert index.count([5, 7, 1000]) == 1
+    assert index.count([6]) == 0
+
+    text = random_text(300)
+    index = SuffixArray(text)
+    for pattern in ["abra", "cat ", "hocuspocus", "xyz"]:
+        assert index.count(pattern) == sum(text.startswith(pattern, i) for i in range(len(text)))
+
+def test_frequent_substrings_matches_counting_trie():
+    text = random_text(400).encode()
+    index = SuffixArray(text)
+    for min_count, max_length in [(2, 8), (5, 32)]:
+        assert index.frequent_substrings(min_count, max_length) == count_substrings(text, max_length, min_count)
+
+def test_builder_with_suffix_array_counts():
+    text = random_text(400)
+    counts = SuffixArray(text).frequent_substrings(3, 16)
+    coder = build_dictionary(text, 64, counts=counts)
+    assert coder.decode(coder.encode(text)) == list(text.encode())
+    assert coder.encode(text) == build_dictionary(text, 64, max_length=16, min_count=3).encode(text)
+    assert coder.encode(text) == build_dictionary(text, 64, max_length=16, min_count=3, suffix_array=True).encode(text)
+
+def test_backends_agree(monkeypatch):
+    if not suffix_array.native_available():
+        pytest.skip("no C compiler")
+    rng = random.Random(1)
+    text = random_text(3000).encode() + bytes(rng.randrange(256) for _ in range(2000))
+    tokens = [rng.randrange(300) for _ in range(3000)]
+    for s in [text, tokens]:
+        native = SuffixArray(s)
+        with monkeypatch.context() as m:
+            m.setattr(suffix_array, "native_available", lambda: False)
+            python = SuffixArray(s)
+        assert native.sa == python.sa and native.lcp == python.lcp
@@ -0,0 +1,148 @@
+import json
+import pytest
+from src.lz import LZCoder, HierachicalLZCoder, EMPTY_TOKEN, CODEPOINT_INPUT
+from src.train import train, load_checkpoint, resume_training, sample_blocks, sampled_training, held_out_tokens
+from test.conftest import random_text
+
+
+def assert_same_state(a, b):
+    assert a.entry_log == b.entry_log
+    if isinstance(a, HierachicalLZCoder):
+        assert a.coders.keys() == b.coders.keys()
+        pairs = [(a.coders[c], b.coders[c]) for c in a.coders]
+    else:
+        pairs = [(a, b)]
+    for x, y in pairs:
+        assert x.encoded_vocab == y.encoded_vocab
+        assert x.unused_tokens == y.unused_tokens
+        assert x.input_vocab == y.input_vocab
+        assert list(x.unused_tokens) == list(y.unused_tokens)
+
+
+def test_train_matches_encode(tmp_path):
+    text = random_text(300)
+    coder = train(HierachicalLZCoder(output_vocab_size=128, input_vocab=set(text.encode())), text, tmp_path / "ckpt")
+    reference = HierachicalLZCoder(output_vocab_size=128, input_vocab=set(text.encode()))
+    reference.encode(text, learn=True)
+    assert_same_state(coder, reference)
+
+    loaded, position, _ = load_checkpoint(tmp_path / "ckpt")
+    assert position == len(text)
+    assert_same_state(loaded, reference)
+
+
+def test_checkpoints_are_incremental(tmp_path):
+    text = random_text(400, seed=1)
+    coder = HierachicalLZCoder(output_vocab_size=128, input_vocab=set(text.encode()))
+    train(coder, text, tmp_path / "ckpt", checkpoint_every=100)
+
+    with open(tmp_path / "ckpt") as f:
+        records = [json.loads(line) for line in f][1:]
+    assert len(records) > 3
+    assert sum(len(r["entries"]) for r in records) == len(coder.entry_log)
+    positions = [r["position"] for r in records]
+    assert positions == sorted(positions)
+
+
+def test_resume_after_crash(tmp_path):
+    text = random_text(400, seed=2)
+    vocab = set(text.encode())
+    full = train(HierachicalLZCoder(output_vocab_size=128, input_vocab=vocab), text, tmp_path / "full", checkpoint_every=100)
+
+    # crash: keep the first two checkpoints plus half of the third record.
+    with open(tmp_path / "full") as f:
+        lines = f.readlines()
+    with open(tmp_path / "crashed", "w") as f:
+        f.writelines(lines[:3])
+        f.write(lines[3][:len(lines[3]) // 2])
+
+    resumed = resume_training(tmp_path / "crashed", text, checkpoint_every=100)
+    assert_same_state(resumed, full)
+    assert resumed.encode(text) == full.encode(text)
+
+    # the resumed checkpoint file is complete again
+    assert_same_state(load_checkpoint(tmp_path / "crashed")[0], full)
+
+
+def test_resume_lz_coder_codepoints(tmp_path):
+    text = random_text(200, seed=3) + "日本語日本語"
+    full = train(LZCoder(output_vocab_size=256, input_mode=CODEPOINT_INPUT), text, tmp_path / "full", checkpoint_every=50)
+
+    with open(tmp_path / "full") as f:
+        lines = f.readlines()
+    with open(tmp_path / "crashed", "w") as f:
+        f.writelines(lines[:2])
+
+    resumed = resume_training(tmp_path / "crashed", text, checkpoint_every=50)
+    assert_same_state(resumed, full)
+    assert resumed.alphabet.symbols == full.alphabet.symbols
+
+def test_sample_blocks_budget_and_order():
+    documents = [random_text(200, seed) for seed in range(20)]
+    blocks = sample_blocks(documents, budget=2000, block_size=100, seed=1)
+    assert len(blocks) == 20
+    corpus = "".join(documents).encode()
+    positions = [corpus.find(block) for block in blocks]
+    assert all(p >= 0 for p in positions)
+    assert positions == sorted(positions)
+
+    # every stratum gets its share, however small.
+    big = [random_text(2000, 100 + i) for i in range(5)]
+    small = [random_text(100, 200)]
+    blocks = sample_blocks(big + small, budget=2000, block_size=100, strata=lambda i, d: i < len(big))
+    assert any(block in small[0].encode() for block in blocks)
+
+    # blocks larger than the budget are cut down to it.
+    blocks = sample_blocks(documents, budget=50, block_size=100)
+    assert len(blocks) == 1 and len(blocks[0]) <= 50
+    with pytest.raises(ValueError):
+        sample_blocks(documents, budget=0)
+
+def test_sampled_training_reports_held_out():
+    documents = [random_text(300, seed) for seed in range(10)]
+    held_out = random_text(300, 99)
+    coder, report = sampled_training(documents, budget=1000, held_out=held_out, block_size=250,
+                                     make_coder=lambda: HierachicalLZCoder(output_vocab_size=256, input_vocab=set(range(256))))
+    assert 0 < report.sample_bytes <= 1000
+    assert report.held_out_bytes == len(held_out)
+    assert report.held_out_tokens == held_out_tokens(coder, held_out) == len(coder.encode(held_out))
+
+    # for an LZCoder that knows every symbol this is just the greedy encoding.
+    lz = LZCoder(output_vocab_size=256, input_vocab=set(held_out.encode()))
+    lz.encode(documents[0], learn=True)
+    assert held_out_tokens(lz, held_out) == len(lz.encode(held_out))
+
+def test_sample_blocks_streams_strata_within_budget():
+    # more strata than the budget has blocks, and one stratum per document:
+    # never more than the budget, and the documents are only iterated once.
+    documents = iter([random_text(100 + 50 * i, i) for i in range(12)])
+    blocks = sample_blocks(documents, budget=1000, block_size=100, strata=lambda i, d: i)
+    assert len(blocks) == 10
+    documents = [random_text(300, i) for i in range(7)]
+    blocks = sample_blocks(documents, budget=1000, block_size=100, strata=lambda i, d: i % 3)
+    assert len(blocks) == 10
+
+def test_held_out_counts_unseen_symbols_and_codepoints():
+    # symbols the coder has never seen still cost a token each.
+    lz = LZCoder(output_vocab_size=256, input_vocab=set(b"abc"))
+    lz.encode("abcabc", learn=True)
+    assert held_out_tokens(lz, "abcxyz") == held_out_tokens(lz, "abc") + 3
+
+    documents = [random_text(200, seed) + "日本語" for seed in range(5)]
+    held_out = "日本語" + random_text(100, 99)
+    coder, report = sampled_training(documents, budget=10000, held_out=held_out, block_size=250,
+                                     make_coder=lambda: LZCoder(output_vocab_size=4096, input_vocab=set(map(ord, held_out)),
+                                                                input_mode=CODEPOINT_INPUT))
+    assert report.held_out_bytes == len(held_out)
+    assert report.held_out_tokens == len(coder.encode(held_out))
+
+def test_checkpoint_warm_start_not_prefix_closed(tmp_path):
+    # (a, b, c) without (a, b): training learns (a, b) after (a, b, c).
+    base = LZCoder(output_vocab_size=16, input_vocab=set(b"abcq"))
+    base._add_new_token(tuple(b"abc"), 4)
+    base.freeze()
+    coder = train(LZCoder.from_pretrained(base), "abq", tmp_path / "ckpt")
+    assert tuple(b"ab") in coder.token_map
+    loaded, position, _ = load_checkpoint(tmp_path / "ckpt")
+    assert position == 3
+    assert_same_state(loaded, coder)